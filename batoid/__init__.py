@@ -1,13 +1,16 @@
 from ._version import __version__, __version_info__
 
-from .rayVector import RayVector, concatenateRayVectors
+from .rayVector import (
+    RayVector, SegmentedRayVector, RayStatistics, RayFocus,
+    concatenateRayVectors, setRayAllocation, clearRayPool
+)
 
 from .coordSys import CoordSys, RotX, RotY, RotZ
 from .coordTransform import CoordTransform
 
 from .surface import (
     Surface, Plane, Paraboloid, Sphere, Quadric, Asphere, Bicubic, Sum, Tilted,
-    Zernike
+    Zernike, RadialSpline
 )
 
 from .trace import (
@@ -16,15 +19,16 @@ from .trace import (
 )
 
 from .medium import (
-    Medium, ConstMedium, TableMedium, SellmeierMedium, SumitaMedium, Air
+    Medium, ConstMedium, TableMedium, SellmeierMedium, SumitaMedium, Air,
+    TabulatedMedium
 )
 
 from .obscuration import (
     Obscuration, ObscCircle, ObscAnnulus, ObscRectangle, ObscRay, ObscPolygon,
-    ObscNegation, ObscUnion, ObscIntersection
+    ObscBitmap, ObscNegation, ObscUnion, ObscIntersection
 )
 
-from .coating import Coating, SimpleCoating
+from .coating import Coating, SimpleCoating, TableCoating, MultilayerCoating
 
 from .optic import Optic, CompoundOptic, Lens
 from .optic import Interface, RefractiveInterface, Mirror, Detector, Baffle
@@ -41,8 +45,8 @@ from . import utils
 from .constants import globalCoordSys, vacuum
 
 from .analysis import (
-    huygensPSF, fftPSF, wavefront, spot,
-    zernike, zernikeGQ, zernikeTA, doubleZernike,
+    huygensPSF, fftPSF, fftPSFBatch, wavefront, spot,
+    zernike, zernikeGQ, ZernikeProjector, zernikeTA, doubleZernike,
     drdth, dthdr, exitPupilPos
 )
 from . import plotUtils
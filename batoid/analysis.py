@@ -1,6 +1,9 @@
+from functools import lru_cache
+
 import numpy as np
 import batoid
 
+from . import _batoid
 from .utils import bilinear_fit, fieldToDirCos
 
 
@@ -12,7 +15,8 @@ def _reciprocalLatticeVectors(a1, a2, N):
 
 
 def dkdu(
-    optic, theta_x, theta_y, wavelength, nrad=6, naz=36, projection='postel'
+    optic, theta_x, theta_y, wavelength, nrad=6, naz=36, projection='postel',
+    method='fit'
 ):
     """Calculate derivative of outgoing ray k-vector with respect to incoming
     ray pupil coordinate.
@@ -32,6 +36,11 @@ def dkdu(
         RayVector.asPolar())
     projection : {'postel', 'zemax', 'gnomonic', 'stereographic', 'lambert', 'orthographic'}
         Projection used to convert field angle to direction cosines.
+    method : {'fit', 'differential'}, optional
+        'fit' fits a plane to the traced rays' k-vectors as a function of their
+        initial pupil coordinates.  'differential' instead averages the local
+        derivative of each ray, propagated alongside it through the trace (see
+        RayVector.differentials).  Default: 'fit'.
 
     Returns
     -------
@@ -39,22 +48,55 @@ def dkdu(
         Jacobian transformation matrix for converting between (kx, ky) of rays
         impacting the focal plane and initial pupil plane coordinate.
     """
+    if method not in ('fit', 'differential'):
+        raise ValueError(f"Unknown method {method!r}")
 
     rays = batoid.RayVector.asPolar(
         optic=optic, theta_x=theta_x, theta_y=theta_y, wavelength=wavelength,
-        projection=projection, nrad=nrad, naz=naz
+        projection=projection, nrad=nrad, naz=naz,
+        differentials=(method == 'differential')
     )
+    if method == 'differential':
+        # Initial derivatives of (x, y) with respect to the stop coordinates.
+        duds = rays.differentials[0:2, 0:2].copy()
+        optic.trace(rays)
+        return _dkduDifferential(duds, rays)
+
     ux = np.array(rays.x)
     uy = np.array(rays.y)
 
     optic.trace(rays)
+    return _dkduFit(ux, uy, rays)
+
+
+def _dkduFit(ux, uy, rays):
+    # Fit of traced rays' k against their initial pupil coordinates ux, uy.
     w = ~rays.vignetted
     soln = bilinear_fit(ux[w], uy[w], rays.kx[w], rays.ky[w])
     return soln[1:]
 
 
+def _dkduDifferential(duds, rays):
+    # Mean over unvignetted rays of dk/du = dk/ds (du/ds)^-1, where s are the
+    # stop coordinates the differentials were seeded with.  Laid out like
+    # _dkduFit, i.e., out[i, j] = dk_j/du_i.
+    w = ~rays.vignetted
+    d = rays.differentials[0:2, :, w]
+    v = rays.v[w].T
+    vsq = np.sum(v*v, axis=0)
+    dv = d[:, 3:5]
+    vdv = np.einsum("cn,kcn->kn", v, d[:, 3:6])
+    dkds = 2*np.pi/rays.wavelength[w]*(dv/vsq - 2*v[:2]*vdv[:, None]/vsq**2)
+    # Both arrays are indexed [s_k, component, ray]; move rays to the front so
+    # each is a stack of matrices with rows indexed by s.
+    A = np.moveaxis(duds[..., w], -1, 0)
+    B = np.moveaxis(dkds, -1, 0)
+    return np.mean(np.linalg.solve(A, B), axis=0)
+
+
 def drdth(
-    optic, theta_x, theta_y, wavelength, nrad=6, naz=36, projection='postel'
+    optic, theta_x, theta_y, wavelength, nrad=6, naz=36, projection='postel',
+    method='differential'
 ):
     """Calculate derivative of focal plane coord with respect to field angle.
 
@@ -73,6 +115,11 @@ def drdth(
         RayVector.asPolar())
     projection : {'postel', 'zemax', 'gnomonic', 'stereographic', 'lambert', 'orthographic'}
         Projection used to convert field angle to direction cosines.
+    method : {'differential', 'finite'}, optional
+        'differential' propagates the derivatives of each ray with respect to
+        field angle through a single trace (see RayVector.differentials).
+        'finite' traces two additional ray bundles at field angles offset by
+        1e-5 radians and takes finite differences.  Default: 'differential'.
 
     Returns
     -------
@@ -86,7 +133,19 @@ def drdth(
         pixels -> ra/dec).  It should be *close* to the inverse plate scale
         though, especially near the center of the tangent plane projection.
     """
-    # We just use a finite difference approach here.
+    if method == 'differential':
+        rays = batoid.RayVector.asPolar(
+            optic=optic, wavelength=wavelength,
+            theta_x=theta_x, theta_y=theta_y, projection=projection,
+            nrad=nrad, naz=naz, differentials=True
+        )
+        optic.trace(rays)
+        w = ~rays.vignetted
+        # differentials are indexed [theta_j, r_i, ray]
+        return np.mean(rays.differentials[2:4, 0:2, w], axis=-1).T
+    elif method != 'finite':
+        raise ValueError(f"Unknown method {method!r}")
+
     dth = 1e-5
 
     # Make direction cosine vectors
@@ -110,15 +169,8 @@ def drdth(
         nrad=nrad, naz=naz
     )
 
-    # Faster to concatenate and trace all at once
-    rays_c = batoid.concatenateRayVectors(
-        [rays, rays_x, rays_y]
-    )
-    optic.trace(rays_c)
-    n = len(rays)
-    rays = rays_c[:n]
-    rays_x = rays_c[n:2*n]
-    rays_y = rays_c[2*n:3*n]
+    # Trace all three bundles together; each is traced in place.
+    optic.trace(batoid.SegmentedRayVector([rays, rays_x, rays_y]))
 
     w = ~rays.vignetted
     mx = np.mean(rays.x[w])
@@ -178,7 +230,7 @@ def dthdr(
 def huygensPSF(
     optic, theta_x, theta_y, wavelength,
     projection='postel', nx=None, dx=None, dy=None,
-    nxOut=None, reference='chief'
+    nxOut=None, reference='chief', method='direct', tol=1e-10
 ):
     r"""Compute a PSF via the Huygens construction.
 
@@ -203,6 +255,18 @@ def huygensPSF(
         If 'chief', then center the output lattice where the chief ray
         intersects the focal plane.  If 'mean', then center at the mean
         non-vignetted ray intersections.
+    method : {'direct', 'recurrence', 'nufft'}
+        If 'direct', evaluate the phase of every ray at every output point.
+        If 'recurrence', step the rays' complex amplitudes along rows of the
+        output lattice by complex multiplication, recomputing them exactly
+        every 32 points.  This is several times faster, and agrees with
+        'direct' to about 1e-15 relative to the peak amplitude.
+        If 'nufft', use a nonuniform FFT, taking time proportional to the
+        number of rays plus the number of output points (times a log) rather
+        than their product.  Best for large ray and output grids.
+    tol : float, optional
+        Accuracy of the 'nufft' method, as a fraction of the summed ray flux,
+        between 0 and 1.  Ignored for other methods.  Default: 1e-10.
 
     Returns
     -------
@@ -233,6 +297,19 @@ def huygensPSF(
     """
     from numbers import Real
 
+    nufftTol = None
+    if method == 'direct':
+        resync = 0
+    elif method == 'recurrence':
+        resync = 32
+    elif method == 'nufft':
+        if not 0 < tol < 1:
+            raise ValueError(f"tol must be between 0 and 1, got {tol!r}")
+        resync = 0
+        nufftTol = tol
+    else:
+        raise ValueError(f"Unknown method {method!r}")
+
     if dx is None:
         if (nx%2) == 0:
             primitiveU = np.array(
@@ -273,10 +350,6 @@ def huygensPSF(
         dirCos=dirCos, nx=nx
     )
 
-    amplitudes = np.zeros(
-        (nxOut*pad_factor, nxOut*pad_factor),
-        dtype=np.complex128
-    )
     out = batoid.Lattice(
         np.zeros((nxOut*pad_factor, nxOut*pad_factor), dtype=float),
         primitiveX
@@ -284,20 +357,21 @@ def huygensPSF(
 
     optic.trace(rays)
     if reference == 'mean':
-        w = np.where(1-rays.vignetted)[0]
-        point = np.mean(rays.r[w], axis=0)
+        point = rays.stats().mean
     elif reference == 'chief':
         cridx = (nx//2)*nx+nx//2 if (nx%2)==0 else (nx*nx-1)//2
         point = rays.r[cridx]
-    # Need transpose to conform to numpy [y,x] ordering convention
-    xs = out.coords[..., 0].T + point[0]
-    ys = out.coords[..., 1].T + point[1]
-    zs = np.zeros_like(xs)
-
-    points = np.concatenate([aux[..., None] for aux in (xs, ys, zs)], axis=-1)
+    # Evaluate on the lattice of out.coords, offset to point in the z=0 plane.
+    # Output is transposed to conform to numpy [y,x] ordering convention, so
+    # the second primitive vector runs along rows.
+    N = nxOut*pad_factor
+    du = np.array([primitiveX[0, 0], primitiveX[0, 1], 0.0])
+    dv = np.array([primitiveX[1, 0], primitiveX[1, 1], 0.0])
+    r0 = np.array([point[0], point[1], 0.0]) - (N//2)*(du+dv)
     time = rays.t[0]
-    for idx in np.ndindex(amplitudes.shape):
-        amplitudes[idx] = rays.sumAmplitude(points[idx], time)
+    amplitudes = rays.sumAmplitudeGrid(
+        r0, du, dv, N, N, time, resync=resync, tol=nufftTol
+    )
     out.array = np.abs(amplitudes)**2
     return out
 
@@ -343,35 +417,40 @@ def wavefront(
         optic=optic, wavelength=wavelength,
         nx=nx, dirCos=dirCos
     )
-    if sphereRadius is None:
-        sphereRadius = optic.sphereRadius
-
     optic.trace(rays)
-    if reference == 'mean':
-        w = np.where(1-rays.vignetted)[0]
-        point = np.mean(rays.r[w], axis=0)
-    elif reference == 'chief':
-        cridx = (nx//2)*nx+nx//2 if (nx%2)==0 else (nx*nx-1)//2
-        point = rays.r[cridx]
-    # Place vertex of reference sphere one radius length away from the
-    # intersection point.  So transform our rays into that coordinate system.
-    targetCoordSys = rays.coordSys.shiftLocal(
-        point+np.array([0,0,sphereRadius])
+    return _wavefrontFromRays(
+        optic, rays, wavelength, nx, sphereRadius, reference
     )
-    rays.toCoordSys(targetCoordSys)
 
-    sphere = batoid.Sphere(-sphereRadius)
-    sphere.intersect(rays)
+
+def _wavefrontFromRays(optic, rays, wavelength, nx, sphereRadius, reference):
+    # The part of wavefront after tracing the nx x nx grid of rays.
+    if sphereRadius is None:
+        sphereRadius = optic.sphereRadius
 
     if reference == 'mean':
-        w = np.where(1-rays.vignetted)[0]
-        t0 = np.mean(rays.t[w])
+        chief = -1
     elif reference == 'chief':
-        t0 = rays.t[cridx]
-    arr = np.ma.masked_array(
-        (t0-rays.t)/wavelength,
-        mask=rays.vignetted
-    ).reshape(nx, nx)
+        chief = (nx//2)*nx+nx//2 if (nx%2)==0 else (nx*nx-1)//2
+    else:
+        raise ValueError(f"Unknown reference {reference!r}")
+    if len(rays) != nx*nx:
+        raise ValueError(
+            f"Expected {nx*nx} rays for nx={nx}, got {len(rays)}"
+        )
+    if chief >= nx*nx:
+        raise ValueError(f"No chief ray in a grid with nx={nx}")
+    # Intersect the rays with the reference sphere centered on the reference
+    # point and take their time differences there, all in one C++ pass
+    # without modifying the rays.
+    opd = np.empty(nx*nx)
+    mask = np.empty(nx*nx, dtype=bool)
+    bounds = np.array([0, nx*nx], dtype=np.uint64)
+    _batoid.wavefront(
+        rays._rv, bounds.ctypes.data, 1, sphereRadius, chief, wavelength,
+        opd.ctypes.data, mask.ctypes.data
+    )
+    arr = np.ma.masked_array(opd, mask=mask).reshape(nx, nx)
     if (nx%2) == 0:
         primitiveU = np.vstack(
             [[optic.pupilSize/(nx-2), 0],
@@ -396,8 +475,7 @@ def spot(
     )
     optic.trace(rays)
     if reference == 'mean':
-        w = np.where(1-rays.vignetted)[0]
-        point = np.mean(rays.r[w], axis=0)
+        point = rays.stats().mean
     elif reference == 'chief':
         cridx = (nx//2)*nx+nx//2 if (nx%2)==0 else (nx*nx-1)//2
         point = rays[cridx].r[0]
@@ -453,13 +531,9 @@ def fftPSF(
         nx=nx, projection=projection,
         sphereRadius=sphereRadius, reference=reference
     )
-    wfarr = wf.array
     pad_size = nx*pad_factor
     expwf = np.zeros((pad_size, pad_size), dtype=np.complex128)
-    start = pad_size//2-nx//2
-    stop = pad_size//2+nx//2
-    expwf[start:stop, start:stop][~wfarr.mask] = \
-        np.exp(2j*np.pi*wfarr[~wfarr.mask])
+    _padWavefront(wf.array, expwf)
     psf = np.abs(np.fft.fftshift(np.fft.fft2(expwf)))**2
     primitiveU = wf.primitiveVectors
     primitiveK = dkdu(
@@ -473,6 +547,133 @@ def fftPSF(
     return batoid.Lattice(psf, primitiveX)
 
 
+def _padWavefront(wfarr, expwf):
+    # Write exp(2 pi i wavefront) into the center of the zeroed array expwf.
+    nx = len(wfarr)
+    pad_size = len(expwf)
+    start = pad_size//2-nx//2
+    stop = pad_size//2+nx//2
+    expwf[start:stop, start:stop][~wfarr.mask] = \
+        np.exp(2j*np.pi*wfarr[~wfarr.mask])
+
+
+def fftPSFBatch(
+    optic, theta_x, theta_y, wavelength,
+    projection='postel', nx=32, pad_factor=2,
+    sphereRadius=None, reference='chief'
+):
+    """Compute PSFs using FFT for many field angles and wavelengths at once.
+
+    Equivalent to `fftPSF` for every combination of field angle and
+    wavelength.  The pupil rays of all of them, including those used for the
+    `dkdu` fits, are generated together and traced in a single pass, and the
+    PSFs of each wavelength are transformed as one stack through a reused
+    padded buffer.
+
+    Parameters
+    ----------
+    optic : batoid.Optic
+        Optical system
+    theta_x, theta_y : array_like of float
+        Field angles in radians.  Broadcast against each other.
+    wavelength : float or array_like of float
+        Wavelengths in meters
+    projection : {'postel', 'zemax', 'gnomonic', 'stereographic', 'lambert', 'orthographic'}
+        Projection used to convert field angle to direction cosines.
+    nx : int, optional
+        Size of ray grid to use.
+    pad_factor : int, optional
+        Factor by which to pad pupil array.  Default: 2
+    sphereRadius : float, optional
+        The radius of the reference sphere.  See `fftPSF`.
+    reference : {'chief', 'mean'}
+        If 'chief', then center the output lattice where the chief ray
+        intersects the focal plane.  If 'mean', then center at the mean
+        non-vignetted ray intersection.
+
+    Returns
+    -------
+    psfs : ndarray of batoid.Lattice
+        Array of shape ``np.shape(wavelength) + np.shape(theta_x)`` (after
+        broadcasting theta_x and theta_y) of the PSFs.
+    """
+    theta_x, theta_y = np.broadcast_arrays(theta_x, theta_y)
+    fieldShape = theta_x.shape
+    theta_x = theta_x.ravel()
+    theta_y = theta_y.ravel()
+    wavelength = np.asarray(wavelength, dtype=float)
+    waveShape = wavelength.shape
+    wavelength = wavelength.ravel()
+    nfield = len(theta_x)
+    nwave = len(wavelength)
+
+    # Ray positions depend only on the field angle, so make them once per
+    # field: the PSF grid followed by the dkdu rays.
+    blocks = []
+    pupils = []
+    dirCos = np.empty((nfield, 3))
+    for i in range(nfield):
+        dirCos[i] = fieldToDirCos(theta_x[i], theta_y[i], projection=projection)
+        grid = batoid.RayVector.asGrid(
+            optic=optic, wavelength=wavelength[0],
+            nx=nx, dirCos=dirCos[i]
+        )
+        polar = batoid.RayVector.asPolar(
+            optic=optic, wavelength=wavelength[0],
+            nrad=6, naz=36, dirCos=dirCos[i]
+        )
+        pupils.append((np.array(polar.x), np.array(polar.y)))
+        blocks.extend([grid, polar])
+    fieldRays = batoid.concatenateRayVectors(blocks)
+    npix = nx*nx
+    nblock = len(fieldRays)//nfield
+
+    # Then repeat them for each wavelength, with the speed in the incoming
+    # medium at that wavelength, and trace everything together.
+    n = np.atleast_1d(optic.inMedium.getN(wavelength))
+    norm = np.sqrt(np.einsum("ab,ab->a", dirCos, dirCos))
+    v = dirCos/(n[:, None, None]*norm[:, None])
+    v = np.repeat(v.reshape(-1, 3), nblock, axis=0)
+    rays = batoid.RayVector(
+        np.tile(fieldRays.x, nwave),
+        np.tile(fieldRays.y, nwave),
+        np.tile(fieldRays.z, nwave),
+        v[:, 0], v[:, 1], v[:, 2],
+        t=0.0,
+        wavelength=np.repeat(wavelength, nfield*nblock),
+        coordSys=fieldRays.coordSys
+    )
+    del fieldRays, blocks, v
+    optic.trace(rays)
+
+    pad_size = nx*pad_factor
+    expwf = np.empty((nfield, pad_size, pad_size), dtype=np.complex128)
+    out = np.empty(nwave*nfield, dtype=object)
+    for k in range(nwave):
+        expwf[:] = 0
+        primitiveX = []
+        for i in range(nfield):
+            start = (k*nfield+i)*nblock
+            wf = _wavefrontFromRays(
+                optic, rays[start:start+npix], wavelength[k], nx,
+                sphereRadius, reference
+            )
+            _padWavefront(wf.array, expwf[i])
+            primitiveK = _dkduFit(
+                *pupils[i], rays[start+npix:start+nblock]
+            ).dot(wf.primitiveVectors)
+            primitiveX.append(np.vstack(
+                _reciprocalLatticeVectors(
+                    primitiveK[0], primitiveK[1], pad_size
+                )
+            ))
+        psf = np.fft.fft2(expwf)
+        psf = np.abs(np.fft.fftshift(psf, axes=(-2, -1)))**2
+        for i in range(nfield):
+            out[k*nfield+i] = batoid.Lattice(psf[i], primitiveX[i])
+    return out.reshape(waveShape+fieldShape)
+
+
 def zernike(
     optic, theta_x, theta_y, wavelength,
     projection='postel', nx=32,
@@ -633,74 +834,169 @@ def zernikeGQ(
     unaffected by vignetting.  It is required that no rays fail to be traced,
     even in vignetted regions.
     """
-    import galsim
-    dirCos = fieldToDirCos(theta_x, theta_y, projection=projection)
-
-    inner = eps*optic.pupilSize/2
-    rays = batoid.RayVector.asSpokes(
-        optic=optic, wavelength=wavelength,
-        inner=inner,
-        dirCos=dirCos,
-        rings=rings,
-        spokes=spokes,
-        spacing='GQ',
+    return ZernikeProjector(
+        optic, rings=rings, spokes=spokes, jmax=jmax, eps=eps
+    )(
+        theta_x, theta_y, wavelength,
+        projection=projection, sphereRadius=sphereRadius, reference=reference
     )
 
-    # Trace to stopSurface to get points at which to evaluate Zernikes
-    epRays = rays.copy().toCoordSys(optic.stopSurface.coordSys)
-    optic.stopSurface.surface.intersect(epRays)
 
+@lru_cache(maxsize=32)
+def _gqProjection(jmax, rings, spokes, outer, eps):
+    # Gaussian quadrature nodes on the annulus eps*outer < r < outer, laid out
+    # as in RayVector.asSpokes with spacing='GQ', their weights, and the
+    # matrix projecting values at the nodes onto annular Zernike
+    # coefficients.  Cached, so the arrays are made read-only.
+    import galsim
+    area = np.pi*(1-eps**2)
+    Li, w = np.polynomial.legendre.leggauss(rings)
+    radii = np.sqrt(eps**2 + (1+Li)*(1-eps**2)/2)*outer
+    azs = np.linspace(0, 2*np.pi, spokes, endpoint=False)
+    radii, azs = np.meshgrid(radii, azs)
+    weights = np.broadcast_to(w*area/(2*spokes), radii.shape).ravel()
+    x = (radii*np.cos(azs)).ravel()
+    y = (radii*np.sin(azs)).ravel()
     basis = galsim.zernike.zernikeBasis(
-        jmax, epRays.x, epRays.y,
-        R_outer=optic.pupilSize/2,
-        R_inner=inner
+        jmax, x, y, R_outer=outer, R_inner=eps*outer
     )
+    projection = basis*weights/area
+    for arr in x, y, weights, projection:
+        arr.setflags(write=False)
+    return x, y, weights, projection
 
-    if sphereRadius is None:
-        sphereRadius = optic.sphereRadius
 
-    optic.trace(rays)
-
-    if np.any(rays.failed):
-        raise ValueError(
-            "Cannot compute zernike with Gaussian Quadrature with failed rays."
-        )
-    if reference == 'mean':
-        w = np.where(1-rays.vignetted)[0]
-        point = np.mean(rays.r[w], axis=0)
-    elif reference == 'chief':
-        chiefRay = batoid.RayVector.fromStop(
-            0.0, 0.0,
-            backDist=optic.backDist, wavelength=wavelength,
-            dirCos=dirCos,
-            medium=optic.inMedium,
-            stopSurface=optic.stopSurface
-        )
-        optic.trace(chiefRay)
-        point = chiefRay.r[0]
+class ZernikeProjector:
+    """Reusable Gaussian quadrature Zernike decomposition of wavefronts.
 
-    # Place vertex of reference sphere one radius length away from the
-    # intersection point.  So transform our rays into that coordinate system.
-    targetCoordSys = rays.coordSys.shiftLocal(
-        point+np.array([0,0,sphereRadius])
-    )
-    rays.toCoordSys(targetCoordSys)
+    Computes the same coefficients as `zernikeGQ`, but the quadrature nodes
+    and weights and the weighted Zernike basis matrix, which depend only on
+    the pupil, are computed once here.  Each call then traces the rays,
+    computes their optical path differences in one C++ pass, and projects
+    them with a single matrix-vector product.  Use this to decompose the
+    wavefronts of one optic (or perturbed versions of it) many times.
 
-    sphere = batoid.Sphere(-sphereRadius)
-    sphere.intersect(rays)
+    Parameters
+    ----------
+    optic : batoid.Optic
+        Optical system.  Used for its pupil size, and as the default optic to
+        trace.
+    rings : int, optional
+        Number of Gaussian quadrature rings to use.  Default: 6.
+    spokes : int, optional
+        Number of Gaussian quadrature spokes to use.  Default: 2*rings + 1
+    jmax : int, optional
+        Number of coefficients to compute.  Default: 22.
+    eps : float, optional
+        Use annular Zernike polynomials with this fractional inner radius.
+        Default: 0.0.
+    """
+    def __init__(self, optic, rings=6, spokes=None, jmax=22, eps=0.0):
+        if spokes is None:
+            spokes = 2*rings+1
+        self.optic = optic
+        self.rings = rings
+        self.spokes = spokes
+        self.jmax = jmax
+        self.eps = eps
+        # Nodes on the stop surface.  Zernike coefficients are flux-weighted
+        # dot products of relative phases with the basis there.
+        self.x, self.y, self.weights, self._projection = _gqProjection(
+            jmax, rings, spokes, optic.pupilSize/2, eps
+        )
 
-    if reference == 'mean':
-        w = np.where(1-rays.vignetted)[0]
-        t0 = np.mean(rays.t[w])
-    elif reference == 'chief':
-        chiefRay.toCoordSys(targetCoordSys)
-        sphere.intersect(chiefRay)
-        t0 = chiefRay.t
+    def __call__(
+        self, theta_x, theta_y, wavelength, optic=None,
+        projection='postel', sphereRadius=None, reference='chief'
+    ):
+        """Compute Zernike polynomial decomposition of the wavefront.
+
+        Parameters
+        ----------
+        theta_x, theta_y : float or array_like of float
+            Field angles in radians.  Rays for all of them are made, traced
+            and reduced together as one `RayVector`.
+        wavelength : float
+            Wavelength in meters
+        optic : batoid.Optic, optional
+            Optical system to trace, e.g. a perturbed version of the one
+            given at construction.  Default: that one.
+        projection : {'postel', 'zemax', 'gnomonic', 'stereographic', 'lambert', 'orthographic'}
+            Projection used to convert field angle to direction cosines.
+        sphereRadius : float, optional
+            The radius of the reference sphere.  See `zernikeGQ`.
+        reference : {'chief', 'mean'}
+            If 'chief', then reference the wavefront to the chief ray.  If
+            'mean', then to the mean non-vignetted ray.
+
+        Returns
+        -------
+        zernikes : array, shape ``np.shape(theta_x) + (jmax+1,)``
+            Zernike polynomial coefficients in waves, indexed as for
+            `zernikeGQ`.
+        """
+        if optic is None:
+            optic = self.optic
+        if sphereRadius is None:
+            sphereRadius = optic.sphereRadius
+        theta_x, theta_y = np.broadcast_arrays(theta_x, theta_y)
+        shape = theta_x.shape
+        n = len(self.x)
+
+        # Each field angle gets a block of rays, with the chief ray from the
+        # center of the stop last.  All blocks are made, traced and reduced
+        # together as one RayVector.
+        if reference == 'chief':
+            x = np.append(self.x, 0.0)
+            y = np.append(self.y, 0.0)
+            chief = n
+        elif reference == 'mean':
+            x = self.x
+            y = self.y
+            chief = -1
+        else:
+            raise ValueError(f"Unknown reference {reference!r}")
+        nfield = theta_x.size
+        m = len(x)
+        rays = self._fromStop(
+            optic, x, y, theta_x.ravel(), theta_y.ravel(), wavelength,
+            projection
+        )
+        optic.trace(rays)
+        if np.any(rays.failed.reshape(nfield, m)[:, :n]):
+            raise ValueError(
+                "Cannot compute zernike with Gaussian Quadrature with "
+                "failed rays."
+            )
 
-    # Zernike coefficients are flux-weighted dot products of relative phases
-    # with basis.
-    area = np.pi*(1.-eps**2)
-    return np.dot(basis, (t0-rays.t)/wavelength*rays.flux)/area
+        opd = np.empty((nfield, m))
+        mask = np.empty((nfield, m), dtype=bool)
+        bounds = np.arange(nfield+1, dtype=np.uint64)*np.uint64(m)
+        _batoid.wavefront(
+            rays._rv, bounds.ctypes.data, nfield, sphereRadius, chief,
+            wavelength, opd.ctypes.data, mask.ctypes.data
+        )
+        out = np.dot(opd[:, :n], self._projection.T)
+        return out.reshape(shape+(self.jmax+1,))
+
+    @staticmethod
+    def _fromStop(optic, x, y, theta_x, theta_y, wavelength, projection):
+        # The rays of RayVector.fromStop(x, y, ...) for each field angle in
+        # turn, made together: each starts from its stop point backed up along
+        # its direction to the plane backDist from the origin.
+        z = optic.stopSurface.surface.sag(x, y)
+        ct = batoid.CoordTransform(optic.stopSurface.coordSys, optic.coordSys)
+        p = np.array(ct.applyForwardArray(x, y, z)).T
+        d = np.array(fieldToDirCos(theta_x, theta_y, projection=projection))
+        d = np.atleast_2d(d.T)
+        d /= np.sqrt(np.einsum("ab,ab->a", d, d))[:, None]
+        r = p - d[:, None, :]*(np.dot(d, p.T) + optic.backDist)[..., None]
+        v = np.repeat(d/optic.inMedium.getN(wavelength), len(x), axis=0)
+        r = r.reshape(-1, 3)
+        return batoid.RayVector(
+            r[:, 0], r[:, 1], r[:, 2], v[:, 0], v[:, 1], v[:, 2],
+            t=0.0, wavelength=wavelength, coordSys=optic.coordSys
+        )
 
 
 def _dZernikeBasis(jmax, x, y, R_outer=1.0, R_inner=0.0):
@@ -849,62 +1145,18 @@ def doubleZernike(
     """
     if spokes is None:
         spokes = 2*rings+1
-    Li, w = np.polynomial.legendre.leggauss(rings)
-    radii = np.sqrt((1+Li)/2)*field
-    w *= np.pi/(2*spokes)
-    azs = np.linspace(0, 2*np.pi, spokes, endpoint=False)
-    radii, azs = np.meshgrid(radii, azs)
-    w = np.broadcast_to(w, radii.shape)
-    radii = radii.ravel()
-    azs = azs.ravel()
-    w = w.ravel()
-
-    thx = radii * np.cos(azs)
-    thy = radii * np.sin(azs)
-    coefs = []
-    for thx_, thy_ in zip(thx, thy):
-        coefs.append(zernikeGQ(
-            optic, thx_, thy_, wavelength,
-            rings=rings, spokes=spokes,
-            **kwargs
-        ))
-    coefs = np.array(coefs)
-
-    import galsim
-    basis = galsim.zernike.zernikeBasis(
-        kmax, thx, thy, R_outer=field
+    # Both projections are Gaussian quadratures, over the field and then the
+    # pupil, and the rays of every field point are traced together.
+    thx, thy, _, fieldProjection = _gqProjection(
+        kmax, rings, spokes, field, 0.0
     )
-    dzs = np.dot(basis, coefs*w[:,None])/np.pi
-    return dzs
-
-
-def _closestApproach(P, u, Q, v):
-    """Compute position along line P + u t of closest approach to line Q + v t
-
-    Parameters
-    ----------
-    P, Q : ndarray
-        Points on lines
-    u, v : ndarray
-        Direction cosines of lines
-
-    Returns
-    -------
-    Pc : ndarray
-        Closest approach point in meters.
-    """
-    # Follows http://geomalgorithms.com/a07-_distance.html
-    a = np.dot(u, u)
-    b = np.dot(u, v)
-    c = np.dot(v, v)
-    w0 = P - Q
-    d = np.dot(u, w0)
-    e = np.dot(v, w0)
-    den = a*c - b*b
-    if den == 0:
-        raise ValueError("Lines are parallel")
-    sc = (b*e - c*d)/den
-    return P + sc*u
+    jmax = kwargs.pop('jmax', 22)
+    eps = kwargs.pop('eps', 0.0)
+    projector = ZernikeProjector(
+        optic, rings=rings, spokes=spokes, jmax=jmax, eps=eps
+    )
+    coefs = projector(thx, thy, wavelength, **kwargs)
+    return np.dot(fieldProjection, coefs)
 
 
 def exitPupilPos(optic, wavelength, smallAngle=np.deg2rad(1./3600), **kwargs):
@@ -939,15 +1191,10 @@ def exitPupilPos(optic, wavelength, smallAngle=np.deg2rad(1./3600), **kwargs):
     rays.toCoordSys(batoid.globalCoordSys)
     # Assume last intersection places rays into "object" space.
     # Now find closest approach to optic axis.
-    ps = []
-    for ray in rays:
-        ps.append(_closestApproach(
-            ray.r[0],
-            ray.v[0],
-            np.array([0., 0., 0.]),
-            np.array([0., 0., 1.0])
-        ))
-    return np.mean(ps, axis=0)
+    focus = rays.focus(ignoreVignetted=False)
+    if focus.nParallel > 0:
+        raise ValueError("Lines are parallel")
+    return focus.axisCrossing
 
 
 def focalLength(*args, **kwargs):
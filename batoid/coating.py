@@ -1,3 +1,5 @@
+import numpy as np
+
 from batoid.trace import reflect
 from . import _batoid
 
@@ -103,3 +105,187 @@ class SimpleCoating(Coating):
 
     def __repr__(self):
         return f"SimpleCoating({self.reflectivity}, {self.transmissivity})"
+
+
+class TableCoating(Coating):
+    """Coating with reflection and transmission coefficients bilinearly
+    interpolated from a table in wavelength and the absolute value of the
+    cosine of the incidence angle.
+
+    Requests outside the table are clamped to its edges.
+
+    Parameters
+    ----------
+    wavelengths : array_like, shape (nw,)
+        Uniformly spaced vacuum wavelengths in meters.
+    cosIncidenceAngles : array_like, shape (nc,)
+        Uniformly spaced cosines of the incidence angle, between 0 and 1.
+    reflect, transmit : array_like, shape (nw, nc)
+        Reflection and transmission coefficients at the grid points.
+    """
+    def __init__(self, wavelengths, cosIncidenceAngles, reflect, transmit):
+        self._wavelengths = np.array(wavelengths, dtype=float)
+        self._cosIncidenceAngles = np.array(cosIncidenceAngles, dtype=float)
+        self._reflect = np.array(reflect, dtype=float)
+        self._transmit = np.array(transmit, dtype=float)
+        nw = len(self._wavelengths)
+        nc = len(self._cosIncidenceAngles)
+        assert nw > 1 and nc > 1
+        assert self._reflect.shape == self._transmit.shape == (nw, nc)
+        self._setup()
+
+    def _setup(self):
+        ws = self._wavelengths
+        cs = self._cosIncidenceAngles
+        # Interleave so both coefficients come from the same cache line.
+        self._coefs = np.ascontiguousarray(
+            np.stack([self._reflect, self._transmit], axis=-1)
+        )
+        self._coating = _batoid.CPPTableCoating(
+            ws[0], (ws[-1]-ws[0])/(len(ws)-1), len(ws),
+            cs[0], (cs[-1]-cs[0])/(len(cs)-1), len(cs),
+            self._coefs.ctypes.data
+        )
+
+    @property
+    def wavelengths(self):
+        return self._wavelengths
+
+    @property
+    def cosIncidenceAngles(self):
+        return self._cosIncidenceAngles
+
+    @property
+    def reflect(self):
+        return self._reflect
+
+    @property
+    def transmit(self):
+        return self._transmit
+
+    def __eq__(self, rhs):
+        return (
+            isinstance(rhs, TableCoating)
+            and np.array_equal(self._wavelengths, rhs._wavelengths)
+            and np.array_equal(
+                self._cosIncidenceAngles, rhs._cosIncidenceAngles
+            )
+            and np.array_equal(self._reflect, rhs._reflect)
+            and np.array_equal(self._transmit, rhs._transmit)
+        )
+
+    def __getstate__(self):
+        return (
+            self._wavelengths, self._cosIncidenceAngles,
+            self._reflect, self._transmit
+        )
+
+    def __setstate__(self, args):
+        self.__init__(*args)
+
+    def __hash__(self):
+        return hash((
+            "TableCoating",
+            tuple(self._wavelengths),
+            tuple(self._cosIncidenceAngles),
+            tuple(self._reflect.ravel()),
+            tuple(self._transmit.ravel())
+        ))
+
+    def __repr__(self):
+        return (
+            f"TableCoating({self._wavelengths!r}, "
+            f"{self._cosIncidenceAngles!r}, "
+            f"{self._reflect!r}, {self._transmit!r})"
+        )
+
+
+class MultilayerCoating(Coating):
+    """Thin-film coating made of a stack of lossless layers.
+
+    Unpolarized reflection and transmission coefficients are computed with the
+    characteristic matrix method on a grid of wavelengths and incidence angles
+    when the coating is constructed, and then interpolated per ray as for
+    `TableCoating`.
+
+    Parameters
+    ----------
+    layers : list of (Medium, float)
+        Medium and physical thickness in meters of each layer, ordered from
+        the incident side.
+    inMedium : Medium
+        Medium on the incident side of the stack.
+    outMedium : Medium
+        Medium on the far side of the stack; usually the substrate.
+    wavelength_min, wavelength_max : float, optional
+        Vacuum wavelength range of the table in meters.
+        [default: 300e-9, 1200e-9]
+    nwavelength : int, optional
+        Number of wavelength grid points.  [default: 451]
+    ncos : int, optional
+        Number of grid points in cosine of the incidence angle, spanning
+        [0, 1].  [default: 101]
+    """
+    def __init__(
+        self, layers, inMedium, outMedium,
+        wavelength_min=300e-9, wavelength_max=1200e-9,
+        nwavelength=451, ncos=101
+    ):
+        self.layers = [(medium, float(thickness)) for medium, thickness in layers]
+        self.inMedium = inMedium
+        self.outMedium = outMedium
+        self.wavelength_min = wavelength_min
+        self.wavelength_max = wavelength_max
+        self.nwavelength = nwavelength
+        self.ncos = ncos
+
+        ws = np.linspace(wavelength_min, wavelength_max, nwavelength)
+        cs = np.linspace(0.0, 1.0, ncos)
+        media = [inMedium] + [medium for medium, _ in self.layers] + [outMedium]
+        ns = np.ascontiguousarray([medium.getN(ws) for medium in media])
+        thicknesses = np.array(
+            [thickness for _, thickness in self.layers], dtype=float
+        )
+        coefs = np.empty((nwavelength, ncos, 2))
+        _batoid.multilayerCoefs(
+            len(self.layers), ns.ctypes.data, thicknesses.ctypes.data,
+            ws.ctypes.data, nwavelength, cs.ctypes.data, ncos,
+            coefs.ctypes.data
+        )
+        self._table = TableCoating(ws, cs, coefs[..., 0], coefs[..., 1])
+        self._coating = self._table._coating
+
+    @property
+    def table(self):
+        """The `TableCoating` used for lookups."""
+        return self._table
+
+    def __eq__(self, rhs):
+        return (
+            isinstance(rhs, MultilayerCoating)
+            and self.__getstate__() == rhs.__getstate__()
+        )
+
+    def __getstate__(self):
+        return (
+            self.layers, self.inMedium, self.outMedium,
+            self.wavelength_min, self.wavelength_max,
+            self.nwavelength, self.ncos
+        )
+
+    def __setstate__(self, args):
+        self.__init__(*args)
+
+    def __hash__(self):
+        return hash((
+            "MultilayerCoating", tuple(self.layers), self.inMedium,
+            self.outMedium, self.wavelength_min, self.wavelength_max,
+            self.nwavelength, self.ncos
+        ))
+
+    def __repr__(self):
+        return (
+            f"MultilayerCoating({self.layers!r}, {self.inMedium!r}, "
+            f"{self.outMedium!r}, {self.wavelength_min!r}, "
+            f"{self.wavelength_max!r}, {self.nwavelength!r}, {self.ncos!r})"
+        )
@@ -13,15 +13,20 @@ class Medium:
 
         Parameters
         ----------
-        wavelength : float
+        wavelength : float or array of float
             Vacuum wavelength in meters.
 
         Returns
         -------
-        n : float
+        n : float or array of float
             Refractive index.
         """
-        return self._medium.getN(wavelength)
+        if np.ndim(wavelength) == 0:
+            return self._medium.getN(wavelength)
+        w = np.ascontiguousarray(wavelength, dtype=float)
+        out = np.empty_like(w)
+        self._medium.getNMany(w.size, w.ctypes.data, out.ctypes.data)
+        return out
 
     def __ne__(self, rhs):
         return not (self == rhs)
@@ -61,24 +66,40 @@ class ConstMedium(Medium):
 class TableMedium(Medium):
     """A `Medium` with refractive index defined via a lookup table.
 
+    Uniformly spaced tables are indexed directly; otherwise the bracketing
+    interval is found with a binary search.
+
     Parameters
     ----------
     wavelengths : array of float
         Wavelengths in meters.
     ns : array of float
         Refractive indices.
+    interpolant : {'linear', 'cubic'}, optional
+        Interpolate linearly between table entries, or with a cubic spline.
+        [default: 'linear']
     """
-    def __init__(self, wavelengths, ns):
-        self.wavelengths = np.array(wavelengths)
-        self.ns = np.array(ns)
+    def __init__(self, wavelengths, ns, interpolant='linear'):
+        assert interpolant in ['linear', 'cubic']
+        self.wavelengths = np.array(wavelengths, dtype=float)
+        self.ns = np.array(ns, dtype=float)
+        self.interpolant = interpolant
+        if interpolant == 'cubic':
+            from scipy.interpolate import CubicSpline
+            spline = CubicSpline(self.wavelengths, self.ns)
+            self._dndws = spline(self.wavelengths, 1)
+            dndwptr = self._dndws.ctypes.data
+        else:
+            dndwptr = 0
         self._medium = _batoid.CPPTableMedium(
             self.wavelengths.ctypes.data,
             self.ns.ctypes.data,
+            dndwptr,
             len(self.wavelengths)
         )
 
     @classmethod
-    def fromTxt(cls, filename, **kwargs):
+    def fromTxt(cls, filename, interpolant='linear', **kwargs):
         """Load a text file with refractive index information in it.
         The file should have two columns, the first with wavelength in microns,
         and the second with the corresponding refractive indices.
@@ -96,29 +117,34 @@ class TableMedium(Medium):
                     break
             else:
                 raise FileNotFoundError(filename)
-        return TableMedium(wavelength*1e-6, n)
+        return TableMedium(wavelength*1e-6, n, interpolant=interpolant)
 
     def __eq__(self, rhs):
         if type(rhs) == type(self):
             return (
                 np.array_equal(self.wavelengths, rhs.wavelengths)
                 and np.array_equal(self.ns, rhs.ns)
+                and self.interpolant == rhs.interpolant
             )
         return False
 
     def __getstate__(self):
-        return self.wavelengths, self.ns
+        return self.wavelengths, self.ns, self.interpolant
 
     def __setstate__(self, args):
         self.__init__(*args)
 
     def __hash__(self):
         return hash((
-            "batoid.TableMedium", tuple(self.wavelengths), tuple(self.ns)
+            "batoid.TableMedium", tuple(self.wavelengths), tuple(self.ns),
+            self.interpolant
         ))
 
     def __repr__(self):
-        return f"TableMedium({self.wavelengths!r}, {self.ns!r})"
+        out = f"TableMedium({self.wavelengths!r}, {self.ns!r}"
+        if self.interpolant != 'linear':
+            out += f", interpolant={self.interpolant!r}"
+        return out+")"
 
 
 class SellmeierMedium(Medium):
@@ -271,3 +297,96 @@ class Air(Medium):
 
     def __repr__(self):
         return f"Air({self.pressure}, {self.temperature}, {self.h2o_pressure})"
+
+
+class TabulatedMedium(Medium):
+    """A `Medium` that evaluates another `Medium` by cubic interpolation
+    from a table sampled on a uniform wavelength grid.
+
+    Useful for media with comparatively expensive dispersion formulae, like
+    `Air` or `SellmeierMedium`, when tracing many rays at continuously
+    distributed wavelengths.  The grid is refined by factors of two until the
+    interpolation error, sampled at the quarter points of every grid interval,
+    is below half of ``tolerance``.
+
+    Parameters
+    ----------
+    medium : Medium
+        The medium to tabulate.
+    wavelength_min, wavelength_max : float, optional
+        Vacuum wavelength range in meters to tabulate.  The refractive index
+        is nan outside of this range.  [default: 300e-9, 1200e-9]
+    tolerance : float, optional
+        Maximum allowed error in refractive index.  [default: 1e-12]
+    """
+    def __init__(
+        self, medium, wavelength_min=300e-9, wavelength_max=1200e-9,
+        tolerance=1e-12
+    ):
+        self.medium = medium
+        self.wavelength_min = wavelength_min
+        self.wavelength_max = wavelength_max
+        self.tolerance = tolerance
+
+        quarters = np.array([0.25, 0.5, 0.75])
+        nknot = 17
+        while True:
+            ws = np.linspace(wavelength_min, wavelength_max, nknot)
+            ns = medium.getN(ws)
+            if not np.all(np.isfinite(ns)):
+                raise ValueError(
+                    "Medium is not finite over the requested wavelength range"
+                )
+            table = TableMedium(ws, ns, interpolant='cubic')
+            testws = (ws[:-1, None] + (ws[1]-ws[0])*quarters).ravel()
+            err = np.max(np.abs(table.getN(testws) - medium.getN(testws)))
+            if 2*err <= tolerance:
+                break
+            if nknot > 2**20:
+                raise ValueError(
+                    f"Unable to reach tolerance {tolerance}; best was {err}"
+                )
+            nknot = 2*nknot-1
+        self._table = table
+        self._medium = table._medium
+
+    @property
+    def wavelengths(self):
+        """Tabulated wavelengths in meters."""
+        return self._table.wavelengths
+
+    @property
+    def ns(self):
+        """Tabulated refractive indices."""
+        return self._table.ns
+
+    def __eq__(self, rhs):
+        if type(rhs) == type(self):
+            return (
+                self.medium == rhs.medium
+                and self.wavelength_min == rhs.wavelength_min
+                and self.wavelength_max == rhs.wavelength_max
+                and self.tolerance == rhs.tolerance
+            )
+        return False
+
+    def __getstate__(self):
+        return (
+            self.medium, self.wavelength_min, self.wavelength_max,
+            self.tolerance
+        )
+
+    def __setstate__(self, args):
+        self.__init__(*args)
+
+    def __hash__(self):
+        return hash((
+            "batoid.TabulatedMedium", self.medium, self.wavelength_min,
+            self.wavelength_max, self.tolerance
+        ))
+
+    def __repr__(self):
+        return (
+            f"TabulatedMedium({self.medium!r}, {self.wavelength_min!r}, "
+            f"{self.wavelength_max!r}, {self.tolerance!r})"
+        )
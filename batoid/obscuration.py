@@ -26,6 +26,47 @@ class Obscuration:
         """
         return self._obsc.contains(x, y)
 
+    def containsGrid(self, xgrid, ygrid, packed=False):
+        """Evaluate `contains` on every point of a grid.
+
+        Rows are rasterized in parallel, using analytic extents for circles,
+        annuli, rectangles, rays and polygons and combining those of the items
+        of compound obscurations, so this is much faster than calling
+        `contains` on a meshgrid.  The result is identical.
+
+        Parameters
+        ----------
+        xgrid : array_like, shape (nx,)
+            Increasing x coordinates of grid columns in meters.
+        ygrid : array_like, shape (ny,)
+            Y coordinates of grid rows in meters.
+        packed : bool, optional
+            Return the mask packed 8 columns per byte, least significant bit
+            first, as from ``np.packbits(mask, axis=1, bitorder='little')``.
+            Default: False.
+
+        Returns
+        -------
+        obscured : ndarray of bool, shape (ny, nx)
+            True where obscured.  If packed, an ndarray of uint8 with shape
+            (ny, (nx+7)//8) instead.
+        """
+        xgrid = np.ascontiguousarray(xgrid, dtype=float)
+        ygrid = np.ascontiguousarray(ygrid, dtype=float)
+        if np.any(np.diff(xgrid) < 0):
+            raise ValueError("xgrid must be increasing")
+        nx = len(xgrid)
+        ny = len(ygrid)
+        out = np.empty((ny, (nx+7)//8), dtype=np.uint8)
+        self._obsc.containsGrid(
+            xgrid.ctypes.data, ygrid.ctypes.data, out.ctypes.data, nx, ny
+        )
+        if packed:
+            return out
+        return np.unpackbits(
+            out, axis=1, count=nx, bitorder='little'
+        ).astype(bool)
+
     def obscure(self, rv):
         """Mark rays for potential vignetting.
 
@@ -289,19 +330,124 @@ class ObscPolygon(Obscuration):
     def __repr__(self):
         return f"ObscPolygon({self.xs!r}, {self.ys!r})"
 
-    def containsGrid(self, xgrid, ygrid):
-        nx = len(xgrid)
-        ny = len(ygrid)
-        out = np.empty((ny, nx), dtype=bool)
-        self._obsc.containsGrid(
-            xgrid.ctypes.data, ygrid.ctypes.data, out.ctypes.data, nx, ny
+
+class ObscBitmap(Obscuration):
+    """An obscuration defined by a boolean raster, such as a measured pupil
+    image or contamination map.
+
+    The mask is stored as packed bits, and lookups take constant time
+    regardless of the complexity of the obscured region.  Points outside the
+    bitmap extent are not obscured.
+
+    Parameters
+    ----------
+    mask : array_like of bool, shape (ny, nx)
+        True where obscured.  ``mask[j, i]`` is the pixel centered at
+        ``xmin + (i+0.5)*(xmax-xmin)/nx``, ``ymin + (j+0.5)*(ymax-ymin)/ny``.
+    xmin, xmax, ymin, ymax : float
+        Extent of the bitmap in meters.
+    interpolant : {'nearest', 'bilinear'}, optional
+        With 'nearest', a point is obscured if the pixel it falls in is.  With
+        'bilinear', the mask is interpolated between pixel centers and a point
+        is obscured if the result exceeds 1/2, which follows diagonal edges
+        more smoothly.  Default: 'nearest'.
+    """
+    def __init__(
+        self, mask, xmin, xmax, ymin, ymax, interpolant='nearest'
+    ):
+        if interpolant not in ['nearest', 'bilinear']:
+            raise ValueError(f"Unknown interpolant {interpolant}")
+        self.mask = np.array(mask, dtype=bool)
+        if self.mask.ndim != 2:
+            raise ValueError("mask must be 2-dimensional")
+        if not (xmax > xmin and ymax > ymin):
+            raise ValueError("Bitmap extent must have positive size")
+        self.xmin = float(xmin)
+        self.xmax = float(xmax)
+        self.ymin = float(ymin)
+        self.ymax = float(ymax)
+        self.interpolant = interpolant
+        ny, nx = self.mask.shape
+        self._bits = np.ascontiguousarray(
+            np.packbits(self.mask, axis=1, bitorder='little')
+        )
+        self._obsc = _batoid.CPPObscBitmap(
+            self.xmin, self.xmax, self.ymin, self.ymax, nx, ny,
+            self._bits.ctypes.data, interpolant == 'bilinear'
         )
+
+    @classmethod
+    def fromFile(
+        cls, filename, xmin, xmax, ymin, ymax, interpolant='nearest',
+        **kwargs
+    ):
+        """Load a bitmap from a file.
+
+        Files ending in ``.npy`` are read with `numpy.load`, others as text
+        with `numpy.loadtxt`, which receives any additional keyword arguments.
+        Nonzero values are obscured.  If ``filename`` isn't found, the batoid
+        data directory is searched for a file of that name.
+        """
+        import os
+        if not os.path.isfile(filename):
+            import glob
+            from . import datadir
+            candidates = glob.glob(
+                os.path.join(datadir, "**", os.path.basename(filename)),
+                recursive=True
+            )
+            if not candidates:
+                raise FileNotFoundError(filename)
+            filename = candidates[0]
+        if filename.endswith('.npy'):
+            data = np.load(filename)
+        else:
+            data = np.loadtxt(filename, **kwargs)
+        return cls(data != 0, xmin, xmax, ymin, ymax, interpolant=interpolant)
+
+    def __eq__(self, rhs):
+        if type(rhs) == type(self):
+            return (
+                np.array_equal(self.mask, rhs.mask)
+                and self.xmin == rhs.xmin
+                and self.xmax == rhs.xmax
+                and self.ymin == rhs.ymin
+                and self.ymax == rhs.ymax
+                and self.interpolant == rhs.interpolant
+            )
+        return False
+
+    def __getstate__(self):
+        return (
+            self.mask, self.xmin, self.xmax, self.ymin, self.ymax,
+            self.interpolant
+        )
+
+    def __setstate__(self, args):
+        self.__init__(*args)
+
+    def __hash__(self):
+        return hash((
+            "batoid.ObscBitmap", self.mask.shape, self._bits.tobytes(),
+            self.xmin, self.xmax, self.ymin, self.ymax, self.interpolant
+        ))
+
+    def __repr__(self):
+        out = f"ObscBitmap({self.mask!r}, {self.xmin!r}, {self.xmax!r}, "
+        out += f"{self.ymin!r}, {self.ymax!r}"
+        if self.interpolant != 'nearest':
+            out += f", interpolant={self.interpolant!r}"
+        out += ")"
         return out
 
 
 class ObscNegation(Obscuration):
     """A negated obscuration.
 
+    Like `ObscUnion` and `ObscIntersection`, the resulting tree of
+    obscurations is compiled into a flat program with bounding-box prefilters
+    for fast evaluation.
+
     The originally obscured regions become clear, and the originally clear
     regions become obscured.
 
@@ -312,7 +458,8 @@ class ObscNegation(Obscuration):
     """
     def __init__(self, original):
         self.original = original
-        self._obsc = _batoid.CPPObscNegation(original._obsc)
+        self._tree = _batoid.CPPObscNegation(original._obsc)
+        self._obsc = _batoid.CPPObscCompiled(self._tree)
 
     def __eq__(self, rhs):
         if type(rhs) == type(self):
@@ -338,6 +485,11 @@ class ObscNegation(Obscuration):
 class ObscUnion(Obscuration):
     """A union of `Obscuration` s.
 
+    Evaluation stops at the first item containing the point.  Items are
+    skipped when the point lies outside their bounding boxes, and unions of
+    many bounded items index them on a uniform grid so each point is tested
+    only against nearby items.
+
     Parameters
     ----------
     *items : `Obscuration` s
@@ -375,7 +527,8 @@ class ObscUnion(Obscuration):
             if isinstance(items, (list, tuple)):
                 items = items[0]
         self.items = sorted(items, key=repr)
-        self._obsc = _batoid.CPPObscUnion([item._obsc for item in items])
+        self._tree = _batoid.CPPObscUnion([item._obsc for item in items])
+        self._obsc = _batoid.CPPObscCompiled(self._tree)
 
     def __eq__(self, rhs):
         if type(rhs) == type(self):
@@ -405,6 +558,8 @@ class ObscUnion(Obscuration):
 class ObscIntersection(Obscuration):
     """An intersection of `Obscuration` s.
 
+    Evaluation stops at the first item not containing the point.
+
     Parameters
     ----------
     *items : `Obscuration` s
@@ -448,7 +603,10 @@ class ObscIntersection(Obscuration):
             if isinstance(items, (list, tuple)):
                 items = items[0]
         self.items = sorted(items, key=repr)
-        self._obsc = _batoid.CPPObscIntersection([item._obsc for item in items])
+        self._tree = _batoid.CPPObscIntersection(
+            [item._obsc for item in items]
+        )
+        self._obsc = _batoid.CPPObscCompiled(self._tree)
 
     def __eq__(self, rhs):
         if type(rhs) == type(self):
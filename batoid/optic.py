@@ -7,7 +7,6 @@ from .obscuration import ObscNegation, ObscCircle, ObscAnnulus
 from .constants import globalCoordSys, vacuum
 from .coordTransform import CoordTransform
 from .utils import lazy_property
-from .rayVector import RayVector
 
 
 class Optic:
@@ -1207,13 +1206,7 @@ class CompoundOptic(Optic):
             for rList in [rForward, rReverse]:
                 for i, rr in enumerate(rList):
                     w = ~rr.vignetted & (rr.flux >= minFlux)
-                    rList[i] = RayVector(
-                        rr.x[w], rr.y[w], rr.z[w],
-                        rr.vx[w], rr.vy[w], rr.vz[w],
-                        rr.t[w], rr.wavelength[w], rr.flux[w],
-                        rr.vignetted[w], rr.failed[w],
-                        rr.coordSys
-                    )
+                    rList[i] = rr[w]
                     rList[i].path = rr.path
 
             for rr in rForward:
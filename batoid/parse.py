@@ -10,6 +10,10 @@ def parse_obscuration(config):
     ]:
         evalstr = "batoid.{}(**config)".format(typ)
         return eval(evalstr)
+    elif typ == 'ObscBitmap':
+        if 'file' in config:
+            return batoid.ObscBitmap.fromFile(config.pop('file'), **config)
+        return batoid.ObscBitmap(**config)
     elif typ == 'ObscNegation':
         original = parse_obscuration(config['original'])
         return batoid.ObscNegation(original)
@@ -96,6 +100,24 @@ def parse_optic(config,
     @param inMedium  default in Medium, often set by optic parent
     @param outMedium default out Medium, often set by optic parent
     """
+    coatings = {}
+    for key in ['forwardCoating', 'reverseCoating']:
+        if key in config:
+            coatings[key] = config.pop(key)
+    optic = _parse_optic(config, coordSys, inMedium, outMedium)
+    # Multilayer coatings default to the media on either side of the optic.
+    if 'forwardCoating' in coatings:
+        optic.forwardCoating = parse_coating(
+            coatings['forwardCoating'], optic.inMedium, optic.outMedium
+        )
+    if 'reverseCoating' in coatings:
+        optic.reverseCoating = parse_coating(
+            coatings['reverseCoating'], optic.outMedium, optic.inMedium
+        )
+    return optic
+
+
+def _parse_optic(config, coordSys, inMedium, outMedium):
     if 'obscuration' in config:
         obscuration = parse_obscuration(config.pop('obscuration'))
     else:
@@ -205,10 +227,31 @@ def parse_medium(config):
     # before parsing
     config = dict(**config)
     typ = config.pop('type')
+    if typ == 'TabulatedMedium':
+        config['medium'] = parse_medium(config['medium'])
     # TableMedium, Sellmeier, ConstMedium, SumitaMedium, Air end up here...
     evalstr = "batoid.{}(**config)".format(typ)
     return eval(evalstr)
 
 
+def parse_coating(config, inMedium=None, outMedium=None):
+    if config is None:
+        return None
+    if isinstance(config, batoid.Coating):
+        return config
+    config = dict(**config)
+    typ = config.pop('type')
+    if typ == 'MultilayerCoating':
+        config['layers'] = [
+            (parse_medium(layer['medium']), layer['thickness'])
+            for layer in config['layers']
+        ]
+        config['inMedium'] = parse_medium(config.get('inMedium', inMedium))
+        config['outMedium'] = parse_medium(config.get('outMedium', outMedium))
+    # SimpleCoating, TableCoating end up here...
+    evalstr = "batoid.{}(**config)".format(typ)
+    return eval(evalstr)
+
+
 def parse_table(config):
     return batoid.Table(config['args'], config['vals'], config['interp'])
@@ -6,19 +6,273 @@ from . import _batoid
 from .constants import globalCoordSys, vacuum
 from .coordTransform import CoordTransform
 from .trace import applyForwardTransform, applyForwardTransformArrays
-from .utils import lazy_property, fieldToDirCos
+from .utils import (
+    lazy_property, fieldToDirCos, dirCosToField, _fieldToDirCosJacobian
+)
 from .surface import Plane
 
 
-def _reshape_arrays(arrays, shape, dtype=float):
+def setRayAllocation(
+    alignment=None, hugePages=None, firstTouch=None, poolBytes=None
+):
+    """Configure how arrays for new RayVectors are allocated.
+
+    RayVector constructors, ray generators and copies allocate their arrays
+    through batoid's own allocator rather than numpy's.  Parameters left as
+    None keep their current setting.
+
+    Parameters
+    ----------
+    alignment : int, optional
+        Byte alignment of each array; a power of 2 of at least 8.  Default
+        64, one cache line.
+    hugePages : bool, optional
+        Back large arrays with transparent huge pages where the OS supports
+        it, reducing TLB misses for large ray counts.  Default False.
+    firstTouch : bool, optional
+        Initialize arrays in parallel with the same OpenMP schedule as the
+        trace kernels, so that on NUMA machines each thread's rays are
+        placed in memory local to it.  Default True.
+    poolBytes : int, optional
+        Arrays of 64 kB or more are not returned to the OS when released, but
+        kept in a pool of up to this many bytes and reused for new arrays of
+        similar size.  See `RayVector.recycle`.  Default 2**30.  0 disables
+        the pool.
+
+    Returns
+    -------
+    dict
+        The previous settings, which may be passed back in as keywords.
+    """
+    prev = dict(zip(
+        ['alignment', 'hugePages', 'firstTouch', 'poolBytes'],
+        _batoid.getAllocOptions()
+    ))
+    if alignment is None:
+        alignment = prev['alignment']
+    if alignment < 8 or alignment & (alignment-1):
+        raise ValueError("alignment must be a power of 2 of at least 8")
+    if hugePages is None:
+        hugePages = prev['hugePages']
+    if firstTouch is None:
+        firstTouch = prev['firstTouch']
+    if poolBytes is None:
+        poolBytes = prev['poolBytes']
+    if poolBytes < 0:
+        raise ValueError("poolBytes must be non-negative")
+    _batoid.setAllocOptions(
+        int(alignment), bool(hugePages), bool(firstTouch), int(poolBytes)
+    )
+    return prev
+
+
+def clearRayPool():
+    """Free all arrays held for reuse by the RayVector allocation pool.
+
+    Returns
+    -------
+    int
+        Number of bytes freed.
+    """
+    return _batoid.clearPool()
+
+
+def _full(shape, value, dtype=float):
+    # Like np.full, but using the ray allocator.
+    n = int(np.prod(shape))
+    if dtype == np.uint64:
+        out = _batoid.fullUInt64(n, int(value))
+    else:
+        out = _batoid.fullDouble(n, float(value))
+    return out.reshape(shape)
+
+
+def _copy(array, dtype=float):
+    # Like np.array(array, dtype=dtype), but using the ray allocator.
+    array = np.ascontiguousarray(array, dtype=dtype)
+    if dtype == np.uint64:
+        out = _batoid.copyUInt64(array.ctypes.data, array.size)
+    else:
+        out = _batoid.copyDouble(array.ctypes.data, array.size)
+    return out.reshape(array.shape)
+
+
+def _reshape_arrays(arrays, shape, dtype=float, uniform=False):
+    # With uniform=True, scalars are kept as a single value shared by all rays.
     for i in range(len(arrays)):
         array = arrays[i]
-        if not hasattr(array, 'shape') or array.shape != shape:
-            arrays[i] = np.array(np.broadcast_to(array, shape))
-        arrays[i] = np.ascontiguousarray(arrays[i], dtype=dtype)
+        if np.ndim(array) == 0:
+            arrays[i] = _full(1 if uniform else shape, array, dtype)
+        else:
+            arrays[i] = _copy(np.broadcast_to(array, shape), dtype)
     return arrays
 
 
+def _packFlags(flags, shape):
+    # Pack boolean flags into the layout used by the C++ RayVector: ray i is
+    # bit i%64 of word i//64, with unused bits of the last word zero.  On a
+    # little-endian host this is exactly np.packbits(bitorder='little').
+    n = int(np.prod(shape))
+    out = _full((n+63)//64, 0, np.uint64)
+    if np.ndim(flags) == 0 and not flags:
+        return out
+    flags = np.broadcast_to(np.asarray(flags, dtype=bool), shape)
+    packed = np.packbits(flags.ravel(), bitorder='little')
+    out.view(np.uint8)[:len(packed)] = packed
+    return out
+
+
+def _unpackFlags(words, shape, offset=0):
+    # offset is the bit of the first word holding the first ray; nonzero for
+    # views into a larger RayVector.
+    n = int(np.prod(shape))
+    out = np.unpackbits(
+        words.view(np.uint8), count=offset+n, bitorder='little'
+    )[offset:]
+    return out.view(bool).reshape(shape)
+
+
+def _readOnly(arr):
+    # Writes into an unpacked copy of the flags would silently be lost, so
+    # make them raise instead.
+    arr.setflags(write=False)
+    return arr
+
+
+def _checkNUFFTTol(tol):
+    # tol sets the Gaussian spreading width through log(tol), so it has to
+    # be a fraction strictly between 0 and 1.
+    if not 0 < tol < 1:
+        raise ValueError(f"tol must be between 0 and 1, got {tol!r}")
+
+
+def _sumAmplitudeNUFFT(rvs, r0, du, dv, nu, nv, t, ignoreVignetted, tol):
+    # Type-1 nonuniform FFT by Gaussian gridding (Greengard & Lee 2004, SIAM
+    # Review 46, 443).  Each ray's phase steps along du and dv are its
+    # nonuniform frequencies; the C++ side spreads them onto a grid
+    # oversampled by at least 2, and the lattice sums are the low modes of the
+    # grid's inverse FFT divided by the Gaussian's Fourier transform.
+    nspread = int(np.clip(np.ceil(-np.log(tol)/(2*np.pi/3)), 2, 16))
+    mu = max(2*nu, 2*nspread)
+    mv = max(2*nv, 2*nspread)
+    Ru = mu/nu
+    Rv = mv/nv
+    tauu = np.pi*nspread/(nu*nu*Ru*(Ru-0.5))
+    tauv = np.pi*nspread/(nv*nv*Rv*(Rv-0.5))
+    du = np.asarray(du, dtype=float)
+    dv = np.asarray(dv, dtype=float)
+    grid = np.zeros((mv, mu), dtype=np.complex128)
+    for rv in rvs:
+        rv._rv.spreadAmplitude(
+            r0[0], r0[1], r0[2], t, du, dv, nu, nv,
+            mu, mv, nspread, tauu, tauv, ignoreVignetted, grid.ctypes.data
+        )
+    modes = np.fft.ifft2(grid)
+    ku = np.arange(nu) - nu//2
+    kv = np.arange(nv) - nv//2
+    out = modes[np.ix_(kv % mv, ku % mu)]
+    out *= np.pi/np.sqrt(tauu*tauv)
+    out *= np.exp(tauv*kv*kv)[:, None]
+    out *= np.exp(tauu*ku*ku)[None, :]
+    return out
+
+
+class RayStatistics:
+    """Summary statistics of the rays in one or more ranges of a RayVector,
+    as returned by `RayVector.stats`.
+
+    Array attributes have a leading axis over the ranges, which is absent
+    when the statistics describe a single range.  Ranges without any usable
+    rays have zero count and weight and NaN for the other statistics.
+
+    Attributes
+    ----------
+    count : ndarray of float
+        Number of rays used.
+    weight : ndarray of float
+        Total weight of the rays used; their total flux for weighted
+        statistics, else equal to count.
+    mean : ndarray of float, shape (..., 3)
+        Weighted mean position in meters.
+    t : ndarray of float
+        Weighted mean reference time in meters.
+    cov : ndarray of float, shape (..., 2, 2)
+        Weighted central second moments of the x and y positions in square
+        meters.
+    """
+    def __init__(self, arr):
+        self.count = arr[..., 0]
+        self.weight = arr[..., 1]
+        self.mean = arr[..., 2:5]
+        self.t = arr[..., 5]
+        self.cov = arr[..., [[6, 7], [7, 8]]]
+
+    @property
+    def rms(self):
+        """ndarray of float: RMS radial distance from the mean position in
+        meters.
+        """
+        return np.sqrt(self.cov[..., 0, 0] + self.cov[..., 1, 1])
+
+
+class RayFocus:
+    """Where the rays in one or more ranges of a RayVector converge, as
+    returned by `RayVector.focus`.  Each ray is treated as the line through
+    its position along its velocity.
+
+    Array attributes have a leading axis over the ranges, which is absent
+    when they describe a single range.  Quantities without any rays to
+    describe are NaN.
+
+    Attributes
+    ----------
+    count : ndarray of float
+        Number of rays used.
+    weight : ndarray of float
+        Total weight of the rays used.
+    axisCrossing : ndarray of float, shape (..., 3)
+        Weighted mean of the points along the rays of closest approach to the
+        reference axis, in meters.  For chief rays, this is the pupil.
+    axisSpread : ndarray of float
+        RMS spread along the reference axis of the points on the axis closest
+        to the rays, in meters; e.g., the length of the caustic along the axis
+        of a spherically aberrated beam.
+    axisMiss : ndarray of float
+        RMS distance of the rays from the reference axis at their closest
+        approach, in meters.  Zero for rays crossing the axis.
+    bestFocus : ndarray of float, shape (..., 3)
+        The point minimizing the weighted sum of squared distances to the
+        rays, in meters.  NaN if the rays are all (nearly) parallel.
+    focusRms : ndarray of float
+        RMS distance of the rays from bestFocus in meters.
+    nParallel : ndarray of float
+        Number of rays exactly parallel to the reference axis, which are
+        omitted from axisCrossing, axisSpread and axisMiss.  Rays at any
+        nonzero angle to the axis, however small, are included.
+    """
+    def __init__(self, arr):
+        self.count = arr[..., 0]
+        self.weight = arr[..., 1]
+        self.axisCrossing = arr[..., 2:5]
+        self.axisSpread = arr[..., 5]
+        self.axisMiss = arr[..., 6]
+        self.bestFocus = arr[..., 7:10]
+        self.focusRms = arr[..., 10]
+        self.nParallel = arr[..., 11]
+
+
+def _focusAxis(point, axis):
+    # Validated reference point and unit axis for RayVector.focus.
+    point = np.array(point, dtype=float)
+    axis = np.array(axis, dtype=float)
+    if point.shape != (3,) or axis.shape != (3,):
+        raise ValueError("point and axis must have shape (3,)")
+    norm = np.sqrt(np.dot(axis, axis))
+    if not norm > 0:
+        raise ValueError("axis must be nonzero")
+    return point, axis/norm
+
+
 class RayVector:
     """Create RayVector from 1d parameter arrays.  Always makes a copy
     of input arrays.
@@ -49,15 +303,16 @@ class RayVector:
         shape = np.broadcast(
             x, y, z, vx, vy, vz, t, wavelength, flux, vignetted, failed
         ).shape
-        x, y, z, vx, vy, vz, t, wavelength, flux = _reshape_arrays(
-            [x, y, z, vx, vy, vz, t, wavelength, flux],
-            shape
+        x, y, z = _reshape_arrays([x, y, z], shape)
+        vx, vy, vz = _reshape_arrays(
+            [vx, vy, vz], shape,
+            uniform=(np.ndim(vx) == np.ndim(vy) == np.ndim(vz) == 0)
         )
-        vignetted, failed = _reshape_arrays(
-            [vignetted, failed],
-            shape,
-            bool
+        t, wavelength, flux = _reshape_arrays(
+            [t, wavelength, flux], shape, uniform=True
         )
+        vignetted = _packFlags(vignetted, shape)
+        failed = _packFlags(failed, shape)
 
         self._x = x
         self._y = y
@@ -92,18 +347,69 @@ class RayVector:
         ret.coordSys = coordSys
         return ret
 
+    # Bit of the first flag word holding ray 0; see RayVector::flagOffset.
+    _flagOffset = 0
+
+    # Ray differentials, shape (nd, 7, n), or None; see differentials.
+    _differentials = None
+
+    # Fields that may be uniform, i.e., stored as one value shared by all rays,
+    # with the matching RayVector::Uniform bits in C++.
+    _uniformFields = dict(
+        v=(1, ['_vx', '_vy', '_vz']),
+        t=(2, ['_t']),
+        wavelength=(4, ['_wavelength']),
+        flux=(8, ['_flux']),
+    )
+
+    def _uniformMask(self):
+        mask = 0
+        for bit, names in self._uniformFields.values():
+            if self.__dict__[names[0]].shape != self._x.shape:
+                mask |= bit
+        return mask
+
+    def _materialize(self, *fields):
+        """Expand uniform fields into per-ray arrays.
+
+        Called before kernels that write the fields ray by ray, and when the
+        arrays are handed out by properties.
+        """
+        names = [
+            name for field in fields
+            for name in self._uniformFields[field][1]
+            if self.__dict__[name].shape != self._x.shape
+        ]
+        if not names:
+            return
+        self._syncToHost()
+        for name in names:
+            self.__dict__[name] = _full(
+                self._x.shape, self.__dict__[name][0]
+            )
+        # Rebuild the C++ view of the arrays on next use.
+        self.__dict__.pop('_rv', None)
+
+    def _field(self, name):
+        # Read-only array of a field for internal use, without materializing.
+        self._syncToHost()
+        arr = self.__dict__[name]
+        if arr.shape != self._x.shape:
+            arr = np.broadcast_to(arr[0], self._x.shape)
+        return arr
+
     def _hash(self):
         # Don't implement as __hash__ since RayVector is mutable.
         return hash((
             tuple(self.x.tolist()),
             tuple(self.y.tolist()),
             tuple(self.z.tolist()),
-            tuple(self.vx.tolist()),
-            tuple(self.vy.tolist()),
-            tuple(self.vz.tolist()),
-            tuple(self.t.tolist()),
-            tuple(self.wavelength.tolist()),
-            tuple(self.flux.tolist()),
+            tuple(self._field('_vx').tolist()),
+            tuple(self._field('_vy').tolist()),
+            tuple(self._field('_vz').tolist()),
+            tuple(self._field('_t').tolist()),
+            tuple(self._field('_wavelength').tolist()),
+            tuple(self._field('_flux').tolist()),
             tuple(self.vignetted.tolist()),
             tuple(self.failed.tolist()),
             self.coordSys
@@ -141,6 +447,13 @@ class RayVector:
         RayVector
             Reference to self, no copy is made.
         """
+        d = self._differentials
+        if d is not None:
+            # Every ray ends at the same time t, so its time differential
+            # becomes a position differential.
+            d[:, 0:3] += d[:, 3:6]*(t - self.t)
+            d[:, 0:3] -= self.v.T*d[:, 6:7]
+            d[:, 6] = 0.0
         self._rv.propagateInPlace(t)
         return self
 
@@ -158,7 +471,7 @@ class RayVector:
         -------
         ndarray of float, shape(n,)
         """
-        out = np.empty_like(self._t)
+        out = np.empty_like(self._x)
         self._rv.phase(r[0], r[1], r[2], t, out.ctypes.data)
         return out
 
@@ -177,7 +490,7 @@ class RayVector:
         -------
         ndarray of complex, shape (n,)
         """
-        out = np.empty_like(self._t, dtype=np.complex128)
+        out = np.empty_like(self._x, dtype=np.complex128)
         self._rv.amplitude(r[0], r[1], r[2], t, out.ctypes.data)
         return out
 
@@ -198,6 +511,153 @@ class RayVector:
         """
         return self._rv.sumAmplitude(r[0], r[1], r[2], t, ignoreVignetted)
 
+    def sumAmplitudeGrid(
+        self, r0, du, dv, nu, nv, t, ignoreVignetted=True, resync=0,
+        tol=None
+    ):
+        """Calculate `sumAmplitude` at every point of a 2d lattice of
+        positions.
+
+        Parameters
+        ----------
+        r0 : ndarray of float, shape (3,)
+            Position of lattice point (0, 0) in meters.
+        du, dv : ndarray of float, shape (3,)
+            Primitive lattice vectors in meters.
+        nu, nv : int
+            Number of lattice points along du and dv.
+        t : float
+            Time (over vacuum speed of light; in meters).
+        ignoreVignetted : bool, optional
+            Omit vignetted rays from the sums?  Default: True.
+        resync : int, optional
+            If nonzero, step each ray's complex amplitude along du by
+            multiplying with its constant per-point phase factor, computing it
+            exactly only every ``resync`` points.  Much faster, at the cost of
+            rounding errors growing linearly between resyncs.  Default: 0,
+            evaluate every point exactly.
+        tol : float, optional
+            If given, evaluate the sums with a nonuniform FFT instead, in
+            O(nrays + nu*nv*log(nu*nv)) time, with errors below about ``tol``
+            times the total flux; must be between 0 and 1.  ``resync`` is then
+            ignored.  Default: None.
+
+        Returns
+        -------
+        ndarray of complex, shape (nv, nu)
+            Element [j, i] is the sum at position r0 + i*du + j*dv.
+        """
+        if tol is not None:
+            _checkNUFFTTol(tol)
+            return _sumAmplitudeNUFFT(
+                [self], r0, du, dv, nu, nv, t, ignoreVignetted, tol
+            )
+        out = np.empty((nv, nu), dtype=np.complex128)
+        self._rv.sumAmplitudeGrid(
+            r0[0], r0[1], r0[2], t,
+            np.asarray(du, dtype=float), np.asarray(dv, dtype=float),
+            nu, nv, ignoreVignetted, out.ctypes.data, resync
+        )
+        return out
+
+    def stats(self, bounds=None, weighted=False, ignoreVignetted=True):
+        """Compute centroids, spot sizes and mean times of the rays in one
+        parallel pass.
+
+        Failed rays are always skipped.
+
+        Parameters
+        ----------
+        bounds : array_like of int, shape (nseg+1,), optional
+            Nondecreasing ray indices.  If given, compute statistics
+            separately for the rays in each range
+            ``bounds[k]:bounds[k+1]``, e.g., for each field point of a
+            RayVector made by concatenating per-field bundles.  Default:
+            None, use all rays.
+        weighted : bool, optional
+            Weight rays by flux?  Default: False.
+        ignoreVignetted : bool, optional
+            Omit vignetted rays?  Default: True.
+
+        Returns
+        -------
+        RayStatistics
+        """
+        bnds = self._bounds(bounds)
+        nseg = len(bnds)-1
+        out = np.zeros((nseg, 9))
+        if nseg > 0:
+            self._rv.stats(
+                bnds.ctypes.data, nseg, weighted, ignoreVignetted,
+                out.ctypes.data
+            )
+        if bounds is None:
+            out = out[0]
+        return RayStatistics(out)
+
+    def focus(
+        self, point=(0.0, 0.0, 0.0), axis=(0.0, 0.0, 1.0), bounds=None,
+        weighted=False, ignoreVignetted=True
+    ):
+        """Find where the rays converge, in one parallel pass.
+
+        Treating each ray as the line through its position along its
+        velocity, computes the points where the rays pass closest to a
+        reference axis and the least squares point of convergence of the
+        rays.  Failed rays are always skipped.
+
+        Parameters
+        ----------
+        point : array_like, shape (3,), optional
+            A point on the reference axis, in the coordinate system of the
+            rays.  Default: the origin.
+        axis : array_like, shape (3,), optional
+            Direction of the reference axis, in the coordinate system of the
+            rays.  Need not be normalized, but must be nonzero.  Default: the
+            z axis.
+        bounds : array_like of int, shape (nseg+1,), optional
+            Nondecreasing ray indices.  If given, compute results separately
+            for the rays in each range ``bounds[k]:bounds[k+1]``.  Default:
+            None, use all rays.
+        weighted : bool, optional
+            Weight rays by flux?  Default: False.
+        ignoreVignetted : bool, optional
+            Omit vignetted rays?  Default: True.
+
+        Returns
+        -------
+        RayFocus
+        """
+        point, axis = _focusAxis(point, axis)
+        bnds = self._bounds(bounds)
+        nseg = len(bnds)-1
+        out = np.zeros((nseg, 12))
+        if nseg > 0:
+            self._rv.focus(
+                bnds.ctypes.data, nseg, point.ctypes.data, axis.ctypes.data,
+                weighted, ignoreVignetted, out.ctypes.data
+            )
+        if bounds is None:
+            out = out[0]
+        return RayFocus(out)
+
+    def _bounds(self, bounds):
+        # Validated uint64 range bounds for stats and focus.
+        if bounds is None:
+            return np.array([0, len(self)], dtype=np.uint64)
+        # Check as given before casting, so negative indices can't wrap.
+        bnds = np.asarray(bounds)
+        if (
+            not np.issubdtype(bnds.dtype, np.integer)
+            or bnds.ndim != 1 or len(bnds) < 1
+            or bnds[0] < 0 or bnds[-1] > len(self)
+            or np.any(bnds[1:] < bnds[:-1])
+        ):
+            raise ValueError(
+                "bounds must be nondecreasing indices into the RayVector"
+            )
+        return np.ascontiguousarray(bnds, dtype=np.uint64)
+
     @classmethod
     def asGrid(
         cls,
@@ -210,7 +670,7 @@ class RayVector:
         dx=None, dy=None,
         lx=None, ly=None,
         flux=1,
-        nrandom=None, rng=None
+        nrandom=None, rng=None, differentials=False
     ):
         """Create RayVector on a parallelogram shaped region.
 
@@ -309,6 +769,11 @@ class RayVector:
             parallelogram region instead of sampling on a regular grid.
         rng : None or int or `np.random.Generator`, optional
             Random number generator or seed to use for random sampling.
+        differentials : bool, optional
+            Seed `differentials` with the derivatives of the rays with
+            respect to their stop surface x and y coordinates and the field
+            angles theta_x and theta_y, in that order.  Requires ``source``
+            None.  Default: False.
         """
         from .optic import Interface
         from .surface import Plane
@@ -414,16 +879,23 @@ class RayVector:
         x = np.dot(lx, stack)
         y = np.dot(ly, stack)
         del xx, yy, stack
+        if differentials:
+            stopNormal = stopSurface.surface.normal(x, y)
         z = stopSurface.surface.sag(x, y)
         transform = CoordTransform(stopSurface.coordSys, coordSys)
         applyForwardTransformArrays(transform, x, y, z)
-        w = np.empty_like(x)
-        w.fill(wavelength)
+        w = wavelength
         n = medium.getN(wavelength)
 
-        return cls._finish(
+        rays = cls._finish(
             backDist, source, dirCos, n, x, y, z, w, flux, coordSys
         )
+        if differentials:
+            rays._seedDifferentials(
+                stopNormal, transform, x, y, z, dirCos, n, backDist,
+                projection
+            )
+        return rays
 
     @classmethod
     def asFan(
@@ -449,7 +921,7 @@ class RayVector:
         theta_x=None, theta_y=None, projection='postel',
         nrad=None, naz=None,
         flux=1,
-        nrandom=None, rng=None
+        nrandom=None, rng=None, differentials=False
     ):
         """Create RayVector on an annular region using a hexapolar grid.
 
@@ -551,6 +1023,11 @@ class RayVector:
             region instead of sampling on a hexapolar grid.
         rng : None or int or `np.random.Generator`, optional
             Random number generator or seed to use for random sampling.
+        differentials : bool, optional
+            Seed `differentials` with the derivatives of the rays with
+            respect to their stop surface x and y coordinates and the field
+            angles theta_x and theta_y, in that order.  Requires ``source``
+            None.  Default: False.
         """
         from .optic import Interface
 
@@ -620,16 +1097,23 @@ class RayVector:
         x = rr*np.cos(th)
         y = rr*np.sin(th)
         del rr, th
+        if differentials:
+            stopNormal = stopSurface.surface.normal(x, y)
         z = stopSurface.surface.sag(x, y)
         transform = CoordTransform(stopSurface.coordSys, coordSys)
         applyForwardTransformArrays(transform, x, y, z)
-        w = np.empty_like(x)
-        w.fill(wavelength)
+        w = wavelength
         n = medium.getN(wavelength)
 
-        return cls._finish(
+        rays = cls._finish(
             backDist, source, dirCos, n, x, y, z, w, flux, coordSys
         )
+        if differentials:
+            rays._seedDifferentials(
+                stopNormal, transform, x, y, z, dirCos, n, backDist,
+                projection
+            )
+        return rays
 
     @classmethod
     def asSpokes(
@@ -642,7 +1126,7 @@ class RayVector:
         theta_x=None, theta_y=None, projection='postel',
         spokes=None, rings=None,
         spacing='uniform',
-        flux=1
+        flux=1, differentials=False
     ):
         """Create RayVector on an annular region using a spokes pattern.
 
@@ -739,6 +1223,11 @@ class RayVector:
             will be ignored).
         flux : float, optional
             Flux to assign each ray.  Default is 1.0.
+        differentials : bool, optional
+            Seed `differentials` with the derivatives of the rays with
+            respect to their stop surface x and y coordinates and the field
+            angles theta_x and theta_y, in that order.  Requires ``source``
+            None.  Default: False.
         """
         from .optic import Interface
         from .surface import Plane
@@ -792,23 +1281,39 @@ class RayVector:
         x = rings*np.cos(spokes)
         y = rings*np.sin(spokes)
         del rings, spokes
+        if differentials:
+            stopNormal = stopSurface.surface.normal(x, y)
         z = stopSurface.surface.sag(x, y)
         transform = CoordTransform(stopSurface.coordSys, coordSys)
         applyForwardTransformArrays(transform, x, y, z)
-        w = np.empty_like(x)
-        w.fill(wavelength)
+        w = wavelength
         n = medium.getN(wavelength)
-        return cls._finish(
+        rays = cls._finish(
             backDist, source, dirCos, n, x, y, z, w, flux, coordSys
         )
+        if differentials:
+            rays._seedDifferentials(
+                stopNormal, transform, x, y, z, dirCos, n, backDist,
+                projection
+            )
+        return rays
 
     @classmethod
     def _finish(
         cls, backDist, source, dirCos, n, x, y, z, w, flux, coordSys
     ):
         """Map rays backwards to their source position."""
-        if isinstance(flux, Real):
-            flux = np.full(len(x), float(flux))
+        if np.ndim(flux) == 0:
+            flux = _full(1, flux)
+        else:
+            flux = _copy(flux)
+        x = _copy(x)
+        y = _copy(y)
+        z = _copy(z)
+        if np.ndim(w) == 0:
+            w = _full(1, w)
+        else:
+            w = _copy(w)
         if source is None:
             vv = np.array(dirCos, dtype=float)
             vv /= n*np.sqrt(np.dot(vv, vv))
@@ -823,12 +1328,12 @@ class RayVector:
                 x.ctypes.data, y.ctypes.data, z.ctypes.data,
                 len(x)
             )
-            vx = np.full_like(x, vv[0])
-            vy = np.full_like(y, vv[1])
-            vz = np.full_like(z, vv[2])
-            t = np.zeros(len(x), dtype=float)
-            vignetted = np.zeros(len(x), dtype=bool)
-            failed = np.zeros(len(x), dtype=bool)
+            vx = _full(1, vv[0])
+            vy = _full(1, vv[1])
+            vz = _full(1, vv[2])
+            t = _full(1, 0.0)
+            vignetted = _packFlags(False, len(x))
+            failed = _packFlags(False, len(x))
             return RayVector._directInit(
                 x, y, z, vx, vy, vz, t, w,
                 flux, vignetted, failed, coordSys
@@ -846,6 +1351,43 @@ class RayVector:
             #     r, v, t, w, flux, vignetted, failed, coordSys
             # )
 
+    def _seedDifferentials(
+        self, stopNormal, transform, x, y, z, dirCos, n, backDist, projection
+    ):
+        """Set differentials with respect to stop surface coordinates and
+        field angles of rays made by `_finish` from the stop points (x, y, z),
+        given in the rays' coordSys, where the stop surface normal is
+        stopNormal.
+        """
+        if dirCos is None:
+            raise ValueError("Ray differentials need rays from infinity")
+        d = np.array(dirCos, dtype=float)
+        d /= np.sqrt(np.dot(d, d))
+        jac = _fieldToDirCosJacobian(
+            *dirCosToField(*d, projection=projection), projection=projection
+        )
+        # Rays start from the stop points P projected along zhat = -d onto the
+        # plane through backDist*zhat: r = P - zhat*(P.zhat - backDist).
+        zhat = -d
+        P = np.array([x, y, z])
+        zeta = zhat@P - backDist
+        out = np.zeros((4, 7, len(self)))
+        # Moving along the stop surface...
+        rot = transform.drot.T
+        nx, ny, nz = np.atleast_2d(stopNormal).T
+        for k, slope in enumerate([-nx/nz, -ny/nz]):
+            dP = np.zeros_like(P)
+            dP[k] = 1.0
+            dP[2] = slope
+            dP = rot@dP
+            out[k, 0:3] = dP - np.outer(zhat, zhat@dP)
+        # ...and changing the field angle, which turns the starting plane.
+        for k in range(2):
+            dzhat = -jac[:, k]
+            out[2+k, 0:3] = -np.outer(dzhat, zeta) - np.outer(zhat, dzhat@P)
+            out[2+k, 3:6] = jac[:, k, None]/n
+        self._differentials = out
+
     @classmethod
     def fromStop(
         cls, x, y,
@@ -854,7 +1396,7 @@ class RayVector:
         wavelength=None,
         source=None, dirCos=None,
         theta_x=None, theta_y=None, projection='postel',
-        flux=1
+        flux=1, differentials=False
     ):
         """Create rays that intersects the "stop" surface at given points.
 
@@ -927,6 +1469,11 @@ class RayVector:
             Projection used to convert field angle to direction cosines.
         flux : float, optional
             Flux of rays.  Default is 1.0.
+        differentials : bool, optional
+            Seed `differentials` with the derivatives of the rays with
+            respect to their stop surface x and y coordinates and the field
+            angles theta_x and theta_y, in that order.  Requires ``source``
+            None.  Default: False.
         """
         from .optic import Interface
         from .surface import Plane
@@ -958,17 +1505,24 @@ class RayVector:
 
         x = np.atleast_1d(x).astype(float, copy=False)
         y = np.atleast_1d(y).astype(float, copy=False)
+        if differentials:
+            stopNormal = stopSurface.surface.normal(x, y)
         z = stopSurface.surface.sag(x, y)
         transform = CoordTransform(stopSurface.coordSys, coordSys)
         applyForwardTransformArrays(transform, x, y, z)
 
-        w = np.empty_like(x)
-        w.fill(wavelength)
+        w = wavelength
         n = medium.getN(wavelength)
 
-        return cls._finish(
+        rays = cls._finish(
             backDist, source, dirCos, n, x, y, z, w, flux, coordSys
         )
+        if differentials:
+            rays._seedDifferentials(
+                stopNormal, transform, x, y, z, dirCos, n, backDist,
+                projection
+            )
+        return rays
 
     @classmethod
     def fromFieldAngles(
@@ -1100,6 +1654,7 @@ class RayVector:
         speed of light in vacuum.  Note that these may have magnitudes < 1 if
         the rays are inside a refractive medium.
         """
+        self._materialize('v')
         self._rv.vx.syncToHost()
         self._rv.vy.syncToHost()
         self._rv.vz.syncToHost()
@@ -1110,6 +1665,7 @@ class RayVector:
         """The x components of ray velocities units of the vacuum speed of
         light.
         """
+        self._materialize('v')
         self._rv.vx.syncToHost()
         return self._vx
 
@@ -1118,6 +1674,7 @@ class RayVector:
         """The y components of ray velocities units of the vacuum speed of
         light.
         """
+        self._materialize('v')
         self._rv.vy.syncToHost()
         return self._vy
 
@@ -1126,6 +1683,7 @@ class RayVector:
         """The z components of ray velocities units of the vacuum speed of
         light.
         """
+        self._materialize('v')
         self._rv.vz.syncToHost()
         return self._vz
 
@@ -1134,6 +1692,7 @@ class RayVector:
         """Reference times (divided by the speed of light in vacuum) in units
         of meters, also known as the optical path lengths.
         """
+        self._materialize('t')
         self._rv.t.syncToHost()
         return self._t
 
@@ -1141,27 +1700,69 @@ class RayVector:
     def wavelength(self):
         """Vacuum wavelengths in meters."""
         # wavelength is constant, so no need to synchronize
+        self._materialize('wavelength')
         return self._wavelength
 
     @property
     def flux(self):
         """Fluxes in arbitrary units."""
+        self._materialize('flux')
         self._rv.flux.syncToHost()
         return self._flux
 
     @property
     def vignetted(self):
-        """True for rays that have been vignetted."""
+        """True for rays that have been vignetted.
+
+        Flags are stored packed 64 rays to a word, so this is a new read-only
+        array unpacked on each access.
+        """
         self._rv.vignetted.syncToHost()
-        return self._vignetted
+        return _readOnly(
+            _unpackFlags(self._vignetted, self._x.shape, self._flagOffset)
+        )
 
     @property
     def failed(self):
         """True for rays that have failed.  This may occur, for example, if
         batoid failed to find the intersection of a ray wiht a surface.
+
+        Like `vignetted`, this is unpacked into a new read-only array on each
+        access.
         """
         self._rv.failed.syncToHost()
-        return self._failed
+        return _readOnly(
+            _unpackFlags(self._failed, self._x.shape, self._flagOffset)
+        )
+
+    @property
+    def differentials(self):
+        """Ray differentials: derivatives of the rays with respect to some
+        parameters, propagated analytically whenever the rays are traced,
+        transformed or propagated.
+
+        None, or ndarray of float with shape (nd, 7, n), whose element
+        [k, c, i] is the derivative of ray i's x, y, z, vx, vy, vz or t (for c
+        = 0 to 6) with respect to parameter k.  Ray generators seed them for
+        the stop surface coordinates and field angles with
+        ``differentials=True``; they can also be set directly.  Tracing uses
+        surface curvatures, analytic for most surface types and from finite
+        differences of the surface gradient otherwise.  Split tracing and
+        phase screens do not support differentials.
+        """
+        return self._differentials
+
+    @differentials.setter
+    def differentials(self, d):
+        if d is None:
+            self.__dict__.pop('_differentials', None)
+            return
+        d = np.array(d, dtype=float)
+        if d.ndim != 3 or d.shape[1:] != (7, len(self)):
+            raise ValueError(
+                f"differentials must have shape (nd, 7, {len(self)})"
+            )
+        self._differentials = d
 
     @property
     def k(self):
@@ -1207,7 +1808,7 @@ class RayVector:
             self._t.ctypes.data,
             self._wavelength.ctypes.data, self._flux.ctypes.data,
             self._vignetted.ctypes.data, self._failed.ctypes.data,
-            len(self._wavelength)
+            self._x.size, self._uniformMask(), self._flagOffset
         )
 
     def _syncToHost(self):
@@ -1243,20 +1844,61 @@ class RayVector:
         # copy on host side for now...
         self._syncToHost()
         ret = RayVector.__new__(RayVector)
-        ret._x = np.copy(self._x)
-        ret._y = np.copy(self._y)
-        ret._z = np.copy(self._z)
-        ret._vx = np.copy(self._vx)
-        ret._vy = np.copy(self._vy)
-        ret._vz = np.copy(self._vz)
-        ret._t = np.copy(self._t)
-        ret._wavelength = np.copy(self._wavelength)
-        ret._flux = np.copy(self._flux)
-        ret._vignetted = np.copy(self._vignetted)
-        ret._failed = np.copy(self._failed)
+        ret._x = _copy(self._x)
+        ret._y = _copy(self._y)
+        ret._z = _copy(self._z)
+        ret._vx = _copy(self._vx)
+        ret._vy = _copy(self._vy)
+        ret._vz = _copy(self._vz)
+        ret._t = _copy(self._t)
+        ret._wavelength = _copy(self._wavelength)
+        ret._flux = _copy(self._flux)
+        # Copies of views keep the view's flag layout.
+        ret._vignetted = _copy(self._vignetted, np.uint64)
+        ret._failed = _copy(self._failed, np.uint64)
+        ret._flagOffset = self._flagOffset
+        if self._differentials is not None:
+            ret._differentials = self._differentials.copy()
         ret.coordSys = self.coordSys.copy()
         return ret
 
+    def recycle(self):
+        """Release this RayVector's arrays for reuse by new RayVectors.
+
+        Arrays are returned to the allocation pool (see `setRayAllocation`) as
+        soon as nothing else references them, so that the next RayVector of a
+        similar size reuses their memory.  This happens anyway when a
+        RayVector is garbage collected; `recycle` just makes it immediate.
+        Arrays previously obtained from properties like `x` remain valid.
+
+        The RayVector is empty afterwards.  RayVectors can also be used as
+        context managers, which recycle them on exit::
+
+            with batoid.RayVector.asPolar(...) as rays:
+                telescope.trace(rays)
+                ...
+        """
+        self.__dict__.pop('_rv', None)
+        self._x = np.empty(0)
+        self._y = np.empty(0)
+        self._z = np.empty(0)
+        self._vx = np.empty(0)
+        self._vy = np.empty(0)
+        self._vz = np.empty(0)
+        self._t = np.empty(0)
+        self._wavelength = np.empty(0)
+        self._flux = np.empty(0)
+        self._vignetted = np.empty(0, dtype=np.uint64)
+        self._failed = np.empty(0, dtype=np.uint64)
+        self.__dict__.pop('_flagOffset', None)
+        self.__dict__.pop('_differentials', None)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.recycle()
+
     def toCoordSys(self, coordSys):
         """Transform this RayVector into a new coordinate system.
 
@@ -1275,7 +1917,7 @@ class RayVector:
         return self
 
     def __len__(self):
-        return self._t.size
+        return self._x.size
 
     def __eq__(self, rhs):
         return self._rv == rhs._rv
@@ -1284,70 +1926,507 @@ class RayVector:
         return self._rv != rhs._rv
 
     def __repr__(self):
+        # Uniform fields are written as scalars.
+        self._syncToHost()
+        fields = [
+            repr(float(arr[0])) if arr.shape != self._x.shape else repr(arr)
+            for arr in [
+                self._vx, self._vy, self._vz,
+                self._t, self._wavelength, self._flux
+            ]
+        ]
         out = f"RayVector({self.x!r}, {self.y!r}, {self.z!r}"
-        out += f", {self.vx!r}, {self.vy!r}, {self.vz!r}"
-        out += f", {self.t!r}, {self.wavelength!r}, {self.flux!r}"
+        out += f", {fields[0]}, {fields[1]}, {fields[2]}"
+        out += f", {fields[3]}, {fields[4]}, {fields[5]}"
         out += f", {self.vignetted!r}, {self.failed!r}, {self.coordSys!r})"
         return out
 
     def __getstate__(self):
+        # Uniform fields are pickled as their single value.
+        self._syncToHost()
         return (
-            self.x, self.y, self.z,
-            self.vx, self.vy, self.vz,
-            self.t,
-            self.wavelength, self.flux,
-            self.vignetted, self.failed, self.coordSys
+            self._x, self._y, self._z,
+            self._vx, self._vy, self._vz,
+            self._t,
+            self._wavelength, self._flux,
+            self.vignetted, self.failed, self.coordSys,
+            self.differentials
         )
 
     def __setstate__(self, args):
         (self._x, self._y, self._z,
          self._vx, self._vy, self._vz, self._t,
-         self._wavelength, self._flux, self._vignetted,
-         self._failed, self.coordSys) = args
+         self._wavelength, self._flux, vignetted,
+         failed, self.coordSys, *differentials) = args
+        self._vignetted = _packFlags(vignetted, self._x.shape)
+        self._failed = _packFlags(failed, self._x.shape)
+        if differentials and differentials[0] is not None:
+            self._differentials = differentials[0]
 
     def __getitem__(self, idx):
-        if isinstance(idx, int):
-            if idx >= 0:
-                if idx >= self._rv.t.size:
-                    msg = "index {} is out of bounds for axis 0 with size {}"
-                    msg = msg.format(idx, self._rv.t.size)
-                    raise IndexError(msg)
-                idx = slice(idx, idx+1)
-            else:
-                if idx < -self._rv.t.size:
-                    msg = "index {} is out of bounds for axis 0 with size {}"
-                    msg = msg.format(idx, self._rv.t.size)
-                    raise IndexError(msg)
-                idx = slice(self._rv.t.size+idx, self._rv.t.size-idx+1)
+        """Select rays.
+
+        A contiguous slice, or a single integer index, returns a view sharing
+        memory with this RayVector, like numpy basic indexing: modifying or
+        tracing the view modifies the corresponding rays here (but only the
+        view's coordSys is updated).  Use `copy` for an independent
+        RayVector.  Boolean masks and integer arrays return a new RayVector,
+        gathered in a single parallel pass.
+        """
+        size = len(self)
+        if isinstance(idx, Integral):
+            if not -size <= idx < size:
+                msg = "index {} is out of bounds for axis 0 with size {}"
+                msg = msg.format(idx, size)
+                raise IndexError(msg)
+            idx = int(idx) % size
+            idx = slice(idx, idx+1)
+
+        if self._x.ndim == 1:
+            if isinstance(idx, slice):
+                start, stop, step = idx.indices(size)
+                # Views would need their own device mappings of the parent's
+                # arrays, so GPU builds copy.
+                if step == 1 and not _batoid.has_gpu():
+                    return self._view(start, max(start, stop))
+            elif not isinstance(idx, tuple):
+                idx = np.asarray(idx)
+                if idx.dtype == bool and idx.shape == self._x.shape:
+                    return self._gather(mask=np.ascontiguousarray(idx))
+                if idx.ndim == 1 and np.issubdtype(idx.dtype, np.integer):
+                    if np.any((idx < -size) | (idx >= size)):
+                        msg = "index out of bounds for axis 0 with size {}"
+                        raise IndexError(msg.format(size))
+                    idx = np.where(idx < 0, idx+size, idx).astype(np.int64)
+                    return self._gather(idx=idx)
 
         self._syncToHost()
-        return RayVector._directInit(
-            np.copy(self._x[idx]),
-            np.copy(self._y[idx]),
-            np.copy(self._z[idx]),
-            np.copy(self._vx[idx]),
-            np.copy(self._vy[idx]),
-            np.copy(self._vz[idx]),
-            np.copy(self._t[idx]),
-            np.copy(self._wavelength[idx]),
-            np.copy(self._flux[idx]),
-            np.copy(self._vignetted[idx]),
-            np.copy(self._failed[idx]),
+        def select(arr):
+            # Uniform fields stay uniform.
+            if arr.shape != self._x.shape:
+                return _copy(arr)
+            return _copy(arr[idx])
+        x = select(self._x)
+        ret = RayVector._directInit(
+            x,
+            select(self._y),
+            select(self._z),
+            select(self._vx),
+            select(self._vy),
+            select(self._vz),
+            select(self._t),
+            select(self._wavelength),
+            select(self._flux),
+            _packFlags(self.vignetted[idx], x.shape),
+            _packFlags(self.failed[idx], x.shape),
             self.coordSys
         )
+        if self._differentials is not None and x.ndim == 1:
+            ret._differentials = np.ascontiguousarray(
+                self._differentials[..., idx]
+            )
+        return ret
+
+    def _view(self, start, stop):
+        # Kernels write uniform fields in place (e.g., the single time updated
+        # by propagate), which would leak into the rest of this RayVector, so
+        # the parent's fields are expanded once before sharing them.
+        self._materialize('v', 't', 'wavelength', 'flux')
+        self._syncToHost()
+        bit0 = start + self._flagOffset
+        bit1 = stop + self._flagOffset
+        words = slice(bit0//64, (bit1+63)//64)
+        ret = RayVector._directInit(
+            self._x[start:stop],
+            self._y[start:stop],
+            self._z[start:stop],
+            self._vx[start:stop],
+            self._vy[start:stop],
+            self._vz[start:stop],
+            self._t[start:stop],
+            self._wavelength[start:stop],
+            self._flux[start:stop],
+            self._vignetted[words],
+            self._failed[words],
+            self.coordSys
+        )
+        ret._flagOffset = bit0 % 64
+        if self._differentials is not None:
+            ret._differentials = self._differentials[..., start:stop]
+        return ret
+
+    def _gather(self, mask=None, idx=None):
+        n = np.count_nonzero(mask) if idx is None else len(idx)
+        def empty(arr):
+            # Uniform fields stay uniform; the C++ gather leaves them alone.
+            if arr.shape != self._x.shape:
+                return _copy(arr)
+            return _full(n, 0.0)
+        ret = RayVector._directInit(
+            _full(n, 0.0),
+            _full(n, 0.0),
+            _full(n, 0.0),
+            empty(self._vx),
+            empty(self._vy),
+            empty(self._vz),
+            empty(self._t),
+            empty(self._wavelength),
+            empty(self._flux),
+            _full((n+63)//64, 0, np.uint64),
+            _full((n+63)//64, 0, np.uint64),
+            self.coordSys
+        )
+        if idx is None:
+            self._rv.compact(mask.ctypes.data, ret._rv)
+        else:
+            self._rv.gather(idx.ctypes.data, ret._rv)
+        if self._differentials is not None:
+            sel = mask if idx is None else idx
+            ret._differentials = self._differentials[..., sel]
+        return ret
 
 def concatenateRayVectors(rvs):
-    return RayVector(
+    ret = RayVector(
         np.hstack([rv.x for rv in rvs]),
         np.hstack([rv.y for rv in rvs]),
         np.hstack([rv.z for rv in rvs]),
-        np.hstack([rv.vx for rv in rvs]),
-        np.hstack([rv.vy for rv in rvs]),
-        np.hstack([rv.vz for rv in rvs]),
-        np.hstack([rv.t for rv in rvs]),
-        np.hstack([rv.wavelength for rv in rvs]),
-        np.hstack([rv.flux for rv in rvs]),
+        np.hstack([rv._field('_vx') for rv in rvs]),
+        np.hstack([rv._field('_vy') for rv in rvs]),
+        np.hstack([rv._field('_vz') for rv in rvs]),
+        np.hstack([rv._field('_t') for rv in rvs]),
+        np.hstack([rv._field('_wavelength') for rv in rvs]),
+        np.hstack([rv._field('_flux') for rv in rvs]),
         np.hstack([rv.vignetted for rv in rvs]),
         np.hstack([rv.failed for rv in rvs]),
         rvs[0].coordSys
     )
+    # Differentials survive if every RayVector has the same parameters.
+    ds = [rv._differentials for rv in rvs]
+    if all(d is not None for d in ds) and len({d.shape[0] for d in ds}) == 1:
+        ret._differentials = np.concatenate(ds, axis=2)
+    return ret
+
+
+class SegmentedRayVector:
+    """Rays held as a list of RayVector segments in a common coordinate
+    system.
+
+    Unlike `concatenateRayVectors`, making a SegmentedRayVector copies no
+    rays: the segments are the given RayVectors themselves, and tracing the
+    SegmentedRayVector traces each of them in place, every kernel walking all
+    segments in a single parallel loop.  Results for each
+    segment therefore remain available from `segments` (or from the
+    original RayVectors) without slicing.
+
+    A SegmentedRayVector can be traced with `Optic.trace` and `Optic.traceFull`
+    and the functions in `batoid.trace`.  Array properties like `x` return the
+    concatenation of the segments' arrays, which is a new array.  Use
+    `toRayVector` for a single contiguous RayVector.
+
+    Parameters
+    ----------
+    segments : list of RayVector
+        Segments, in order.  Segments not expressed in the first segment's
+        coordinate system are transformed into it, in place.
+    """
+    def __init__(self, segments):
+        self.segments = list(segments)
+        if self.segments:
+            coordSys = self.segments[0].coordSys
+            for seg in self.segments[1:]:
+                if seg.coordSys != coordSys:
+                    seg.toCoordSys(coordSys)
+        else:
+            coordSys = globalCoordSys
+        self._coordSys = coordSys
+
+    @property
+    def coordSys(self):
+        """CoordSys: Coordinate system of every segment."""
+        return self._coordSys
+
+    @coordSys.setter
+    def coordSys(self, coordSys):
+        self._coordSys = coordSys
+        for seg in self.segments:
+            seg.coordSys = coordSys
+
+    def _concat(self, name):
+        if not self.segments:
+            flag = name in ('vignetted', 'failed')
+            return np.empty(0, dtype=bool if flag else float)
+        return np.concatenate([getattr(seg, name) for seg in self.segments])
+
+    @property
+    def r(self):
+        """ndarray of float, shape (n, 3): Positions of rays in meters."""
+        return np.array([self.x, self.y, self.z]).T
+
+    @property
+    def x(self):
+        """The x components of ray positions in meters."""
+        return self._concat('x')
+
+    @property
+    def y(self):
+        """The y components of ray positions in meters."""
+        return self._concat('y')
+
+    @property
+    def z(self):
+        """The z components of ray positions in meters."""
+        return self._concat('z')
+
+    @property
+    def v(self):
+        """ndarray of float, shape (n, 3): Velocities of rays in units of the
+        speed of light in vacuum.
+        """
+        return np.array([self.vx, self.vy, self.vz]).T
+
+    @property
+    def vx(self):
+        """The x components of ray velocities."""
+        return self._concat('vx')
+
+    @property
+    def vy(self):
+        """The y components of ray velocities."""
+        return self._concat('vy')
+
+    @property
+    def vz(self):
+        """The z components of ray velocities."""
+        return self._concat('vz')
+
+    @property
+    def t(self):
+        """Reference times (divided by the speed of light in vacuum) in units
+        of meters.
+        """
+        return self._concat('t')
+
+    @property
+    def wavelength(self):
+        """Vacuum wavelengths in meters."""
+        return self._concat('wavelength')
+
+    @property
+    def flux(self):
+        """Fluxes in arbitrary units."""
+        return self._concat('flux')
+
+    @property
+    def vignetted(self):
+        """True for rays that have been vignetted."""
+        return self._concat('vignetted')
+
+    @property
+    def failed(self):
+        """True for rays that have failed."""
+        return self._concat('failed')
+
+    def positionAtTime(self, t):
+        """Calculate the positions of the rays at a given time.
+
+        Parameters
+        ----------
+        t : float
+            Time (over vacuum speed of light; in meters).
+
+        Returns
+        -------
+        ndarray of float, shape (n, 3)
+            Positions in meters.
+        """
+        if not self.segments:
+            return np.empty((0, 3))
+        return np.concatenate(
+            [seg.positionAtTime(t) for seg in self.segments]
+        )
+
+    def propagate(self, t):
+        """Propagate every segment to given time.
+
+        Parameters
+        ----------
+        t : float
+            Time (over vacuum speed of light; in meters).
+
+        Returns
+        -------
+        SegmentedRayVector
+            Reference to self, no copy is made.
+        """
+        for seg in self.segments:
+            seg.propagate(t)
+        return self
+
+    def phase(self, r, t):
+        """Calculate plane wave phases at given position and time.
+
+        Parameters
+        ----------
+        r : ndarray of float, shape (3,)
+            Position in meters at which to compute phase
+        t : float
+            Time (over vacuum speed of light; in meters).
+
+        Returns
+        -------
+        ndarray of float, shape(n,)
+        """
+        if not self.segments:
+            return np.empty(0)
+        return np.concatenate([seg.phase(r, t) for seg in self.segments])
+
+    def amplitude(self, r, t):
+        """Calculate (scalar) complex electric-field amplitudes at given
+        position and time.
+
+        Parameters
+        ----------
+        r : ndarray of float, shape (3,)
+            Position in meters.
+        t : float
+            Time (over vacuum speed of light; in meters).
+
+        Returns
+        -------
+        ndarray of complex, shape (n,)
+        """
+        if not self.segments:
+            return np.empty(0, dtype=complex)
+        return np.concatenate([seg.amplitude(r, t) for seg in self.segments])
+
+    def sumAmplitude(self, r, t, ignoreVignetted=True):
+        """Calculate the sum of (scalar) complex electric-field amplitudes of
+        all rays in all segments at given position and time.
+
+        Parameters
+        ----------
+        r : ndarray of float, shape (3,)
+            Position in meters.
+        t : float
+            Time (over vacuum speed of light; in meters).
+        ignoreVignetted : bool, optional
+            Omit vignetted rays from the sum?  Default: True.
+
+        Returns
+        -------
+        complex
+        """
+        return sum(
+            (seg.sumAmplitude(r, t, ignoreVignetted) for seg in self.segments),
+            0j
+        )
+
+    def sumAmplitudeGrid(
+        self, r0, du, dv, nu, nv, t, ignoreVignetted=True, resync=0,
+        tol=None
+    ):
+        """Calculate `sumAmplitude` at every point of a 2d lattice of
+        positions.  See `RayVector.sumAmplitudeGrid`.
+        """
+        if tol is not None:
+            _checkNUFFTTol(tol)
+            # All segments spread onto one grid, so one FFT.
+            return _sumAmplitudeNUFFT(
+                self.segments, r0, du, dv, nu, nv, t, ignoreVignetted, tol
+            )
+        out = np.zeros((nv, nu), dtype=np.complex128)
+        for seg in self.segments:
+            out += seg.sumAmplitudeGrid(
+                r0, du, dv, nu, nv, t, ignoreVignetted, resync
+            )
+        return out
+
+    def stats(self, weighted=False, ignoreVignetted=True):
+        """Compute centroids, spot sizes and mean times of the rays of each
+        segment.  See `RayVector.stats`.
+
+        Returns
+        -------
+        RayStatistics
+            With a leading axis over segments.
+        """
+        nseg = len(self.segments)
+        out = np.zeros((nseg, 9))
+        if nseg > 0:
+            _batoid.segmentedStats(
+                [seg._rv for seg in self.segments], self._bounds().ctypes.data,
+                nseg, weighted, ignoreVignetted, out.ctypes.data
+            )
+        return RayStatistics(out)
+
+    def focus(
+        self, point=(0.0, 0.0, 0.0), axis=(0.0, 0.0, 1.0), weighted=False,
+        ignoreVignetted=True
+    ):
+        """Find where the rays of each segment converge.  See
+        `RayVector.focus`.
+
+        Returns
+        -------
+        RayFocus
+            With a leading axis over segments.
+        """
+        point, axis = _focusAxis(point, axis)
+        nseg = len(self.segments)
+        out = np.zeros((nseg, 12))
+        if nseg > 0:
+            _batoid.segmentedFocus(
+                [seg._rv for seg in self.segments], self._bounds().ctypes.data,
+                nseg, point.ctypes.data, axis.ctypes.data, weighted,
+                ignoreVignetted, out.ctypes.data
+            )
+        return RayFocus(out)
+
+    def _bounds(self):
+        # Segment boundaries in the concatenated rays, for stats and focus.
+        return np.concatenate(
+            [[0], np.cumsum([len(seg) for seg in self.segments])]
+        ).astype(np.uint64)
+
+    def copy(self):
+        return SegmentedRayVector([seg.copy() for seg in self.segments])
+
+    def toCoordSys(self, coordSys):
+        """Transform every segment into a new coordinate system.
+
+        Parameters
+        ----------
+        coordSys: batoid.CoordSys
+            Destination coordinate system.
+
+        Returns
+        -------
+        SegmentedRayVector
+            Reference to self, no copy is made.
+        """
+        transform = CoordTransform(self.coordSys, coordSys)
+        applyForwardTransform(transform, self)
+        return self
+
+    def toRayVector(self):
+        """Concatenate the segments into a single new RayVector."""
+        out = concatenateRayVectors(self.segments)
+        out.coordSys = self.coordSys
+        return out
+
+    def __len__(self):
+        return sum(len(seg) for seg in self.segments)
+
+    def __eq__(self, rhs):
+        if not isinstance(rhs, SegmentedRayVector):
+            return False
+        return (
+            len(self.segments) == len(rhs.segments)
+            and all(a == b for a, b in zip(self.segments, rhs.segments))
+        )
+
+    def __ne__(self, rhs):
+        return not (self == rhs)
+
+    def __repr__(self):
+        return f"SegmentedRayVector({self.segments!r})"
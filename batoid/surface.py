@@ -153,6 +153,67 @@ class Surface(ABC):
         """
         return refractScreen(self, rv, screen, coordSys)
 
+    def tabulated(
+        self, resolution, tolerance=None, radius=1.0, nanpolicy='nan'
+    ):
+        """Tabulate this surface onto a `Bicubic` grid.
+
+        Sag and gradient are sampled in parallel on a square grid covering
+        ``[-radius, radius]`` in x and y.  Tracing through the resulting
+        `Bicubic` is typically much faster than through surfaces whose sag is
+        expensive to evaluate (e.g., `Zernike` with many terms or nested
+        `Sum` surfaces), at the cost of a small interpolation error.
+
+        Parameters
+        ----------
+        resolution : int
+            Number of grid points along each axis.
+        tolerance : float, optional
+            Maximum acceptable sag error in meters, checked at the center of
+            every grid cell.  If ``None`` (default), no check is performed.
+        radius : float, optional
+            Half-width of the tabulated domain in meters.  Default: 1.0
+        nanpolicy : {'zero', 'nan'}
+            Return zero or nan for requests outside the tabulated domain?
+
+        Returns
+        -------
+        Bicubic
+
+        Raises
+        ------
+        ValueError
+            If ``resolution`` is less than 2 or the interpolation error exceeds
+            ``tolerance``.
+        """
+        n = int(resolution)
+        if n < 2:
+            raise ValueError(
+                f"Resolution {resolution} is too small; need at least 2 grid "
+                "points along each axis."
+            )
+        xs = np.linspace(-radius, radius, n)
+        dx = xs[1] - xs[0]
+        zs, dzdxs, dzdys, d2zdxdys = np.empty((4, n, n))
+        _batoid.tabulateSurface(
+            self._surface, xs[0], xs[0], dx, dx, n, n,
+            zs.ctypes.data, dzdxs.ctypes.data,
+            dzdys.ctypes.data, d2zdxdys.ctypes.data
+        )
+        bc = Bicubic(
+            xs, xs, zs, dzdxs, dzdys, d2zdxdys, nanpolicy=nanpolicy
+        )
+        if tolerance is not None:
+            err = _batoid.maxTableError(
+                self._surface, bc._surface, xs[0], xs[0], dx, dx, n, n
+            )
+            if err > tolerance:
+                raise ValueError(
+                    f"Tabulation error {err} exceeds tolerance {tolerance}. "
+                    "Try a larger resolution."
+                )
+        return bc
+
     def __ne__(self, rhs):
         return not (self == rhs)
 
@@ -610,6 +671,111 @@ class Bicubic(Surface):
         return out
 
 
+class RadialSpline(Surface):
+    """Axisymmetric surface defined by a cubic spline in radius.
+
+    The surface sag follows the equation:
+
+    .. math::
+
+        z(x, y) = z(r) = S(r)
+
+    where :math:`r = \\sqrt{x^2 + y^2}` and :math:`S` is the piecewise cubic
+    Hermite interpolant through the knots ``(rs, zs)`` with slopes ``dzdrs``.
+
+    This is much more compact than an equivalent `Bicubic`; a 1000-knot table
+    occupies 16 KB, compared to 32 MB for a 1000x1000 `Bicubic`.
+
+    Parameters
+    ----------
+    rs : array_like
+        1d uniform-spaced array of radii at which the surface is tabulated.
+    zs : array_like
+        1d array of surface sags at ``rs``.
+    dzdrs : array_like, optional
+        1d array of derivatives dz/dr at ``rs``.  If omitted, these are
+        computed from a cubic spline through ``zs``, with zero slope imposed at
+        the origin if ``rs[0] == 0``.
+    nanpolicy : {'zero', 'nan'}
+        Return zero or nan for requests outside input domain?
+    """
+    def __init__(self, rs, zs, dzdrs=None, nanpolicy='nan'):
+        assert nanpolicy.upper() in ['NAN', 'ZERO']
+        self._rs = np.array(rs, dtype=float, order="C")
+        self._zs = np.array(zs, dtype=float, order="C")
+        assert self._rs.ndim == 1 and len(self._rs) >= 2
+        assert self._zs.shape == self._rs.shape
+
+        if dzdrs is None:
+            from scipy.interpolate import CubicSpline
+            if self._rs[0] == 0.0:
+                bc_type = ((1, 0.0), 'not-a-knot')
+            else:
+                bc_type = 'not-a-knot'
+            dzdrs = CubicSpline(self._rs, self._zs, bc_type=bc_type)(
+                self._rs, 1
+            )
+        self._dzdrs = np.array(dzdrs, dtype=float, order="C")
+        self.nanpolicy = nanpolicy
+        self._setup()
+
+    def _setup(self):
+        self._r0 = self._rs[0]
+        self._dr = (self._rs[-1] - self._rs[0])/(len(self._rs)-1)
+        # Interleave sag and slope so both are fetched together.
+        self._zdzdrs = np.ascontiguousarray(
+            np.stack([self._zs, self._dzdrs], axis=-1)
+        )
+        self._surface = _batoid.CPPRadialSpline(
+            self._r0, self._dr,
+            self._zdzdrs.ctypes.data,
+            len(self._rs),
+            True if self.nanpolicy.upper() == 'NAN' else False
+        )
+
+    @property
+    def rs(self):
+        return self._rs
+
+    @property
+    def zs(self):
+        return self._zs
+
+    @property
+    def dzdrs(self):
+        return self._dzdrs
+
+    def __hash__(self):
+        return hash((
+            "batoid.RadialSpline", tuple(self.rs), tuple(self.zs),
+            tuple(self.dzdrs), self.nanpolicy
+        ))
+
+    def __setstate__(self, args):
+        self._rs, self._zs, self._dzdrs, self.nanpolicy = args
+        self._setup()
+
+    def __getstate__(self):
+        return self.rs, self.zs, self.dzdrs, self.nanpolicy
+
+    def __eq__(self, rhs):
+        if not isinstance(rhs, RadialSpline): return False
+        return (
+            np.array_equal(self.rs, rhs.rs)
+            and np.array_equal(self.zs, rhs.zs)
+            and np.array_equal(self.dzdrs, rhs.dzdrs)
+            and self.nanpolicy.upper() == rhs.nanpolicy.upper()
+        )
+
+    def __repr__(self):
+        out = f"RadialSpline({self.rs!r}, {self.zs!r}, {self.dzdrs!r}"
+        if self.nanpolicy.upper() == "NAN":
+            out += ")"
+        else:
+            out += ", nanpolicy='zero')"
+        return out
+
+
 class Sum(Surface):
     """Composite surface combining two or more other Surfaces through addition.
     The surface sag follows the equation:
@@ -1,16 +1,63 @@
+import numpy as np
+
 from . import _batoid
 from .coordSys import CoordSys
 from .coordTransform import CoordTransform
 
 
+def _segments(rv):
+    # Kernels trace all segments of a SegmentedRayVector in one pass.
+    return getattr(rv, 'segments', (rv,))
+
+
+def _rvs(rv):
+    return [seg._rv for seg in _segments(rv)]
+
+
+def _materialize(rv, v=False, flux=False):
+    # Expand the uniform RayVector fields that a kernel will write per ray.  Time
+    # is always written.
+    fields = ['t']
+    if v:
+        fields.append('v')
+    if flux:
+        fields.append('flux')
+    for seg in _segments(rv):
+        seg._materialize(*fields)
+
+
+def _differentials(rv):
+    # Ray differentials of each segment as the C++ kernels take them: data
+    # pointer (0 for none), number of parameters and stride, concatenated.
+    out = []
+    for seg in _segments(rv):
+        d = seg._differentials
+        if d is None:
+            out.extend((0, 0, 0))
+        else:
+            out.extend((d.ctypes.data, d.shape[0], d.strides[1]//d.itemsize))
+    return out
+
+
+def _noDifferentials(rv, what):
+    if any(seg._differentials is not None for seg in _segments(rv)):
+        raise NotImplementedError(
+            f"{what} does not propagate ray differentials"
+        )
+
+
 def applyForwardTransform(ct, rv):
-    _batoid.applyForwardTransform(ct.dr, ct.drot.ravel(), rv._rv)
+    _batoid.applyForwardTransform(
+        ct.dr, ct.drot.ravel(), _rvs(rv), _differentials(rv)
+    )
     rv.coordSys = ct.toSys
     return rv
 
 
 def applyReverseTransform(ct, rv):
-    _batoid.applyReverseTransform(ct.dr, ct.drot.ravel(), rv._rv)
+    _batoid.applyReverseTransform(
+        ct.dr, ct.drot.ravel(), _rvs(rv), _differentials(rv)
+    )
     rv.coordSys = ct.fromSys
     return rv
 
@@ -32,7 +79,7 @@ def applyReverseTransformArrays(ct, x, y, z):
 
 
 def obscure(obsc, rv):
-    _batoid.obscure(obsc._obsc, rv._rv)
+    _batoid.obscure(obsc._obsc, _rvs(rv))
     return rv
 
 
@@ -61,11 +108,18 @@ def intersect(surface, rv, coordSys=None, coating=None):
         coordSys = rv.coordSys
     ct = CoordTransform(rv.coordSys, coordSys)
     _coating = coating._coating if coating else None
+    # Rays that miss keep their untransformed velocity, so a uniform velocity
+    # only survives a pure translation.
+    _materialize(
+        rv,
+        v=not np.array_equal(ct.drot, np.eye(3)),
+        flux=coating is not None
+    )
 
     _batoid.intersect(
         surface._surface,
         ct.dr, ct.drot.ravel(),
-        rv._rv, _coating
+        _rvs(rv), _coating, _differentials(rv)
     )
     rv.coordSys = coordSys
     return rv
@@ -76,11 +130,12 @@ def reflect(surface, rv, coordSys=None, coating=None):
         coordSys = rv.coordSys
     ct = CoordTransform(rv.coordSys, coordSys)
     _coating = coating._coating if coating else None
+    _materialize(rv, v=True, flux=coating is not None)
 
     _batoid.reflect(
         surface._surface,
         ct.dr, ct.drot.ravel(),
-        rv._rv, _coating
+        _rvs(rv), _coating, _differentials(rv)
     )
     rv.coordSys = coordSys
     return rv
@@ -91,12 +146,13 @@ def refract(surface, rv, m1, m2, coordSys=None, coating=None):
         coordSys = rv.coordSys
     ct = CoordTransform(rv.coordSys, coordSys)
     _coating = coating._coating if coating else None
+    _materialize(rv, v=True, flux=coating is not None)
 
     _batoid.refract(
         surface._surface,
         ct.dr, ct.drot.ravel(),
         m1._medium, m2._medium,
-        rv._rv, _coating
+        _rvs(rv), _coating, _differentials(rv)
     )
     rv.coordSys = coordSys
     return rv
@@ -106,14 +162,16 @@ def rSplit(surface, rv, inMedium, outMedium, coating, coordSys=None):
     if coordSys is None:
         coordSys = rv.coordSys
     ct = CoordTransform(rv.coordSys, coordSys)
+    _noDifferentials(rv, "rSplit")
 
+    _materialize(rv, v=True, flux=True)
     rvSplit = rv.copy()
     _batoid.rSplit(
         surface._surface,
         ct.dr, ct.drot.ravel(),
         inMedium._medium, outMedium._medium,
         coating._coating,
-        rv._rv, rvSplit._rv
+        _rvs(rv), _rvs(rvSplit)
     )
     rv.coordSys = coordSys
     rvSplit.coordSys = coordSys
@@ -124,12 +182,14 @@ def refractScreen(surface, rv, screen, coordSys=None):
     if coordSys is None:
         coordSys = rv.coordSys
     ct = CoordTransform(rv.coordSys, coordSys)
+    _noDifferentials(rv, "refractScreen")
+    _materialize(rv, v=True)
 
     _batoid.refractScreen(
         surface._surface,
         ct.dr, ct.drot.ravel(),
         screen._surface,
-        rv._rv
+        _rvs(rv)
     )
     rv.coordSys = coordSys
     return rv
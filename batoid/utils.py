@@ -451,6 +451,55 @@ def fieldToDirCos(u, v, projection='postel'):
         raise ValueError("Bad projection: {}".format(projection))
 
 
+def _fieldToDirCosJacobian(u, v, projection='postel'):
+    """Derivatives of `fieldToDirCos` with respect to field angle.
+
+    Returns
+    -------
+    ndarray of float, shape (3, 2)
+        Element [i, j] is the derivative of direction cosine i with respect to
+        field angle j.
+    """
+    if projection == 'zemax':
+        tu = np.tan(u)
+        tv = np.tan(v)
+        su = 1 + tu*tu
+        sv = 1 + tv*tv
+        norm3 = np.sqrt(su + tv*tv)**3
+        return np.array([
+            [su*sv, -tu*tv*sv],
+            [-tu*tv*su, su*sv],
+            [tu*su, tv*sv]
+        ])/norm3
+    # The rest are azimuthal projections, with direction cosines
+    # (u S, v S, -cos(theta)) for S = sin(theta)/rho, theta = theta(rho).
+    rho = np.sqrt(u*u + v*v)
+    if projection == 'postel':
+        theta, dtheta = rho, 1.0
+    elif projection == 'gnomonic':
+        theta, dtheta = np.arctan(rho), 1/(1 + rho*rho)
+    elif projection == 'stereographic':
+        theta, dtheta = 2*np.arctan(rho/2), 1/(1 + rho*rho/4)
+    elif projection == 'lambert':
+        theta, dtheta = 2*np.arcsin(rho/2), 1/np.sqrt(1 - rho*rho/4)
+    elif projection == 'orthographic':
+        theta, dtheta = np.arcsin(rho), 1/np.sqrt(1 - rho*rho)
+    else:
+        raise ValueError("Bad projection: {}".format(projection))
+    if rho == 0.0:
+        S, dS_rho = 1.0, 0.0
+    else:
+        S = np.sin(theta)/rho
+        # dS/drho / rho; its rounding error, about eps/rho^2, only enters
+        # multiplied by u*u, u*v or v*v.
+        dS_rho = (np.cos(theta)*dtheta*rho - np.sin(theta))/rho**3
+    return np.array([
+        [S + u*u*dS_rho, u*v*dS_rho],
+        [u*v*dS_rho, S + v*v*dS_rho],
+        [S*dtheta*u, S*dtheta*v]
+    ])
+
+
 def dirCosToField(alpha, beta, gamma, projection='postel'):
     """Convert direction cosines to field angle using specified projection.
 
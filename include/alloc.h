@@ -0,0 +1,44 @@
+#ifndef batoid_alloc_h
+#define batoid_alloc_h
+
+#include <cstdlib>  // for size_t
+
+namespace batoid {
+
+    // Controls how ray arrays are allocated.  Arrays are aligned to
+    // `alignment` bytes (at least a cache line).  With hugePages, arrays of a
+    // few MB or more are aligned to and advised as transparent huge pages.
+    // With firstTouch, arrays are initialized in parallel with the same
+    // static OpenMP schedule as the trace kernels, so on NUMA machines each
+    // thread's rays are placed in memory local to that thread.
+    //
+    // Large freed arrays are kept in a thread-safe pool, up to poolBytes in
+    // total, and handed out again for allocations of the same size class.
+    // Repeatedly tracing the same number of rays then reuses memory instead
+    // of page faulting fresh allocations.
+    struct AllocOptions {
+        size_t alignment;
+        bool hugePages;
+        bool firstTouch;
+        size_t poolBytes;
+    };
+
+    void setAllocOptions(const AllocOptions& options);
+    AllocOptions getAllocOptions();
+
+    // Release all pooled arrays, returning the number of bytes freed.
+    size_t clearPool();
+
+    // Allocate n elements, all set to value.
+    template<typename T>
+    T* allocateArray(size_t n, T value=T());
+
+    // Allocate n elements, copied from src.
+    template<typename T>
+    T* allocateCopy(const T* src, size_t n);
+
+    // Release an array from allocateArray or allocateCopy.
+    void freeArray(void* ptr);
+}
+
+#endif
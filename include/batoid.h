@@ -12,30 +12,60 @@ namespace batoid {
     using vec3 = std::array<double, 3>;
     using mat3 = std::array<double, 9>;  // Column major rotation matrix.
 
-    void applyForwardTransform(const vec3 dr, const mat3 drot, RayVector& rv);
-    void applyReverseTransform(const vec3 dr, const mat3 drot, RayVector& rv);
-    void obscure(const Obscuration& obsc, RayVector& rv);
+    // Kernels trace all segments of rays in a single parallel loop over
+    // their flag words, carrying the differentials of any segment that has
+    // them.  They may read uniform RayVector fields, but the caller must
+    // expand any field that a kernel writes ray by ray: the velocity and time
+    // for reflect, refract, rSplit and refractScreen, the time for intersect
+    // (and also the velocity when drot is not the identity), and the flux
+    // whenever a coating is applied.  rSplit expects each segment of
+    // raysSplit to start as a copy of the same segment of rays.
+    void applyForwardTransform(
+        const vec3 dr, const mat3 drot, const RaySegments& rays
+    );
+    void applyReverseTransform(
+        const vec3 dr, const mat3 drot, const RaySegments& rays
+    );
+    void obscure(const Obscuration& obsc, const RaySegments& rays);
     void intersect(
-        const Surface& surface, const vec3 dr, const mat3 drot, RayVector& rv,
-        const Coating* coating
+        const Surface& surface, const vec3 dr, const mat3 drot,
+        const RaySegments& rays, const Coating* coating
     );
     void reflect(
-        const Surface& surface, const vec3 dr, const mat3 drot, RayVector& rv,
-        const Coating* coating
+        const Surface& surface, const vec3 dr, const mat3 drot,
+        const RaySegments& rays, const Coating* coating
     );
     void refract(
         const Surface& surface, const vec3 dr, const mat3 drot,
-        const Medium& m1, const Medium& m2, RayVector& rv, const Coating* coating
+        const Medium& m1, const Medium& m2, const RaySegments& rays,
+        const Coating* coating
     );
     void rSplit(
         const Surface& surface, const vec3 dr, const mat3 drot,
         const Medium& m1, const Medium& m2,
         const Coating& coating,
-        RayVector& rv, RayVector& rvSplit
+        const RaySegments& rays, const RaySegments& raysSplit
     );
     void refractScreen(
         const Surface& surface, const vec3 dr, const mat3 drot,
-        const Surface& screen, RayVector& rv
+        const Surface& screen, const RaySegments& rays
+    );
+
+    // Optical path differences in waves of the traced rays rv, which are left
+    // unchanged, computed separately for the rays of each range [bounds[k],
+    // bounds[k+1]).  The reference point of a range is the position of its
+    // ray bounds[k]+chief, or for chief < 0 the mean position of its
+    // unvignetted rays.  Rays are intersected with the sphere of radius
+    // sphereRadius about that point, on its +z side, and out[i] is the
+    // reference time minus ray i's time there.  The reference time is again
+    // the chief ray's, or the mean over rays still unvignetted.  mask[i] is
+    // true for vignetted rays, including those that miss the sphere.  Rays
+    // outside all ranges are skipped.  A nonnegative chief must be less than
+    // the size of every range; callers check this.
+    void wavefront(
+        const RayVector& rv, const size_t* bounds, size_t nseg,
+        double sphereRadius, long chief, double wavelength,
+        double* out, bool* mask
     );
 
     void applyForwardTransformArrays(
@@ -50,6 +80,16 @@ namespace batoid {
     );
 
     void finishParallel(const vec3 dr, const mat3 drot, const vec3 vv, double* x, double* y, double* z, size_t n);
+
+    void tabulateSurface(
+        const Surface& surface,
+        double x0, double y0, double dx, double dy, size_t nx, size_t ny,
+        double* z, double* dzdx, double* dzdy, double* d2zdxdy
+    );
+    double maxTableError(
+        const Surface& surface, const Surface& approx,
+        double x0, double y0, double dx, double dy, size_t nx, size_t ny
+    );
 }
 
 #endif
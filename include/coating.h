@@ -1,6 +1,8 @@
 #ifndef batoid_coating_h
 #define batoid_coating_h
 
+#include <cstdlib>
+
 namespace batoid {
 
     #if defined(BATOID_GPU)
@@ -43,10 +45,48 @@ namespace batoid {
         double _transmissivity;
     };
 
+    class TableCoating : public Coating {
+    public:
+        // coefs is an interleaved [nw, nc, 2] array of (reflect, transmit)
+        // on uniform grids of wavelength (w0, w0+dw, ...) and of the absolute
+        // value of cosIncidenceAngle (c0, c0+dc, ...).  Lookups are bilinear
+        // and clamp to the edges of the grid.
+        TableCoating(
+            double w0, double dw, size_t nw,
+            double c0, double dc, size_t nc,
+            const double* coefs
+        );
+        ~TableCoating();
+
+        void getCoefs(double wavelength, double cosIncidenceAngle, double& reflect, double& transmit) const override;
+        double getReflect(double wavelength, double cosIncidenceAngle) const override;
+        double getTransmit(double wavelength, double cosIncidenceAngle) const override;
+
+        virtual const Coating* getDevPtr() const override;
+
+    private:
+        const double _w0, _dw;
+        const size_t _nw;
+        const double _c0, _dc;
+        const size_t _nc;
+        const double* _coefs;
+    };
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
 
+    // Unpolarized reflectance and transmittance of a stack of thin lossless
+    // layers, via the characteristic matrix method.  ns is [nlayer+2, nw]:
+    // the incident medium, each layer in order, then the substrate.  Output
+    // coefs is [nw, nc, 2] as consumed by TableCoating.
+    void multilayerCoefs(
+        size_t nlayer, const double* ns, const double* thicknesses,
+        const double* wavelengths, size_t nw,
+        const double* cosIncidenceAngles, size_t nc,
+        double* coefs
+    );
+
 }
 
 #endif
@@ -16,6 +16,7 @@ namespace batoid {
         virtual ~Medium();
 
         virtual double getN(double wavelength) const = 0;
+        void getNMany(size_t size, const double* wavelength, double* out) const;
 
         virtual const Medium* getDevPtr() const = 0;
 
@@ -45,7 +46,12 @@ namespace batoid {
 
     class TableMedium : public Medium {
     public:
-        TableMedium(const double* args, const double* vals, const size_t size);
+        // If ders is not nullptr, it holds dn/dwavelength at each arg and the
+        // table is interpolated with cubic Hermite segments instead of lines.
+        TableMedium(
+            const double* args, const double* vals, const double* ders,
+            const size_t size
+        );
         ~TableMedium();
 
         double getN(double wavelength) const override;
@@ -55,7 +61,10 @@ namespace batoid {
     private:
         const double* _args;
         const double* _vals;
+        const double* _ders;
         const size_t _size;
+        bool _uniform;  // args uniformly spaced?  Then index directly.
+        double _dx;
     };
 
 
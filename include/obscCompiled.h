@@ -0,0 +1,76 @@
+#ifndef batoid_obscCompiled_h
+#define batoid_obscCompiled_h
+
+#include "obscuration.h"
+#include <vector>
+
+namespace batoid {
+
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+    // One step of a compiled obscuration program.  Each instruction tests a
+    // single condition and jumps to onTrue or onFalse, which are either
+    // instruction indices or one of the negative ObscCompiled::Target codes.
+    // Points outside [xmin, xmax] x [ymin, ymax] take onFalse without
+    // evaluating the condition.
+    struct ObscInstr {
+        int op;
+        int onTrue, onFalse;
+        int leaf;  // index into leaves for LEAF; first cell for GRID
+        double xmin, xmax, ymin, ymax;
+        double p[6];
+    };
+
+    class ObscCompiled : public Obscuration {
+    public:
+        // Flatten the tree rooted at source into a short-circuiting program.
+        // Unions with many bounded items additionally get a uniform grid
+        // index so only items near the query point are evaluated.
+        ObscCompiled(const Obscuration* source);
+        ~ObscCompiled();
+
+        bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
+
+        const Obscuration* getDevPtr() const override;
+
+        size_t getProgramSize() const { return _nprog; }
+
+        enum Op { BBOX, CIRCLE, ANNULUS, RECTANGLE, RAY, LEAF, GRID };
+        enum Target { OBSCURED=-1, CLEAR=-2, NEXT_ITEM=-3 };
+
+    private:
+        friend class ObscRasterizer;
+
+        // Device-side constructor; arrays are not owned.
+        ObscCompiled(
+            const ObscInstr* prog, size_t nprog,
+            const Obscuration** leaves, size_t nleaves,
+            const int* cells, size_t ncells
+        );
+
+        const Obscuration* _source;
+        const ObscInstr* _prog;
+        size_t _nprog;
+        const Obscuration** _leaves;
+        size_t _nleaves;
+        // For each GRID instruction: nx*ny+1 offsets followed by the entry
+        // points of the items overlapping each cell.
+        const int* _cells;
+        size_t _ncells;
+        const bool _owner;
+
+        struct Compiler;
+    };
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define batoid_obscuration_h
 
 #include <cstdlib>  // for size_t
+#include <cstdint>
 
 namespace batoid {
 
@@ -16,8 +17,23 @@ namespace batoid {
 
         virtual bool contains(double x, double y) const = 0;
 
+        // Axis-aligned bounding box of the obscured region.  Sides may be
+        // infinite.  Used to build prefilters; the default is unbounded.
+        virtual void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const;
+
         virtual const Obscuration* getDevPtr() const = 0;
 
+        // Rasterize onto the grid xgrid[nx] x ygrid[ny]; xgrid must be
+        // increasing.  out is [ny, (nx+7)/8] bytes with bits packed least
+        // significant first, set where obscured.  Host only; rows are
+        // processed in parallel.
+        void containsGrid(
+            const double* xgrid, const double* ygrid, uint8_t* out,
+            const size_t nx, const size_t ny
+        ) const;
+
     protected:
         mutable Obscuration* _devPtr;
 
@@ -34,10 +50,15 @@ namespace batoid {
         ~ObscCircle();
 
         bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
 
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscCompiled;
+        friend class ObscRasterizer;
         const double _radius, _x0, _y0;
     };
 
@@ -48,10 +69,15 @@ namespace batoid {
         ~ObscAnnulus();
 
         bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
 
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscCompiled;
+        friend class ObscRasterizer;
         const double _inner, _outer, _x0, _y0;
     };
 
@@ -62,10 +88,15 @@ namespace batoid {
         ~ObscRectangle();
 
         bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
 
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscCompiled;
+        friend class ObscRasterizer;
         const double _width, _height, _x0, _y0, _theta;
         const double _sth, _cth;
     };
@@ -77,10 +108,15 @@ namespace batoid {
         ~ObscRay();
 
         bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
 
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscCompiled;
+        friend class ObscRasterizer;
         const double _width, _theta, _x0, _y0;
         const double _sth, _cth;
     };
@@ -92,17 +128,67 @@ namespace batoid {
         ~ObscPolygon();
 
         bool contains(double x, double y) const override;
-
-        void containsGrid(
-            const double* xgrid, const double* ygrid, bool* out, const size_t nx, const size_t ny
-        ) const;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
 
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscRasterizer;
+
+        // Device-side constructor; slab tables are not owned.
+        ObscPolygon(
+            const double* xp, const double* yp, const size_t size,
+            double xmin, double xmax, double ymin, double ymax,
+            size_t nslab, const int* slabs, const double* edges, size_t nedge
+        );
+
         const double* _xp;
         const double* _yp;
         const size_t _size;
+
+        // Edges are bucketed into nslab horizontal slabs of equal height
+        // spanning [ymin, ymax].  _slabs holds nslab+1 offsets into _edges,
+        // which stores (x1, y1, x2, y2) for every edge crossing each slab.
+        double _xmin, _xmax, _ymin, _ymax;
+        size_t _nslab;
+        double _dy;
+        const int* _slabs;
+        const double* _edges;
+        size_t _nedge;
+        const bool _owner;
+    };
+
+
+    class ObscBitmap : public Obscuration {
+    public:
+        // bits holds ny rows of nx pixels covering [xmin, xmax] x [ymin, ymax],
+        // packed least significant bit first with each row padded to a whole
+        // byte.  Set bits are obscured.  With bilinear, the bits are
+        // interpolated between pixel centers and thresholded at 1/2.
+        ObscBitmap(
+            double xmin, double xmax, double ymin, double ymax,
+            size_t nx, size_t ny, const uint8_t* bits, bool bilinear
+        );
+        ~ObscBitmap();
+
+        bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
+
+        const Obscuration* getDevPtr() const override;
+
+    private:
+        bool _bit(int i, int j) const;
+
+        const double _xmin, _xmax, _ymin, _ymax;
+        const size_t _nx, _ny;
+        const double _dx, _dy;
+        const size_t _rowbytes;
+        const uint8_t* _bits;
+        const bool _bilinear;
     };
 
 
@@ -116,6 +202,8 @@ namespace batoid {
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscCompiled;
+        friend class ObscRasterizer;
         const Obscuration* _original;
     };
 
@@ -126,10 +214,15 @@ namespace batoid {
         ~ObscUnion();
 
         bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
 
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscCompiled;
+        friend class ObscRasterizer;
         const Obscuration** _obscs;
         size_t _nobsc;
     };
@@ -141,10 +234,15 @@ namespace batoid {
         ~ObscIntersection();
 
         bool contains(double x, double y) const override;
+        void getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const override;
 
         const Obscuration* getDevPtr() const override;
 
     private:
+        friend class ObscCompiled;
+        friend class ObscRasterizer;
         const Obscuration** _obscs;
         size_t _nobsc;
     };
@@ -26,6 +26,10 @@ namespace batoid {
             double vx, double vy, double vz,
             double& dt
         ) const override;
+        virtual void hessian(
+            double x, double y,
+            double& dzdxx, double& dzdxy, double& dzdyy
+        ) const override;
     };
 
     #if defined(BATOID_GPU)
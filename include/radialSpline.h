@@ -0,0 +1,53 @@
+#ifndef batoid_radialSpline_h
+#define batoid_radialSpline_h
+
+#include "surface.h"
+
+namespace batoid {
+
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+    class RadialSpline : public Surface {
+    public:
+        // zdzdr is an interleaved [n, 2] array of (z, dz/dr) at the uniformly
+        // spaced knots r0, r0+dr, ..., r0+(n-1)*dr.  Interleaving means a single
+        // lookup touches one contiguous pair of knots.
+        RadialSpline(double r0, double dr, const double* zdzdr, size_t n, bool use_nan);
+        ~RadialSpline();
+
+        virtual const Surface* getDevPtr() const override;
+
+        virtual double sag(double, double) const override;
+        virtual void normal(
+            double x, double y,
+            double& nx, double& ny, double& nz
+        ) const override;
+        virtual bool timeToIntersect(
+            double x, double y, double z,
+            double vx, double vy, double vz,
+            double& dt
+        ) const override;
+        virtual void grad(
+            double x, double y,
+            double& dzdx, double& dzdy
+        ) const override;
+
+    private:
+        const double _r0, _dr;
+        const double _rmax;
+        const double* _zdzdr;
+        const size_t _n;
+        const bool _use_nan;
+
+        // Evaluate sag and dz/dr together.  Returns false outside the knot range.
+        bool _eval(double r, double& z, double& dzdr) const;
+    };
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
+}
+#endif
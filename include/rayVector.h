@@ -2,6 +2,9 @@
 #define batoid_rayVector_h
 
 #include <complex>
+#include <cstdint>
+#include <utility>
+#include <vector>
 #include "dualView.h"
 
 namespace batoid {
@@ -12,10 +15,19 @@ namespace batoid {
             double* vx, double* vy, double* vz,
             double* t,
             double* wavelength, double* flux,
-            bool* vignetted, bool* failed,
-            size_t N
+            uint64_t* vignetted, uint64_t* failed,
+            size_t N, int uniform=0, size_t flagOffset=0
         );
 
+        // Fields that may be uniform, i.e., hold a single value shared by all
+        // rays instead of one per ray.  Kernels index these with
+        // i & indexMask(field), and never write them per ray.
+        enum Uniform { VELOCITY=1, TIME=2, WAVELENGTH=4, FLUX=8 };
+
+        size_t indexMask(const DualView<double>& field) const {
+            return field.size == size ? ~size_t(0) : 0;
+        }
+
         bool operator==(const RayVector& rhs) const;
         bool operator!=(const RayVector& rhs) const;
         void positionAtTime(double t, double* xout, double* yout, double* zout) const;
@@ -23,6 +35,61 @@ namespace batoid {
         void phase(double x, double y, double z, double t, double* out) const;
         void amplitude(double x, double y, double z, double t, std::complex<double>* out) const;
         std::complex<double> sumAmplitude(double x, double y, double z, double t, bool ignoreVignetted=true) const;
+        // sumAmplitude at every point r0 + iu*du + iv*dv of a lattice, with
+        // out[iv*nu + iu] the sum for point (iu, iv).  If resync is nonzero,
+        // each ray's phasor is instead advanced along du by complex
+        // multiplication, and recomputed exactly every resync points.
+        void sumAmplitudeGrid(
+            double x0, double y0, double z0, double t,
+            const double* du, const double* dv, size_t nu, size_t nv,
+            bool ignoreVignetted, std::complex<double>* out, size_t resync=0
+        ) const;
+        // Spreading step of a nonuniform FFT of the same lattice sums.  Each
+        // ray's amplitude, shifted to lattice index (nu/2, nv/2), is placed at
+        // its phase steps along du and dv, wrapped to [-pi, pi), and added to
+        // the mu x mv grid over that square with Gaussian weights of variance
+        // 2*tauu and 2*tauv, out to nspread cells on either side.  Requires
+        // mu, mv >= 2*nspread.  grid[iv*mu + iu] is accumulated into.
+        void spreadAmplitude(
+            double x0, double y0, double z0, double t,
+            const double* du, const double* dv, size_t nu, size_t nv,
+            size_t mu, size_t mv, int nspread, double tauu, double tauv,
+            bool ignoreVignetted, std::complex<double>* grid
+        ) const;
+
+        // Copy rays idx[0..out.size) into out, all fields in one parallel
+        // pass.  out must have the same uniform fields as this, which it
+        // shares by value and which are left alone here.
+        void gather(const int64_t* idx, RayVector& out) const;
+        // Gather the rays for which mask is true; out.size must equal the
+        // number of true entries.
+        void compact(const bool* mask, RayVector& out) const;
+        // Statistics of the rays in each of the nseg ranges
+        // [bounds[k], bounds[k+1]), skipping failed rays and, if
+        // ignoreVignetted, vignetted ones.  Rays are weighted by flux if
+        // weighted, else equally.  out[9*k ... 9*k+8] receives the number of
+        // rays used, their total weight, the mean x, y, z and t, and the
+        // central second moments xx, xy and yy of range k.
+        void stats(
+            const size_t* bounds, size_t nseg, bool weighted,
+            bool ignoreVignetted, double* out
+        ) const;
+        // Where the rays of each range converge, treating each as a line
+        // through its position along its velocity, with the same ray
+        // selection and weights as stats.  point and axis (unit length)
+        // define a reference axis.  out[12*k ... 12*k+11] receives the number
+        // of rays used and their total weight; the mean point on the rays of
+        // closest approach to the axis, the RMS spread along the axis of the
+        // corresponding axis points and the RMS distance of the rays from the
+        // axis there; the point minimizing the summed squared distance to the
+        // rays and the RMS distance of the rays from it; and the number of
+        // rays parallel to the axis, which are left out of the closest
+        // approach statistics.
+        void focus(
+            const size_t* bounds, size_t nseg, const double* point,
+            const double* axis, bool weighted, bool ignoreVignetted,
+            double* out
+        ) const;
 
         DualView<double> x;           // 8
         DualView<double> y;           // 16
@@ -33,10 +100,116 @@ namespace batoid {
         DualView<double> t;           // 56
         DualView<double> wavelength;  // 64
         DualView<double> flux;        // 72
-        DualView<bool> vignetted;     // 73
-        DualView<bool> failed;        // 74 cumulative bytes per Ray.
+        // Flags are packed 64 rays per word: ray i is bit (i+flagOffset)%64
+        // of word (i+flagOffset)/64.  flagOffset is nonzero only for views
+        // into a larger RayVector, whose rays own the remaining bits of the
+        // first and last words.  Otherwise bits past the last ray are zero.
+        DualView<uint64_t> vignetted; // 72.125
+        DualView<uint64_t> failed;    // 72.25 cumulative bytes per Ray.
+        size_t size;
+        size_t flagOffset;
+    };
+
+    // Ray differentials: derivatives of ray positions, velocities and times
+    // with respect to nd parameters, such as pupil coordinates and field
+    // angles.  The derivative of component c (x, y, z, vx, vy, vz, t for c =
+    // 0..6) of ray i with respect to parameter k is data[(7*k+c)*stride + i].
+    // Kernels given non-null differentials update them along with the rays,
+    // using surface second derivatives at each intersection.
+    struct RayDifferentials {
+        double* data;
+        size_t nd;
+        size_t stride;
+    };
+
+    // Field pointers of one of the RayVectors in a RaySegments, its
+    // differentials (data is null for none), and its first flag word and ray
+    // in the concatenation of all segments.
+    struct RaySegment {
+        double* x;
+        double* y;
+        double* z;
+        double* vx;
+        double* vy;
+        double* vz;
+        double* t;
+        double* wavelength;
+        double* flux;
+        uint64_t* vignetted;
+        uint64_t* failed;
         size_t size;
+        size_t flagOffset;
+        size_t vmask, tmask, wmask, fmask;  // See RayVector::indexMask.
+        RayDifferentials diff;
+        size_t word0, ray0;
     };
+
+    // Several RayVectors, such as the segments of a SegmentedRayVector, laid
+    // out for kernels that walk all of their flag words in a single parallel
+    // loop.  Flattened word w is word w - word0 of segment
+    // _segmentOf(wordStart, segs.size(), w).  Constructing syncs every field
+    // to the device (and maps the differentials there), and destruction
+    // brings the differentials back.
+    class RaySegments {
+    public:
+        RaySegments(
+            const RayVector* const* rvs, size_t n,
+            const RayDifferentials* diffs=nullptr
+        );
+        explicit RaySegments(
+            const RayVector& rv, const RayDifferentials* diff=nullptr
+        );
+        ~RaySegments();
+        RaySegments(const RaySegments&) = delete;
+        RaySegments& operator=(const RaySegments&) = delete;
+
+        // Statistics and focus of the rays in the ranges [bounds[k],
+        // bounds[k+1]) of the concatenation of all segments; see
+        // RayVector::stats and RayVector::focus.
+        void stats(
+            const size_t* bounds, size_t nseg, bool weighted,
+            bool ignoreVignetted, double* out
+        ) const;
+        void focus(
+            const size_t* bounds, size_t nseg, const double* point,
+            const double* axis, bool weighted, bool ignoreVignetted,
+            double* out
+        ) const;
+
+        std::vector<RaySegment> segs;
+        // word0 of each segment, followed by the total number of words.
+        std::vector<size_t> wordStart;
+        size_t nray;
+
+    private:
+        void _add(const RayVector& rv, const RayDifferentials* diff);
+        // Host differentials mapped to the device, and their lengths.
+        std::vector<std::pair<double*, size_t>> _mappedDiffs;
+    };
+
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+    // Index k of the range [bounds[k], bounds[k+1]) holding i, clamped to
+    // [0, nseg).  Of several ranges starting at i, the last (the only
+    // nonempty one) is chosen.
+    inline size_t _segmentOf(const size_t* bounds, size_t nseg, size_t i) {
+        size_t lo = 0;
+        size_t hi = nseg;
+        while (hi-lo > 1) {
+            size_t mid = (lo+hi)/2;
+            if (bounds[mid] <= i)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
 }
 
 #endif
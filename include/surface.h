@@ -29,11 +29,24 @@ namespace batoid {
             double x, double y,
             double& dzdx, double& dzdy
         ) const;
+        // Second derivatives of the sag, for propagating ray differentials.
+        // The default takes central differences of grad.
+        virtual void hessian(
+            double x, double y,
+            double& dzdxx, double& dzdxy, double& dzdyy
+        ) const;
 
     protected:
         Surface();
         mutable Surface* _devPtr;
 
+        // Hessian of an axisymmetric sag with first radial derivative over
+        // radius dzdr_r and second radial derivative d2zdr2 at (x, y).
+        static void _radialHessian(
+            double x, double y, double dzdr_r, double d2zdr2,
+            double& dzdxx, double& dzdxy, double& dzdyy
+        );
+
     private:
         #if defined(BATOID_GPU)
         void freeDevPtr() const;
@@ -0,0 +1,66 @@
+#include "alloc.h"
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+
+namespace py = pybind11;
+
+namespace batoid {
+    // Wrap memory from the batoid allocator in a numpy array that releases it
+    // when garbage collected.
+    template<typename T>
+    py::array_t<T> ownedArray(T* ptr, size_t n) {
+        py::capsule owner(ptr, [](void* p){ freeArray(p); });
+        return py::array_t<T>(n, ptr, owner);
+    }
+
+    void pyExportAlloc(py::module& m) {
+        using namespace pybind11::literals;
+
+        m.def(
+            "setAllocOptions",
+            [](size_t alignment, bool hugePages, bool firstTouch, size_t poolBytes){
+                setAllocOptions({alignment, hugePages, firstTouch, poolBytes});
+            },
+            "alignment"_a, "hugePages"_a, "firstTouch"_a, "poolBytes"_a
+        );
+        m.def(
+            "getAllocOptions",
+            [](){
+                AllocOptions options = getAllocOptions();
+                return py::make_tuple(
+                    options.alignment, options.hugePages, options.firstTouch,
+                    options.poolBytes
+                );
+            }
+        );
+        m.def("clearPool", &clearPool);
+        m.def(
+            "fullDouble",
+            [](size_t n, double value){
+                return ownedArray(allocateArray<double>(n, value), n);
+            }
+        );
+        m.def(
+            "fullUInt64",
+            [](size_t n, uint64_t value){
+                return ownedArray(allocateArray<uint64_t>(n, value), n);
+            }
+        );
+        m.def(
+            "copyDouble",
+            [](size_t src, size_t n){
+                return ownedArray(
+                    allocateCopy<double>(reinterpret_cast<const double*>(src), n), n
+                );
+            }
+        );
+        m.def(
+            "copyUInt64",
+            [](size_t src, size_t n){
+                return ownedArray(
+                    allocateCopy<uint64_t>(reinterpret_cast<const uint64_t*>(src), n), n
+                );
+            }
+        );
+    }
+}
@@ -9,6 +9,7 @@
 namespace py = pybind11;
 
 namespace batoid {
+    void pyExportAlloc(py::module&);
     void pyExportRayVector(py::module&);
 
     void pyExportTable(py::module&);
@@ -18,6 +19,7 @@ namespace batoid {
     void pyExportAsphere(py::module&);
     void pyExportTilted(py::module&);
     void pyExportBicubic(py::module&);
+    void pyExportRadialSpline(py::module&);
     void pyExportSphere(py::module&);
     void pyExportSum(py::module&);
     void pyExportParaboloid(py::module&);
@@ -28,7 +30,21 @@ namespace batoid {
     void pyExportMedium(py::module&);
     void pyExportObscuration(py::module&);
 
+    // Differentials of each segment from their concatenated data pointers,
+    // numbers of parameters and strides.
+    static std::vector<RayDifferentials> _differentials(
+        const std::vector<size_t>& diffs
+    ) {
+        std::vector<RayDifferentials> out;
+        for(size_t k=0; k+3<=diffs.size(); k+=3)
+            out.push_back(RayDifferentials{
+                reinterpret_cast<double*>(diffs[k]), diffs[k+1], diffs[k+2]
+            });
+        return out;
+    }
+
     PYBIND11_MODULE(_batoid, m) {
+        pyExportAlloc(m);
         pyExportRayVector(m);
 
         pyExportTable(m);
@@ -38,6 +54,7 @@ namespace batoid {
         pyExportAsphere(m); // Order Surface, Quadric, Asphere important b/c inheritance
         pyExportTilted(m);
         pyExportBicubic(m);
+        pyExportRadialSpline(m);
         pyExportSphere(m);
         pyExportSum(m);
         pyExportParaboloid(m);
@@ -50,14 +67,112 @@ namespace batoid {
 
         using namespace pybind11::literals;
 
-        m.def("applyForwardTransform", &applyForwardTransform);
-        m.def("applyReverseTransform", &applyReverseTransform);
-        m.def("intersect", &intersect);
-        m.def("reflect", &reflect);
-        m.def("refract", &refract);
-        m.def("refractScreen", &refractScreen);
-        m.def("obscure", &obscure);
-        m.def("rSplit", &rSplit);
+        // Rays are passed as the list of segments of a (Segmented)RayVector
+        // and, for each segment, the data pointer (0 for none), number of
+        // parameters and stride of its differentials, all concatenated into
+        // diffs; see RaySegments and RayDifferentials.
+        m.def(
+            "applyForwardTransform",
+            [](
+                const vec3 dr, const mat3 drot,
+                const std::vector<RayVector*>& rvs,
+                const std::vector<size_t>& diffs
+            ){
+                auto d = _differentials(diffs);
+                applyForwardTransform(
+                    dr, drot, RaySegments(rvs.data(), rvs.size(), d.data())
+                );
+            }
+        );
+        m.def(
+            "applyReverseTransform",
+            [](
+                const vec3 dr, const mat3 drot,
+                const std::vector<RayVector*>& rvs,
+                const std::vector<size_t>& diffs
+            ){
+                auto d = _differentials(diffs);
+                applyReverseTransform(
+                    dr, drot, RaySegments(rvs.data(), rvs.size(), d.data())
+                );
+            }
+        );
+        m.def(
+            "intersect",
+            [](
+                const Surface& surface, const vec3 dr, const mat3 drot,
+                const std::vector<RayVector*>& rvs, const Coating* coating,
+                const std::vector<size_t>& diffs
+            ){
+                auto d = _differentials(diffs);
+                intersect(
+                    surface, dr, drot,
+                    RaySegments(rvs.data(), rvs.size(), d.data()), coating
+                );
+            }
+        );
+        m.def(
+            "reflect",
+            [](
+                const Surface& surface, const vec3 dr, const mat3 drot,
+                const std::vector<RayVector*>& rvs, const Coating* coating,
+                const std::vector<size_t>& diffs
+            ){
+                auto d = _differentials(diffs);
+                reflect(
+                    surface, dr, drot,
+                    RaySegments(rvs.data(), rvs.size(), d.data()), coating
+                );
+            }
+        );
+        m.def(
+            "refract",
+            [](
+                const Surface& surface, const vec3 dr, const mat3 drot,
+                const Medium& m1, const Medium& m2,
+                const std::vector<RayVector*>& rvs, const Coating* coating,
+                const std::vector<size_t>& diffs
+            ){
+                auto d = _differentials(diffs);
+                refract(
+                    surface, dr, drot, m1, m2,
+                    RaySegments(rvs.data(), rvs.size(), d.data()), coating
+                );
+            }
+        );
+        m.def(
+            "refractScreen",
+            [](
+                const Surface& surface, const vec3 dr, const mat3 drot,
+                const Surface& screen, const std::vector<RayVector*>& rvs
+            ){
+                refractScreen(
+                    surface, dr, drot, screen,
+                    RaySegments(rvs.data(), rvs.size())
+                );
+            }
+        );
+        m.def(
+            "obscure",
+            [](const Obscuration& obsc, const std::vector<RayVector*>& rvs){
+                obscure(obsc, RaySegments(rvs.data(), rvs.size()));
+            }
+        );
+        m.def(
+            "rSplit",
+            [](
+                const Surface& surface, const vec3 dr, const mat3 drot,
+                const Medium& m1, const Medium& m2, const Coating& coating,
+                const std::vector<RayVector*>& rvs,
+                const std::vector<RayVector*>& rvSplits
+            ){
+                rSplit(
+                    surface, dr, drot, m1, m2, coating,
+                    RaySegments(rvs.data(), rvs.size()),
+                    RaySegments(rvSplits.data(), rvSplits.size())
+                );
+            }
+        );
         m.def(
             "applyForwardTransformArrays",
             [](
@@ -115,6 +230,37 @@ namespace batoid {
                     n
                 );
             });
+        m.def(
+            "tabulateSurface",
+            [](
+                const Surface& surface,
+                double x0, double y0, double dx, double dy,
+                size_t nx, size_t ny,
+                size_t z, size_t dzdx, size_t dzdy, size_t d2zdxdy
+            ){
+                tabulateSurface(
+                    surface, x0, y0, dx, dy, nx, ny,
+                    reinterpret_cast<double*>(z),
+                    reinterpret_cast<double*>(dzdx),
+                    reinterpret_cast<double*>(dzdy),
+                    reinterpret_cast<double*>(d2zdxdy)
+                );
+            });
+        m.def("maxTableError", &maxTableError);
+        m.def(
+            "wavefront",
+            [](
+                const RayVector& rv, size_t bounds, size_t nseg,
+                double sphereRadius, long chief, double wavelength,
+                size_t out, size_t mask
+            ){
+                wavefront(
+                    rv, reinterpret_cast<size_t*>(bounds), nseg,
+                    sphereRadius, chief, wavelength,
+                    reinterpret_cast<double*>(out),
+                    reinterpret_cast<bool*>(mask)
+                );
+            });
         m.def(
             "get_nthreads",
 #if defined(_OPENMP)
@@ -129,6 +275,14 @@ namespace batoid {
             [](int nthreads) { omp_set_num_threads(nthreads); }
 #else
             [](int nthreads) { }
+#endif
+        )
+        .def(
+            "has_gpu",
+#if defined(BATOID_GPU)
+            []() { return true; }
+#else
+            []() { return false; }
 #endif
         );
         // #if defined(BATOID_GPU)
@@ -18,5 +18,38 @@ namespace batoid {
 
         py::class_<SimpleCoating, std::shared_ptr<SimpleCoating>, Coating>(m, "CPPSimpleCoating")
             .def(py::init<double,double>(), "reflectivity"_a, "transmissivity"_a);
+
+        py::class_<TableCoating, std::shared_ptr<TableCoating>, Coating>(m, "CPPTableCoating")
+            .def(py::init(
+                [](
+                    double w0, double dw, size_t nw,
+                    double c0, double dc, size_t nc,
+                    size_t coefs
+                ){
+                    return new TableCoating(
+                        w0, dw, nw, c0, dc, nc,
+                        reinterpret_cast<double*>(coefs)
+                    );
+                }
+            ));
+
+        m.def(
+            "multilayerCoefs",
+            [](
+                size_t nlayer, size_t ns, size_t thicknesses,
+                size_t wavelengths, size_t nw,
+                size_t cosIncidenceAngles, size_t nc,
+                size_t coefs
+            ){
+                multilayerCoefs(
+                    nlayer,
+                    reinterpret_cast<double*>(ns),
+                    reinterpret_cast<double*>(thicknesses),
+                    reinterpret_cast<double*>(wavelengths), nw,
+                    reinterpret_cast<double*>(cosIncidenceAngles), nc,
+                    reinterpret_cast<double*>(coefs)
+                );
+            }
+        );
     }
 }
@@ -9,7 +9,17 @@ using namespace pybind11::literals;
 namespace batoid {
     void pyExportMedium(py::module& m) {
         py::class_<Medium, std::shared_ptr<Medium>>(m, "CPPMedium")
-            .def("getN", py::vectorize(&Medium::getN));
+            .def("getN", py::vectorize(&Medium::getN))
+            .def(
+                "getNMany",
+                [](const Medium& m, size_t size, size_t w, size_t out){
+                    m.getNMany(
+                        size,
+                        reinterpret_cast<double*>(w),
+                        reinterpret_cast<double*>(out)
+                    );
+                }
+            );
 
 
         py::class_<ConstMedium, std::shared_ptr<ConstMedium>, Medium>(m, "CPPConstMedium")
@@ -21,11 +31,13 @@ namespace batoid {
                 [](
                     size_t w,
                     size_t n,
+                    size_t dndw,
                     size_t size
                 ){
                     return new TableMedium(
                         reinterpret_cast<double*>(w),
                         reinterpret_cast<double*>(n),
+                        reinterpret_cast<double*>(dndw),
                         size
                     );
                 }
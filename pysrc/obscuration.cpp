@@ -1,4 +1,5 @@
 #include "obscuration.h"
+#include "obscCompiled.h"
 #include <memory>
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
@@ -11,7 +12,25 @@ using namespace pybind11::literals;
 namespace batoid {
     void pyExportObscuration(py::module& m) {
         py::class_<Obscuration, std::shared_ptr<Obscuration>>(m, "CPPObscuration")
-            .def("contains", py::vectorize(&Obscuration::contains));
+            .def("contains", py::vectorize(&Obscuration::contains))
+            .def(
+                "containsGrid",
+                [](
+                    const Obscuration& o,
+                    size_t x_ptr,
+                    size_t y_ptr,
+                    size_t out_ptr,
+                    size_t nx,
+                    size_t ny
+                ){
+                    o.containsGrid(
+                        reinterpret_cast<const double*>(x_ptr),
+                        reinterpret_cast<const double*>(y_ptr),
+                        reinterpret_cast<uint8_t*>(out_ptr),
+                        nx, ny
+                    );
+                }
+            );
 
 
         py::class_<ObscCircle, std::shared_ptr<ObscCircle>, Obscuration>(m, "CPPObscCircle")
@@ -43,25 +62,24 @@ namespace batoid {
                         size
                     );
                 }
-            ))
-            .def(
-                "containsGrid",
+            ));
+
+
+        py::class_<ObscBitmap, std::shared_ptr<ObscBitmap>, Obscuration>(m, "CPPObscBitmap")
+            .def(py::init(
                 [](
-                    const ObscPolygon& op,
-                    size_t x_ptr,
-                    size_t y_ptr,
-                    size_t out_ptr,
-                    size_t nx,
-                    size_t ny
+                    double xmin, double xmax, double ymin, double ymax,
+                    size_t nx, size_t ny,
+                    size_t bits,
+                    bool bilinear
                 ){
-                    op.containsGrid(
-                        reinterpret_cast<const double*>(x_ptr),
-                        reinterpret_cast<const double*>(y_ptr),
-                        reinterpret_cast<bool*>(out_ptr),
-                        nx, ny
+                    return new ObscBitmap(
+                        xmin, xmax, ymin, ymax, nx, ny,
+                        reinterpret_cast<const uint8_t*>(bits),
+                        bilinear
                     );
                 }
-            );
+            ));
 
 
         py::class_<ObscNegation, std::shared_ptr<ObscNegation>, Obscuration>(m, "CPPObscNegation")
@@ -89,5 +107,9 @@ namespace batoid {
                     return new ObscIntersection(_obscs, obscs.size());
                 }
             ));
+
+        py::class_<ObscCompiled, std::shared_ptr<ObscCompiled>, Obscuration>(m, "CPPObscCompiled")
+            .def(py::init<const Obscuration*>(), py::keep_alive<1,2>())
+            .def_property_readonly("programSize", &ObscCompiled::getProgramSize);
     }
 }
@@ -0,0 +1,27 @@
+#include "radialSpline.h"
+#include <memory>
+#include <pybind11/pybind11.h>
+
+namespace py = pybind11;
+using namespace pybind11::literals;
+
+namespace batoid {
+    void pyExportRadialSpline(py::module& m) {
+        py::class_<RadialSpline, std::shared_ptr<RadialSpline>, Surface>(m, "CPPRadialSpline")
+            .def(py::init(
+                [](
+                    double r0,
+                    double dr,
+                    size_t zdzdr_ptr,
+                    size_t n,
+                    bool use_nan
+                ){
+                    return new RadialSpline(
+                        r0, dr,
+                        reinterpret_cast<double*>(zdzdr_ptr),
+                        n, use_nan
+                    );
+                }
+            ));
+    }
+}
@@ -22,11 +22,11 @@ namespace batoid {
             .def_readonly("size", &DualView<double>::size)
             .def_readonly("ownsHostData", &DualView<double>::ownsHostData);
 
-        auto dvb = py::class_<DualView<bool>>(m, "CPPDualViewBool")
-            .def("syncToHost", &DualView<bool>::syncToHost)
-            .def("syncToDevice", &DualView<bool>::syncToDevice)
-            .def_readonly("size", &DualView<bool>::size)
-            .def_readonly("ownsHostData", &DualView<bool>::ownsHostData);
+        auto dvu = py::class_<DualView<uint64_t>>(m, "CPPDualViewUInt64")
+            .def("syncToHost", &DualView<uint64_t>::syncToHost)
+            .def("syncToDevice", &DualView<uint64_t>::syncToDevice)
+            .def_readonly("size", &DualView<uint64_t>::size)
+            .def_readonly("ownsHostData", &DualView<uint64_t>::ownsHostData);
 
         auto rv = py::class_<RayVector>(m, "CPPRayVector")
             .def(py::init(
@@ -42,7 +42,9 @@ namespace batoid {
                     size_t f_ptr,
                     size_t vig_ptr,
                     size_t fail_ptr,
-                    size_t size
+                    size_t size,
+                    int uniform,
+                    size_t flagOffset
                 ){
                     return new RayVector(
                         reinterpret_cast<double*>(x_ptr),
@@ -54,9 +56,9 @@ namespace batoid {
                         reinterpret_cast<double*>(t_ptr),
                         reinterpret_cast<double*>(w_ptr),
                         reinterpret_cast<double*>(f_ptr),
-                        reinterpret_cast<bool*>(vig_ptr),
-                        reinterpret_cast<bool*>(fail_ptr),
-                        size
+                        reinterpret_cast<uint64_t*>(vig_ptr),
+                        reinterpret_cast<uint64_t*>(fail_ptr),
+                        size, uniform, flagOffset
                     );
                 }
             ))
@@ -82,6 +84,74 @@ namespace batoid {
                 }
             )
             .def("sumAmplitude", &RayVector::sumAmplitude)
+            .def("sumAmplitudeGrid",
+                [](
+                    const RayVector& rv, double x, double y, double z, double t,
+                    const std::array<double, 3> du, const std::array<double, 3> dv,
+                    size_t nu, size_t nv, bool ignoreVignetted, size_t out_ptr,
+                    size_t resync
+                ){
+                    rv.sumAmplitudeGrid(
+                        x, y, z, t, du.data(), dv.data(), nu, nv,
+                        ignoreVignetted,
+                        reinterpret_cast<std::complex<double>*>(out_ptr),
+                        resync
+                    );
+                }
+            )
+            .def("spreadAmplitude",
+                [](
+                    const RayVector& rv, double x, double y, double z, double t,
+                    const std::array<double, 3> du, const std::array<double, 3> dv,
+                    size_t nu, size_t nv, size_t mu, size_t mv, int nspread,
+                    double tauu, double tauv, bool ignoreVignetted,
+                    size_t grid_ptr
+                ){
+                    rv.spreadAmplitude(
+                        x, y, z, t, du.data(), dv.data(), nu, nv,
+                        mu, mv, nspread, tauu, tauv, ignoreVignetted,
+                        reinterpret_cast<std::complex<double>*>(grid_ptr)
+                    );
+                }
+            )
+            .def("gather",
+                [](const RayVector& rv, size_t idx_ptr, RayVector& out){
+                    rv.gather(reinterpret_cast<int64_t*>(idx_ptr), out);
+                }
+            )
+            .def("compact",
+                [](const RayVector& rv, size_t mask_ptr, RayVector& out){
+                    rv.compact(reinterpret_cast<bool*>(mask_ptr), out);
+                }
+            )
+            .def("stats",
+                [](
+                    const RayVector& rv, size_t bounds_ptr, size_t nseg,
+                    bool weighted, bool ignoreVignetted, size_t out_ptr
+                ){
+                    rv.stats(
+                        reinterpret_cast<size_t*>(bounds_ptr), nseg,
+                        weighted, ignoreVignetted,
+                        reinterpret_cast<double*>(out_ptr)
+                    );
+                }
+            )
+            .def("focus",
+                [](
+                    const RayVector& rv, size_t bounds_ptr, size_t nseg,
+                    size_t point_ptr, size_t axis_ptr, bool weighted,
+                    bool ignoreVignetted, size_t out_ptr
+                ){
+                    rv.focus(
+                        reinterpret_cast<size_t*>(bounds_ptr), nseg,
+                        reinterpret_cast<double*>(point_ptr),
+                        reinterpret_cast<double*>(axis_ptr),
+                        weighted, ignoreVignetted,
+                        reinterpret_cast<double*>(out_ptr)
+                    );
+                }
+            )
+            .def_readonly("flagOffset", &RayVector::flagOffset)
             .def(py::self == py::self)
             .def(py::self != py::self)
 
@@ -98,5 +168,36 @@ namespace batoid {
             .def_readonly("vignetted", &RayVector::vignetted)
             .def_readonly("failed", &RayVector::failed)
             ;
+
+        // stats and focus of all segments of a SegmentedRayVector in one
+        // pass, bounds indexing the concatenated rays.
+        m.def("segmentedStats",
+            [](
+                const std::vector<RayVector*>& rvs, size_t bounds_ptr,
+                size_t nseg, bool weighted, bool ignoreVignetted,
+                size_t out_ptr
+            ){
+                RaySegments(rvs.data(), rvs.size()).stats(
+                    reinterpret_cast<size_t*>(bounds_ptr), nseg,
+                    weighted, ignoreVignetted,
+                    reinterpret_cast<double*>(out_ptr)
+                );
+            }
+        );
+        m.def("segmentedFocus",
+            [](
+                const std::vector<RayVector*>& rvs, size_t bounds_ptr,
+                size_t nseg, size_t point_ptr, size_t axis_ptr, bool weighted,
+                bool ignoreVignetted, size_t out_ptr
+            ){
+                RaySegments(rvs.data(), rvs.size()).focus(
+                    reinterpret_cast<size_t*>(bounds_ptr), nseg,
+                    reinterpret_cast<double*>(point_ptr),
+                    reinterpret_cast<double*>(axis_ptr),
+                    weighted, ignoreVignetted,
+                    reinterpret_cast<double*>(out_ptr)
+                );
+            }
+        );
     }
 }
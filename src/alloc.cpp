@@ -0,0 +1,174 @@
+#include "alloc.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+
+namespace batoid {
+
+    static AllocOptions _options{64, false, true, size_t(1) << 30};
+    static const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+    // Smaller arrays are left to malloc, which already recycles them cheaply.
+    static const size_t MIN_POOLED_SIZE = size_t(64) << 10;
+
+    // Pooled blocks are keyed by size class, alignment and huge page status,
+    // so a reused block always satisfies the current options.
+    struct BlockKey {
+        size_t capacity;
+        size_t alignment;
+        bool huge;
+        bool operator<(const BlockKey& rhs) const {
+            return std::tie(capacity, alignment, huge)
+                < std::tie(rhs.capacity, rhs.alignment, rhs.huge);
+        }
+    };
+
+    static std::mutex _poolMutex;
+    static std::unordered_map<void*, BlockKey> _liveBlocks;
+    static std::map<BlockKey, std::vector<void*>> _pool;
+    static size_t _pooledBytes = 0;
+
+    // Round up to a size class; classes are spaced 4 per power of 2 so at
+    // most 25% of a block goes unused.
+    static size_t sizeClass(size_t nbytes) {
+        size_t step = 1;
+        while (step*8 <= nbytes)
+            step *= 2;
+        return (nbytes + step - 1) / step * step;
+    }
+
+    // Free pooled blocks until at most maxBytes remain.  Caller holds the
+    // pool mutex.
+    static void trimPool(size_t maxBytes) {
+        auto it = _pool.begin();
+        while (_pooledBytes > maxBytes && it != _pool.end()) {
+            auto& blocks = it->second;
+            while (_pooledBytes > maxBytes && !blocks.empty()) {
+                std::free(blocks.back());
+                blocks.pop_back();
+                _pooledBytes -= it->first.capacity;
+            }
+            it = blocks.empty() ? _pool.erase(it) : std::next(it);
+        }
+    }
+
+    void setAllocOptions(const AllocOptions& options) {
+        std::lock_guard<std::mutex> lock(_poolMutex);
+        // Pooled blocks allocated under other settings would never be
+        // reused.
+        bool stale = (options.alignment != _options.alignment)
+            || (options.hugePages != _options.hugePages);
+        _options = options;
+        trimPool(stale ? 0 : _options.poolBytes);
+    }
+
+    AllocOptions getAllocOptions() {
+        return _options;
+    }
+
+    size_t clearPool() {
+        std::lock_guard<std::mutex> lock(_poolMutex);
+        size_t freed = _pooledBytes;
+        trimPool(0);
+        return freed;
+    }
+
+    static void* rawAllocate(size_t nbytes) {
+        size_t alignment = std::max(_options.alignment, sizeof(void*));
+        bool huge = _options.hugePages && nbytes >= HUGE_PAGE_SIZE;
+        if (huge) {
+            alignment = std::max(alignment, HUGE_PAGE_SIZE);
+            // Round up so the last huge page isn't shared with other data.
+            nbytes = (nbytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        }
+        bool pooled = nbytes >= MIN_POOLED_SIZE && _options.poolBytes > 0;
+        BlockKey key{pooled ? sizeClass(nbytes) : nbytes, alignment, huge};
+        if (pooled) {
+            std::lock_guard<std::mutex> lock(_poolMutex);
+            auto it = _pool.find(key);
+            if (it != _pool.end() && !it->second.empty()) {
+                void* ptr = it->second.back();
+                it->second.pop_back();
+                _pooledBytes -= key.capacity;
+                _liveBlocks[ptr] = key;
+                return ptr;
+            }
+        }
+
+        void* ptr;
+        if (posix_memalign(&ptr, alignment, std::max(key.capacity, size_t(1))))
+            throw std::bad_alloc();
+        #if defined(__linux__) && defined(MADV_HUGEPAGE)
+            if (huge)
+                madvise(ptr, key.capacity, MADV_HUGEPAGE);
+        #endif
+        if (pooled) {
+            std::lock_guard<std::mutex> lock(_poolMutex);
+            _liveBlocks[ptr] = key;
+        }
+        return ptr;
+    }
+
+    template<typename T>
+    T* allocateArray(size_t n, T value) {
+        T* ptr = static_cast<T*>(rawAllocate(n*sizeof(T)));
+        if (_options.firstTouch) {
+            // Same loop and schedule as the kernels in batoid.cpp.
+            #pragma omp parallel for schedule(static)
+            for(int i=0; i<n; i++) {
+                ptr[i] = value;
+            }
+        } else {
+            std::fill(ptr, ptr+n, value);
+        }
+        return ptr;
+    }
+
+    template<typename T>
+    T* allocateCopy(const T* src, size_t n) {
+        T* ptr = static_cast<T*>(rawAllocate(n*sizeof(T)));
+        if (_options.firstTouch) {
+            #pragma omp parallel for schedule(static)
+            for(int i=0; i<n; i++) {
+                ptr[i] = src[i];
+            }
+        } else {
+            std::copy(src, src+n, ptr);
+        }
+        return ptr;
+    }
+
+    void freeArray(void* ptr) {
+        {
+            std::lock_guard<std::mutex> lock(_poolMutex);
+            auto it = _liveBlocks.find(ptr);
+            if (it != _liveBlocks.end()) {
+                BlockKey key = it->second;
+                _liveBlocks.erase(it);
+                if (_pooledBytes + key.capacity <= _options.poolBytes) {
+                    _pool[key].push_back(ptr);
+                    _pooledBytes += key.capacity;
+                    return;
+                }
+            }
+        }
+        std::free(ptr);
+    }
+
+    template double* allocateArray<double>(size_t, double);
+    template bool* allocateArray<bool>(size_t, bool);
+    template int* allocateArray<int>(size_t, int);
+    template uint64_t* allocateArray<uint64_t>(size_t, uint64_t);
+    template double* allocateCopy<double>(const double*, size_t);
+    template bool* allocateCopy<bool>(const bool*, size_t);
+    template int* allocateCopy<int>(const int*, size_t);
+    template uint64_t* allocateCopy<uint64_t>(const uint64_t*, size_t);
+}
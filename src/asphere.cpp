@@ -84,6 +84,28 @@ namespace batoid {
         return Surface::timeToIntersect(x, y, z, vx, vy, vz, dt);
     }
 
+    void Asphere::hessian(
+        double x, double y,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) const {
+        Quadric::hessian(x, y, dzdxx, dzdxy, dzdyy);
+        // Polynomial terms coefs[j] r^(2j+4), by linearity.
+        double r2 = x*x + y*y;
+        double rr = r2;
+        double dzdr_r = 0.0;
+        double d2zdr2 = 0.0;
+        for (int j=0; j<_size; j++) {
+            dzdr_r += _dzdrcoefs[j]*rr;
+            d2zdr2 += _dzdrcoefs[j]*(2*j+3)*rr;
+            rr *= r2;
+        }
+        double hxx, hxy, hyy;
+        _radialHessian(x, y, dzdr_r, d2zdr2, hxx, hxy, hyy);
+        dzdxx += hxx;
+        dzdxy += hxy;
+        dzdyy += hyy;
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
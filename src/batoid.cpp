@@ -1,7 +1,128 @@
 #include "batoid.h"
+#include "sphere.h"
 
 namespace batoid {
 
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+    // Rotate the position and velocity differentials of one ray, d pointing
+    // at its x derivative for parameter 0, like a ray's position and
+    // velocity in applyForwardTransform (or applyReverseTransform).
+    static void _rotateDifferentials(
+        const double* drot, bool reverse, double* d, size_t nd, size_t stride
+    ) {
+        for(size_t k=0; k<nd; k++) {
+            for(int c=0; c<6; c+=3) {
+                double* p = d + (7*k+c)*stride;
+                double ax = p[0];
+                double ay = p[stride];
+                double az = p[2*stride];
+                if (reverse) {
+                    p[0] = ax*drot[0] + ay*drot[1] + az*drot[2];
+                    p[stride] = ax*drot[3] + ay*drot[4] + az*drot[5];
+                    p[2*stride] = ax*drot[6] + ay*drot[7] + az*drot[8];
+                } else {
+                    p[0] = ax*drot[0] + ay*drot[3] + az*drot[6];
+                    p[stride] = ax*drot[1] + ay*drot[4] + az*drot[7];
+                    p[2*stride] = ax*drot[2] + ay*drot[5] + az*drot[8];
+                }
+            }
+        }
+    }
+
+    enum { DIFF_INTERSECT, DIFF_REFLECT, DIFF_REFRACT };
+
+    // Carry the differentials of one ray, already in the surface's frame,
+    // across its intersection with surface at (x, y) after time dt, v being
+    // the incoming velocity.  For DIFF_REFLECT and DIFF_REFRACT (into index
+    // n2), also differentiate the change of velocity there, which depends on
+    // the differentials through the incoming velocity and, via the surface
+    // curvature, the normal at the moved intersection point.
+    static void _surfaceDifferentials(
+        const Surface* surface, int mode,
+        double x, double y, double vx, double vy, double vz, double dt,
+        double n2, double* d, size_t nd, size_t stride
+    ) {
+        double nx, ny, nz;
+        surface->normal(x, y, nx, ny, nz);
+        double vn = vx*nx + vy*ny + vz*nz;
+        double hxx = 0.0, hxy = 0.0, hyy = 0.0;
+        if (mode != DIFF_INTERSECT)
+            surface->hessian(x, y, hxx, hxy, hyy);
+        // Quantities of the velocity change itself; see reflect and refract.
+        double n1 = 1/sqrt(vx*vx + vy*vy + vz*vz);
+        double sgn = (vn > 0.0 && mode == DIFF_REFRACT) ? -1.0 : 1.0;
+        double alpha = (mode == DIFF_REFRACT) ? sgn*vn*n1 : vn;
+        double eta = (mode == DIFF_REFRACT) ? n1/n2 : 0.0;
+        double root = sqrt(1-eta*eta*(1-alpha*alpha));
+        double nfactor = eta*alpha + root;
+
+        for(size_t k=0; k<nd; k++) {
+            double* p = d + 7*k*stride;
+            double Drx = p[0];
+            double Dry = p[stride];
+            double Drz = p[2*stride];
+            double Dvx = p[3*stride];
+            double Dvy = p[4*stride];
+            double Dvz = p[5*stride];
+            // Transfer: the intersection time changes so the moved ray still
+            // meets the surface.
+            Drx += dt*Dvx;
+            Dry += dt*Dvy;
+            Drz += dt*Dvz;
+            double Ddt = -(Drx*nx + Dry*ny + Drz*nz)/vn;
+            Drx += vx*Ddt;
+            Dry += vy*Ddt;
+            Drz += vz*Ddt;
+            p[0] = Drx;
+            p[stride] = Dry;
+            p[2*stride] = Drz;
+            p[6*stride] += Ddt;
+            if (mode == DIFF_INTERSECT)
+                continue;
+
+            // Change of the unit normal n = m/|m|, m = (-dz/dx, -dz/dy, 1),
+            // as the intersection moves by (Drx, Dry).
+            double Dmx = -(hxx*Drx + hxy*Dry);
+            double Dmy = -(hxy*Drx + hyy*Dry);
+            double nDm = nx*Dmx + ny*Dmy;
+            double Dnx = nz*(Dmx - nx*nDm);
+            double Dny = nz*(Dmy - ny*nDm);
+            double Dnz = -nz*nz*nDm;
+            if (mode == DIFF_REFLECT) {
+                double Dalpha = Dvx*nx + Dvy*ny + Dvz*nz;
+                Dalpha += vx*Dnx + vy*Dny + vz*Dnz;
+                p[3*stride] = Dvx - 2*(Dalpha*nx + alpha*Dnx);
+                p[4*stride] = Dvy - 2*(Dalpha*ny + alpha*Dny);
+                p[5*stride] = Dvz - 2*(Dalpha*nz + alpha*Dnz);
+            } else {
+                double snx = sgn*nx, sny = sgn*ny, snz = sgn*nz;
+                Dnx *= sgn;
+                Dny *= sgn;
+                Dnz *= sgn;
+                double Dn1 = -n1*n1*n1*(vx*Dvx + vy*Dvy + vz*Dvz);
+                double Dnvx = Dvx*n1 + vx*Dn1;
+                double Dnvy = Dvy*n1 + vy*Dn1;
+                double Dnvz = Dvz*n1 + vz*Dn1;
+                double Dalpha = Dnvx*snx + Dnvy*sny + Dnvz*snz;
+                Dalpha += n1*(vx*Dnx + vy*Dny + vz*Dnz);
+                double Deta = Dn1/n2;
+                double Dsinsqr = 2*eta*Deta*(1-alpha*alpha);
+                Dsinsqr -= 2*eta*eta*alpha*Dalpha;
+                double Dnfactor = Deta*alpha + eta*Dalpha - 0.5*Dsinsqr/root;
+                p[3*stride] = (Deta*vx*n1 + eta*Dnvx - Dnfactor*snx - nfactor*Dnx)/n2;
+                p[4*stride] = (Deta*vy*n1 + eta*Dnvy - Dnfactor*sny - nfactor*Dny)/n2;
+                p[5*stride] = (Deta*vz*n1 + eta*Dnvz - Dnfactor*snz - nfactor*Dnz)/n2;
+            }
+        }
+    }
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
 
     void applyForwardTransformArrays(
         const vec3 dr, const mat3 drot,
@@ -64,106 +185,138 @@ namespace batoid {
         }
     }
 
-    void applyForwardTransform(const vec3 dr, const mat3 drot, RayVector& rv) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vx.syncToDevice();
-        rv.vy.syncToDevice();
-        rv.vz.syncToDevice();
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        double* vxptr = rv.vx.data;
-        double* vyptr = rv.vy.data;
-        double* vzptr = rv.vz.data;
+    void applyForwardTransform(
+        const vec3 dr, const mat3 drot, const RaySegments& rays
+    ) {
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
         const double* drptr = dr.data();
         const double* drotptr = drot.data();
 
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
-                map(to:drptr[:3], drotptr[:9])
+                map(to:segptr[:nsegs], wordptr[:nsegs+1], drptr[:3], drotptr[:9])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            double dx = xptr[i]-drptr[0];
-            double dy = yptr[i]-drptr[1];
-            double dz = zptr[i]-drptr[2];
-            xptr[i] = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
-            yptr[i] = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
-            zptr[i] = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
-            double vx = vxptr[i]*drotptr[0] + vyptr[i]*drotptr[3] + vzptr[i]*drotptr[6];
-            double vy = vxptr[i]*drotptr[1] + vyptr[i]*drotptr[4] + vzptr[i]*drotptr[7];
-            double vz = vxptr[i]*drotptr[2] + vyptr[i]*drotptr[5] + vzptr[i]*drotptr[8];
-            vxptr[i] = vx;
-            vyptr[i] = vy;
-            vzptr[i] = vz;
+        for(int jw=0; jw<nword; jw++) {
+            const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+            size_t iw = jw-seg.word0;
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                size_t i = i0+ib-off;
+                if (seg.diff.data)
+                    _rotateDifferentials(
+                        drotptr, false, seg.diff.data+i, seg.diff.nd,
+                        seg.diff.stride
+                    );
+                double dx = seg.x[i]-drptr[0];
+                double dy = seg.y[i]-drptr[1];
+                double dz = seg.z[i]-drptr[2];
+                seg.x[i] = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
+                seg.y[i] = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
+                seg.z[i] = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
+                // A uniform velocity is rotated just once.
+                if ((i & seg.vmask) == i) {
+                    double vx = seg.vx[i]*drotptr[0] + seg.vy[i]*drotptr[3] + seg.vz[i]*drotptr[6];
+                    double vy = seg.vx[i]*drotptr[1] + seg.vy[i]*drotptr[4] + seg.vz[i]*drotptr[7];
+                    double vz = seg.vx[i]*drotptr[2] + seg.vy[i]*drotptr[5] + seg.vz[i]*drotptr[8];
+                    seg.vx[i] = vx;
+                    seg.vy[i] = vy;
+                    seg.vz[i] = vz;
+                }
+            }
         }
     }
 
 
-    void applyReverseTransform(const vec3 dr, const mat3 drot, RayVector& rv) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vx.syncToDevice();
-        rv.vy.syncToDevice();
-        rv.vz.syncToDevice();
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        double* vxptr = rv.vx.data;
-        double* vyptr = rv.vy.data;
-        double* vzptr = rv.vz.data;
+    void applyReverseTransform(
+        const vec3 dr, const mat3 drot, const RaySegments& rays
+    ) {
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
         const double* drptr = dr.data();
         const double* drotptr = drot.data();
 
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
-                map(to:drptr[:3], drotptr[:9])
+                map(to:segptr[:nsegs], wordptr[:nsegs+1], drptr[:3], drotptr[:9])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            double x = xptr[i]*drotptr[0] + yptr[i]*drotptr[1] + zptr[i]*drotptr[2] + drptr[0];
-            double y = xptr[i]*drotptr[3] + yptr[i]*drotptr[4] + zptr[i]*drotptr[5] + drptr[1];
-            double z = xptr[i]*drotptr[6] + yptr[i]*drotptr[7] + zptr[i]*drotptr[8] + drptr[2];
-            xptr[i] = x;
-            yptr[i] = y;
-            zptr[i] = z;
-            double vx = vxptr[i]*drotptr[0] + vyptr[i]*drotptr[1] + vzptr[i]*drotptr[2];
-            double vy = vxptr[i]*drotptr[3] + vyptr[i]*drotptr[4] + vzptr[i]*drotptr[5];
-            double vz = vxptr[i]*drotptr[6] + vyptr[i]*drotptr[7] + vzptr[i]*drotptr[8];
-            vxptr[i] = vx;
-            vyptr[i] = vy;
-            vzptr[i] = vz;
+        for(int jw=0; jw<nword; jw++) {
+            const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+            size_t iw = jw-seg.word0;
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                size_t i = i0+ib-off;
+                if (seg.diff.data)
+                    _rotateDifferentials(
+                        drotptr, true, seg.diff.data+i, seg.diff.nd,
+                        seg.diff.stride
+                    );
+                double x = seg.x[i]*drotptr[0] + seg.y[i]*drotptr[1] + seg.z[i]*drotptr[2] + drptr[0];
+                double y = seg.x[i]*drotptr[3] + seg.y[i]*drotptr[4] + seg.z[i]*drotptr[5] + drptr[1];
+                double z = seg.x[i]*drotptr[6] + seg.y[i]*drotptr[7] + seg.z[i]*drotptr[8] + drptr[2];
+                seg.x[i] = x;
+                seg.y[i] = y;
+                seg.z[i] = z;
+                // A uniform velocity is rotated just once.
+                if ((i & seg.vmask) == i) {
+                    double vx = seg.vx[i]*drotptr[0] + seg.vy[i]*drotptr[1] + seg.vz[i]*drotptr[2];
+                    double vy = seg.vx[i]*drotptr[3] + seg.vy[i]*drotptr[4] + seg.vz[i]*drotptr[5];
+                    double vz = seg.vx[i]*drotptr[6] + seg.vy[i]*drotptr[7] + seg.vz[i]*drotptr[8];
+                    seg.vx[i] = vx;
+                    seg.vy[i] = vy;
+                    seg.vz[i] = vz;
+                }
+            }
         }
     }
 
 
-    void obscure(const Obscuration& obsc, RayVector& rv) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vignetted.syncToDevice();
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        bool* vigptr = rv.vignetted.data;
+    void obscure(const Obscuration& obsc, const RaySegments& rays) {
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
 
         const Obscuration* obscPtr = obsc.getDevPtr();
 
         #if defined(BATOID_GPU)
-            #pragma omp target teams distribute parallel for is_device_ptr(obscPtr)
+            #pragma omp target teams distribute parallel for \
+                is_device_ptr(obscPtr) map(to:segptr[:nsegs], wordptr[:nsegs+1])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            vigptr[i] |= obscPtr->contains(xptr[i], yptr[i]);
+        for(int jw=0; jw<nword; jw++) {
+            const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+            size_t iw = jw-seg.word0;
+            // Rays already vignetted stay vignetted; don't test them again.
+            uint64_t vig = seg.vignetted[iw];
+            if (vig == ~uint64_t(0))
+                continue;
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                uint64_t bit = uint64_t(1) << ib;
+                size_t i = i0+ib-off;
+                if (!(vig & bit) && obscPtr->contains(seg.x[i], seg.y[i]))
+                    vig |= bit;
+            }
+            seg.vignetted[iw] = vig;
         }
     }
 
@@ -171,34 +324,13 @@ namespace batoid {
     void intersect(
         const Surface& surface,
         const vec3 dr, const mat3 drot,
-        RayVector& rv,
+        const RaySegments& rays,
         const Coating* coating
     ) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vx.syncToDevice();
-        rv.vy.syncToDevice();
-        rv.vz.syncToDevice();
-        rv.t.syncToDevice();
-        rv.vignetted.syncToDevice();
-        rv.failed.syncToDevice();
-        if (coating) {
-            rv.wavelength.syncToDevice();
-            rv.flux.syncToDevice();
-        }
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        double* vxptr = rv.vx.data;
-        double* vyptr = rv.vy.data;
-        double* vzptr = rv.vz.data;
-        double* tptr = rv.t.data;
-        double* wptr = rv.wavelength.data;
-        double* fluxptr = rv.flux.data;
-        bool* vigptr = rv.vignetted.data;
-        bool* failptr = rv.failed.data;
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
 
         const Surface* surfacePtr = surface.getDevPtr();
         const double* drptr = dr.data();
@@ -210,24 +342,38 @@ namespace batoid {
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
                 is_device_ptr(surfacePtr, coatingPtr) \
-                map(to:drptr[:3], drotptr[:9])
+                map(to:segptr[:nsegs], wordptr[:nsegs+1], drptr[:3], drotptr[:9])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            // Coordinate transformation
-            double dx = xptr[i]-drptr[0];
-            double dy = yptr[i]-drptr[1];
-            double dz = zptr[i]-drptr[2];
-            double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
-            double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
-            double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
-            double vx = vxptr[i]*drotptr[0] + vyptr[i]*drotptr[3] + vzptr[i]*drotptr[6];
-            double vy = vxptr[i]*drotptr[1] + vyptr[i]*drotptr[4] + vzptr[i]*drotptr[7];
-            double vz = vxptr[i]*drotptr[2] + vyptr[i]*drotptr[5] + vzptr[i]*drotptr[8];
-            double t = tptr[i];
-            // intersection
-            if (!failptr[i]) {
+        for(int jw=0; jw<nword; jw++) {
+            const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+            size_t iw = jw-seg.word0;
+            uint64_t fail = seg.failed[iw];
+            if (fail == ~uint64_t(0))
+                continue;  // Whole word already failed
+            uint64_t vig = seg.vignetted[iw];
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                uint64_t bit = uint64_t(1) << ib;
+                if (fail & bit)
+                    continue;
+                size_t i = i0+ib-off;
+                // Coordinate transformation
+                double dx = seg.x[i]-drptr[0];
+                double dy = seg.y[i]-drptr[1];
+                double dz = seg.z[i]-drptr[2];
+                double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
+                double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
+                double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
+                double vx = seg.vx[i&seg.vmask]*drotptr[0] + seg.vy[i&seg.vmask]*drotptr[3] + seg.vz[i&seg.vmask]*drotptr[6];
+                double vy = seg.vx[i&seg.vmask]*drotptr[1] + seg.vy[i&seg.vmask]*drotptr[4] + seg.vz[i&seg.vmask]*drotptr[7];
+                double vz = seg.vx[i&seg.vmask]*drotptr[2] + seg.vy[i&seg.vmask]*drotptr[5] + seg.vz[i&seg.vmask]*drotptr[8];
+                double t = seg.t[i];
+                // intersection
                 double dt = 0.0;
                 bool success = surfacePtr->timeToIntersect(x, y, z, vx, vy, vz, dt);
                 if (success) {
@@ -235,13 +381,25 @@ namespace batoid {
                     y += vy * dt;
                     z += vz * dt;
                     t += dt;
-                    xptr[i] = x;
-                    yptr[i] = y;
-                    zptr[i] = z;
-                    vxptr[i] = vx;
-                    vyptr[i] = vy;
-                    vzptr[i] = vz;
-                    tptr[i] = t;
+                    if (seg.diff.data) {
+                        _rotateDifferentials(
+                            drotptr, false, seg.diff.data+i, seg.diff.nd,
+                            seg.diff.stride
+                        );
+                        _surfaceDifferentials(
+                            surfacePtr, DIFF_INTERSECT, x, y, vx, vy, vz, dt,
+                            0.0, seg.diff.data+i, seg.diff.nd, seg.diff.stride
+                        );
+                    }
+                    seg.x[i] = x;
+                    seg.y[i] = y;
+                    seg.z[i] = z;
+                    if (seg.vmask) {
+                        seg.vx[i] = vx;
+                        seg.vy[i] = vy;
+                        seg.vz[i] = vz;
+                    }
+                    seg.t[i] = t;
                     if (coatingPtr) {
                         double nx, ny, nz;
                         surfacePtr->normal(x, y, nx, ny, nz);
@@ -253,13 +411,15 @@ namespace batoid {
                         alpha += vy*ny;
                         alpha += vz*nz;
                         alpha *= n1;
-                        fluxptr[i] *= coatingPtr->getTransmit(wptr[i], alpha);
+                        seg.flux[i] *= coatingPtr->getTransmit(seg.wavelength[i&seg.wmask], alpha);
                     }
                 } else {
-                    failptr[i] = true;
-                    vigptr[i] = true;
+                    fail |= bit;
+                    vig |= bit;
                 }
             }
+            seg.failed[iw] = fail;
+            seg.vignetted[iw] = vig;
         }
     }
 
@@ -267,34 +427,13 @@ namespace batoid {
     void reflect(
         const Surface& surface,
         const vec3 dr, const mat3 drot,
-        RayVector& rv,
+        const RaySegments& rays,
         const Coating* coating
     ) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vx.syncToDevice();
-        rv.vy.syncToDevice();
-        rv.vz.syncToDevice();
-        rv.t.syncToDevice();
-        rv.vignetted.syncToDevice();
-        rv.failed.syncToDevice();
-        if (coating) {
-            rv.wavelength.syncToDevice();
-            rv.flux.syncToDevice();
-        }
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        double* vxptr = rv.vx.data;
-        double* vyptr = rv.vy.data;
-        double* vzptr = rv.vz.data;
-        double* tptr = rv.t.data;
-        double* wptr = rv.wavelength.data;
-        double* fluxptr = rv.flux.data;
-        bool* vigptr = rv.vignetted.data;
-        bool* failptr = rv.failed.data;
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
 
         const Surface* surfacePtr = surface.getDevPtr();
         const double* drptr = dr.data();
@@ -306,23 +445,37 @@ namespace batoid {
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
                 is_device_ptr(surfacePtr, coatingPtr) \
-                map(to:drptr[:3], drotptr[:9])
+                map(to:segptr[:nsegs], wordptr[:nsegs+1], drptr[:3], drotptr[:9])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            // Coordinate transformation
-            double dx = xptr[i]-drptr[0];
-            double dy = yptr[i]-drptr[1];
-            double dz = zptr[i]-drptr[2];
-            double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
-            double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
-            double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
-            double vx = vxptr[i]*drotptr[0] + vyptr[i]*drotptr[3] + vzptr[i]*drotptr[6];
-            double vy = vxptr[i]*drotptr[1] + vyptr[i]*drotptr[4] + vzptr[i]*drotptr[7];
-            double vz = vxptr[i]*drotptr[2] + vyptr[i]*drotptr[5] + vzptr[i]*drotptr[8];
-            double t = tptr[i];
-            if (!failptr[i]) {
+        for(int jw=0; jw<nword; jw++) {
+            const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+            size_t iw = jw-seg.word0;
+            uint64_t fail = seg.failed[iw];
+            if (fail == ~uint64_t(0))
+                continue;  // Whole word already failed
+            uint64_t vig = seg.vignetted[iw];
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                uint64_t bit = uint64_t(1) << ib;
+                if (fail & bit)
+                    continue;
+                size_t i = i0+ib-off;
+                // Coordinate transformation
+                double dx = seg.x[i]-drptr[0];
+                double dy = seg.y[i]-drptr[1];
+                double dz = seg.z[i]-drptr[2];
+                double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
+                double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
+                double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
+                double vx = seg.vx[i]*drotptr[0] + seg.vy[i]*drotptr[3] + seg.vz[i]*drotptr[6];
+                double vy = seg.vx[i]*drotptr[1] + seg.vy[i]*drotptr[4] + seg.vz[i]*drotptr[7];
+                double vz = seg.vx[i]*drotptr[2] + seg.vy[i]*drotptr[5] + seg.vz[i]*drotptr[8];
+                double t = seg.t[i];
                 // intersection
                 double dt = 0.0;
                 bool success = surfacePtr->timeToIntersect(x, y, z, vx, vy, vz, dt);
@@ -332,6 +485,16 @@ namespace batoid {
                     y += vy * dt;
                     z += vz * dt;
                     t += dt;
+                    if (seg.diff.data) {
+                        _rotateDifferentials(
+                            drotptr, false, seg.diff.data+i, seg.diff.nd,
+                            seg.diff.stride
+                        );
+                        _surfaceDifferentials(
+                            surfacePtr, DIFF_REFLECT, x, y, vx, vy, vz, dt,
+                            0.0, seg.diff.data+i, seg.diff.nd, seg.diff.stride
+                        );
+                    }
                     // reflection
                     double nx, ny, nz;
                     surfacePtr->normal(x, y, nx, ny, nz);
@@ -344,13 +507,13 @@ namespace batoid {
                     vy -= 2*alpha*ny;
                     vz -= 2*alpha*nz;
                     // output
-                    xptr[i] = x;
-                    yptr[i] = y;
-                    zptr[i] = z;
-                    vxptr[i] = vx;
-                    vyptr[i] = vy;
-                    vzptr[i] = vz;
-                    tptr[i] = t;
+                    seg.x[i] = x;
+                    seg.y[i] = y;
+                    seg.z[i] = z;
+                    seg.vx[i] = vx;
+                    seg.vy[i] = vy;
+                    seg.vz[i] = vz;
+                    seg.t[i] = t;
                     if (coatingPtr) {
                         double nx, ny, nz;
                         surfacePtr->normal(x, y, nx, ny, nz);
@@ -359,13 +522,15 @@ namespace batoid {
                         n1 += vz*vz;
                         n1 = 1/sqrt(n1);
                         alpha *= n1;
-                        fluxptr[i] *= coatingPtr->getReflect(wptr[i], alpha);
+                        seg.flux[i] *= coatingPtr->getReflect(seg.wavelength[i&seg.wmask], alpha);
                     }
                 } else {
-                    failptr[i] = true;
-                    vigptr[i] = true;
+                    fail |= bit;
+                    vig |= bit;
                 }
             }
+            seg.failed[iw] = fail;
+            seg.vignetted[iw] = vig;
         }
     }
 
@@ -374,34 +539,13 @@ namespace batoid {
         const Surface& surface,
         const vec3 dr, const mat3 drot,
         const Medium& m1, const Medium& m2,
-        RayVector& rv,
+        const RaySegments& rays,
         const Coating* coating
     ) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vx.syncToDevice();
-        rv.vy.syncToDevice();
-        rv.vz.syncToDevice();
-        rv.t.syncToDevice();
-        rv.vignetted.syncToDevice();
-        rv.failed.syncToDevice();
-        rv.wavelength.syncToDevice();
-        if (coating) {
-            rv.flux.syncToDevice();
-        }
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        double* vxptr = rv.vx.data;
-        double* vyptr = rv.vy.data;
-        double* vzptr = rv.vz.data;
-        double* tptr = rv.t.data;
-        double* wptr = rv.wavelength.data;
-        double* fluxptr = rv.flux.data;
-        bool* vigptr = rv.vignetted.data;
-        bool* failptr = rv.failed.data;
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
 
         const Surface* surfacePtr = surface.getDevPtr();
         const double* drptr = dr.data();
@@ -414,23 +558,37 @@ namespace batoid {
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
                 is_device_ptr(surfacePtr, mPtr, coatingPtr) \
-                map(to:drptr[:3], drotptr[:9])
+                map(to:segptr[:nsegs], wordptr[:nsegs+1], drptr[:3], drotptr[:9])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            // Coordinate transformation
-            double dx = xptr[i]-drptr[0];
-            double dy = yptr[i]-drptr[1];
-            double dz = zptr[i]-drptr[2];
-            double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
-            double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
-            double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
-            double vx = vxptr[i]*drotptr[0] + vyptr[i]*drotptr[3] + vzptr[i]*drotptr[6];
-            double vy = vxptr[i]*drotptr[1] + vyptr[i]*drotptr[4] + vzptr[i]*drotptr[7];
-            double vz = vxptr[i]*drotptr[2] + vyptr[i]*drotptr[5] + vzptr[i]*drotptr[8];
-            double t = tptr[i];
-            if (!failptr[i]) {
+        for(int jw=0; jw<nword; jw++) {
+            const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+            size_t iw = jw-seg.word0;
+            uint64_t fail = seg.failed[iw];
+            if (fail == ~uint64_t(0))
+                continue;  // Whole word already failed
+            uint64_t vig = seg.vignetted[iw];
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                uint64_t bit = uint64_t(1) << ib;
+                if (fail & bit)
+                    continue;
+                size_t i = i0+ib-off;
+                // Coordinate transformation
+                double dx = seg.x[i]-drptr[0];
+                double dy = seg.y[i]-drptr[1];
+                double dz = seg.z[i]-drptr[2];
+                double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
+                double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
+                double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
+                double vx = seg.vx[i]*drotptr[0] + seg.vy[i]*drotptr[3] + seg.vz[i]*drotptr[6];
+                double vy = seg.vx[i]*drotptr[1] + seg.vy[i]*drotptr[4] + seg.vz[i]*drotptr[7];
+                double vz = seg.vx[i]*drotptr[2] + seg.vy[i]*drotptr[5] + seg.vz[i]*drotptr[8];
+                double t = seg.t[i];
                 // intersection
                 double dt = 0.0;
                 bool success = surfacePtr->timeToIntersect(x, y, z, vx, vy, vz, dt);
@@ -461,29 +619,41 @@ namespace batoid {
                         nz *= -1;
                         alpha *= -1;
                     }
-                    double n2 = mPtr->getN(wptr[i]);
+                    double n2 = mPtr->getN(seg.wavelength[i&seg.wmask]);
                     double eta = n1/n2;
                     double sinsqr = eta*eta*(1-alpha*alpha);
                     double nfactor = eta*alpha + sqrt(1-sinsqr);
                     // output
-                    vxptr[i] = eta*nvx - nfactor*nx;
-                    vyptr[i] = eta*nvy - nfactor*ny;
-                    vzptr[i] = eta*nvz - nfactor*nz;
-                    vxptr[i] /= n2;
-                    vyptr[i] /= n2;
-                    vzptr[i] /= n2;
-                    xptr[i] = x;
-                    yptr[i] = y;
-                    zptr[i] = z;
-                    tptr[i] = t;
+                    seg.vx[i] = eta*nvx - nfactor*nx;
+                    seg.vy[i] = eta*nvy - nfactor*ny;
+                    seg.vz[i] = eta*nvz - nfactor*nz;
+                    seg.vx[i] /= n2;
+                    seg.vy[i] /= n2;
+                    seg.vz[i] /= n2;
+                    seg.x[i] = x;
+                    seg.y[i] = y;
+                    seg.z[i] = z;
+                    seg.t[i] = t;
+                    if (seg.diff.data) {
+                        _rotateDifferentials(
+                            drotptr, false, seg.diff.data+i, seg.diff.nd,
+                            seg.diff.stride
+                        );
+                        _surfaceDifferentials(
+                            surfacePtr, DIFF_REFRACT, x, y, vx, vy, vz, dt,
+                            n2, seg.diff.data+i, seg.diff.nd, seg.diff.stride
+                        );
+                    }
                     if (coatingPtr) {
-                        fluxptr[i] *= coatingPtr->getTransmit(wptr[i], alpha);
+                        seg.flux[i] *= coatingPtr->getTransmit(seg.wavelength[i&seg.wmask], alpha);
                     }
                 } else {
-                    failptr[i] = true;
-                    vigptr[i] = true;
+                    fail |= bit;
+                    vig |= bit;
                 }
             }
+            seg.failed[iw] = fail;
+            seg.vignetted[iw] = vig;
         }
     }
 
@@ -493,57 +663,15 @@ namespace batoid {
         const vec3 dr, const mat3 drot,
         const Medium& m1, const Medium& m2,
         const Coating& coating,
-        RayVector& rv, RayVector& rvSplit
+        const RaySegments& rays, const RaySegments& raysSplit
     ) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vx.syncToDevice();
-        rv.vy.syncToDevice();
-        rv.vz.syncToDevice();
-        rv.t.syncToDevice();
-        rv.wavelength.syncToDevice();
-        rv.flux.syncToDevice();
-        rv.vignetted.syncToDevice();
-        rv.failed.syncToDevice();
-        rvSplit.x.syncState = SyncState::device;
-        rvSplit.y.syncState = SyncState::device;
-        rvSplit.z.syncState = SyncState::device;
-        rvSplit.vx.syncState = SyncState::device;
-        rvSplit.vy.syncState = SyncState::device;
-        rvSplit.vz.syncState = SyncState::device;
-        rvSplit.t.syncState = SyncState::device;
-        rvSplit.wavelength.syncState = SyncState::device;
-        rvSplit.flux.syncState = SyncState::device;
-        rvSplit.vignetted.syncState = SyncState::device;
-        rvSplit.failed.syncState = SyncState::device;
-
-        // Original RayVector will get replaced with refraction
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        double* vxptr = rv.vx.data;
-        double* vyptr = rv.vy.data;
-        double* vzptr = rv.vz.data;
-        double* tptr = rv.t.data;
-        double* wptr = rv.wavelength.data;
-        double* fluxptr = rv.flux.data;
-        bool* vigptr = rv.vignetted.data;
-        bool* failptr = rv.failed.data;
-
-        // rvSplit will contain reflection
-        double* xptr2 = rvSplit.x.data;
-        double* yptr2 = rvSplit.y.data;
-        double* zptr2 = rvSplit.z.data;
-        double* vxptr2 = rvSplit.vx.data;
-        double* vyptr2 = rvSplit.vy.data;
-        double* vzptr2 = rvSplit.vz.data;
-        double* tptr2 = rvSplit.t.data;
-        double* wptr2 = rvSplit.wavelength.data;
-        double* fluxptr2 = rvSplit.flux.data;
-        bool* vigptr2 = rvSplit.vignetted.data;
-        bool* failptr2 = rvSplit.failed.data;
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
+        // rays get the refracted rays and raysSplit, laid out alike, the
+        // reflected ones.
+        const RaySegment* splitptr = raysSplit.segs.data();
 
         const Surface* surfacePtr = surface.getDevPtr();
         const double* drptr = dr.data();
@@ -554,23 +682,43 @@ namespace batoid {
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
                 is_device_ptr(surfacePtr, mPtr, cPtr) \
+                map(to:segptr[:nsegs], splitptr[:nsegs], wordptr[:nsegs+1]) \
                 map(to:drptr[:3], drotptr[:9])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            // Coordinate transformation
-            double dx = xptr[i]-drptr[0];
-            double dy = yptr[i]-drptr[1];
-            double dz = zptr[i]-drptr[2];
-            double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
-            double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
-            double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
-            double vx = vxptr[i]*drotptr[0] + vyptr[i]*drotptr[3] + vzptr[i]*drotptr[6];
-            double vy = vxptr[i]*drotptr[1] + vyptr[i]*drotptr[4] + vzptr[i]*drotptr[7];
-            double vz = vxptr[i]*drotptr[2] + vyptr[i]*drotptr[5] + vzptr[i]*drotptr[8];
-            double t = tptr[i];
-            if (!failptr[i]) {
+        for(int jw=0; jw<nword; jw++) {
+            size_t k = _segmentOf(wordptr, nsegs, jw);
+            const RaySegment& seg = segptr[k];
+            const RaySegment& split = splitptr[k];
+            size_t iw = jw-seg.word0;
+            uint64_t fail = seg.failed[iw];
+            uint64_t vig = seg.vignetted[iw];
+            if (fail == ~uint64_t(0)) {  // Whole word already failed
+                split.vignetted[iw] = vig;
+                split.failed[iw] = fail;
+                continue;
+            }
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                uint64_t bit = uint64_t(1) << ib;
+                if (fail & bit)
+                    continue;
+                size_t i = i0+ib-off;
+                // Coordinate transformation
+                double dx = seg.x[i]-drptr[0];
+                double dy = seg.y[i]-drptr[1];
+                double dz = seg.z[i]-drptr[2];
+                double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
+                double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
+                double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
+                double vx = seg.vx[i]*drotptr[0] + seg.vy[i]*drotptr[3] + seg.vz[i]*drotptr[6];
+                double vy = seg.vx[i]*drotptr[1] + seg.vy[i]*drotptr[4] + seg.vz[i]*drotptr[7];
+                double vz = seg.vx[i]*drotptr[2] + seg.vy[i]*drotptr[5] + seg.vz[i]*drotptr[8];
+                double t = seg.t[i];
                 // intersection
                 double dt = 0.0;
                 bool success = surfacePtr->timeToIntersect(x, y, z, vx, vy, vz, dt);
@@ -604,44 +752,48 @@ namespace batoid {
 
                     // Flux coefficients
                     double reflect, transmit;
-                    cPtr->getCoefs(wptr[i], alpha, reflect, transmit);
+                    cPtr->getCoefs(seg.wavelength[i&seg.wmask], alpha, reflect, transmit);
 
                     // Reflection
-                    xptr2[i] = x;
-                    yptr2[i] = y;
-                    zptr2[i] = z;
-                    vxptr2[i] = vx - 2*alpha*nx/n1;
-                    vyptr2[i] = vy - 2*alpha*ny/n1;
-                    vzptr2[i] = vz - 2*alpha*nz/n1;
-                    tptr2[i] = t;
-                    wptr2[i] = wptr[i];
-                    fluxptr2[i] = fluxptr[i]*reflect;
-                    vigptr2[i] = vigptr[i];
-                    failptr2[i] = failptr[i];
+                    split.x[i] = x;
+                    split.y[i] = y;
+                    split.z[i] = z;
+                    split.vx[i] = vx - 2*alpha*nx/n1;
+                    split.vy[i] = vy - 2*alpha*ny/n1;
+                    split.vz[i] = vz - 2*alpha*nz/n1;
+                    split.t[i] = t;
+                    // rvSplit starts as a copy of rv, so a uniform
+                    // wavelength is already in place.
+                    if (seg.wmask)
+                        split.wavelength[i] = seg.wavelength[i];
+                    split.flux[i] = seg.flux[i]*reflect;
 
                     // refraction
-                    double n2 = mPtr->getN(wptr[i]);
+                    double n2 = mPtr->getN(seg.wavelength[i&seg.wmask]);
                     double eta = n1/n2;
                     double sinsqr = eta*eta*(1-alpha*alpha);
                     double nfactor = eta*alpha + sqrt(1-sinsqr);
-                    xptr[i] = x;
-                    yptr[i] = y;
-                    zptr[i] = z;
-                    vxptr[i] = eta*nvx - nfactor*nx;
-                    vyptr[i] = eta*nvy - nfactor*ny;
-                    vzptr[i] = eta*nvz - nfactor*nz;
-                    vxptr[i] /= n2;
-                    vyptr[i] /= n2;
-                    vzptr[i] /= n2;
-                    tptr[i] = t;
-                    fluxptr[i] *= transmit;
+                    seg.x[i] = x;
+                    seg.y[i] = y;
+                    seg.z[i] = z;
+                    seg.vx[i] = eta*nvx - nfactor*nx;
+                    seg.vy[i] = eta*nvy - nfactor*ny;
+                    seg.vz[i] = eta*nvz - nfactor*nz;
+                    seg.vx[i] /= n2;
+                    seg.vy[i] /= n2;
+                    seg.vz[i] /= n2;
+                    seg.t[i] = t;
+                    seg.flux[i] *= transmit;
                 } else {
-                    vigptr[i] = true;
-                    failptr[i] = true;
-                    vigptr2[i] = true;
-                    failptr2[i] = true;
+                    fail |= bit;
+                    vig |= bit;
                 }
             }
+            seg.failed[iw] = fail;
+            seg.vignetted[iw] = vig;
+            // Reflected rays share the flags of the refracted ones.
+            split.failed[iw] = fail;
+            split.vignetted[iw] = vig;
         }
     }
 
@@ -650,30 +802,12 @@ namespace batoid {
         const Surface& surface,
         const vec3 dr, const mat3 drot,
         const Surface& screen,
-        RayVector& rv
+        const RaySegments& rays
     ) {
-        rv.x.syncToDevice();
-        rv.y.syncToDevice();
-        rv.z.syncToDevice();
-        rv.vx.syncToDevice();
-        rv.vy.syncToDevice();
-        rv.vz.syncToDevice();
-        rv.t.syncToDevice();
-        rv.vignetted.syncToDevice();
-        rv.failed.syncToDevice();
-        rv.wavelength.syncToDevice();
-        size_t size = rv.size;
-        double* xptr = rv.x.data;
-        double* yptr = rv.y.data;
-        double* zptr = rv.z.data;
-        double* vxptr = rv.vx.data;
-        double* vyptr = rv.vy.data;
-        double* vzptr = rv.vz.data;
-        double* tptr = rv.t.data;
-        double* wptr = rv.wavelength.data;
-        double* fluxptr = rv.flux.data;
-        bool* vigptr = rv.vignetted.data;
-        bool* failptr = rv.failed.data;
+        const RaySegment* segptr = rays.segs.data();
+        const size_t* wordptr = rays.wordStart.data();
+        size_t nsegs = rays.segs.size();
+        size_t nword = rays.wordStart.back();
 
         const Surface* surfacePtr = surface.getDevPtr();
         const Surface* screenPtr = screen.getDevPtr();
@@ -683,23 +817,37 @@ namespace batoid {
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
                 is_device_ptr(surfacePtr, screenPtr) \
-                map(to:drptr[:3], drotptr[:9])
+                map(to:segptr[:nsegs], wordptr[:nsegs+1], drptr[:3], drotptr[:9])
         #else
             #pragma omp parallel for
         #endif
-        for(int i=0; i<size; i++) {
-            // Coordinate transformation
-            double dx = xptr[i]-drptr[0];
-            double dy = yptr[i]-drptr[1];
-            double dz = zptr[i]-drptr[2];
-            double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
-            double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
-            double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
-            double vx = vxptr[i]*drotptr[0] + vyptr[i]*drotptr[3] + vzptr[i]*drotptr[6];
-            double vy = vxptr[i]*drotptr[1] + vyptr[i]*drotptr[4] + vzptr[i]*drotptr[7];
-            double vz = vxptr[i]*drotptr[2] + vyptr[i]*drotptr[5] + vzptr[i]*drotptr[8];
-            double t = tptr[i];
-            if (!failptr[i]) {
+        for(int jw=0; jw<nword; jw++) {
+            const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+            size_t iw = jw-seg.word0;
+            uint64_t fail = seg.failed[iw];
+            if (fail == ~uint64_t(0))
+                continue;  // Whole word already failed
+            uint64_t vig = seg.vignetted[iw];
+            size_t off = seg.flagOffset;
+            size_t i0 = 64*iw;
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                uint64_t bit = uint64_t(1) << ib;
+                if (fail & bit)
+                    continue;
+                size_t i = i0+ib-off;
+                // Coordinate transformation
+                double dx = seg.x[i]-drptr[0];
+                double dy = seg.y[i]-drptr[1];
+                double dz = seg.z[i]-drptr[2];
+                double x = dx*drotptr[0] + dy*drotptr[3] + dz*drotptr[6];
+                double y = dx*drotptr[1] + dy*drotptr[4] + dz*drotptr[7];
+                double z = dx*drotptr[2] + dy*drotptr[5] + dz*drotptr[8];
+                double vx = seg.vx[i]*drotptr[0] + seg.vy[i]*drotptr[3] + seg.vz[i]*drotptr[6];
+                double vy = seg.vx[i]*drotptr[1] + seg.vy[i]*drotptr[4] + seg.vz[i]*drotptr[7];
+                double vz = seg.vx[i]*drotptr[2] + seg.vy[i]*drotptr[5] + seg.vz[i]*drotptr[8];
+                double t = seg.t[i];
                 // intersection
                 double dt = 0.0;
                 bool success = surfacePtr->timeToIntersect(x, y, z, vx, vy, vz, dt);
@@ -799,18 +947,217 @@ namespace batoid {
                     t += screenPtr->sag(x, y);
 
                     // output
-                    vxptr[i] = vx;
-                    vyptr[i] = vy;
-                    vzptr[i] = vz;
-                    xptr[i] = x;
-                    yptr[i] = y;
-                    zptr[i] = z;
-                    tptr[i] = t;
+                    seg.vx[i] = vx;
+                    seg.vy[i] = vy;
+                    seg.vz[i] = vz;
+                    seg.x[i] = x;
+                    seg.y[i] = y;
+                    seg.z[i] = z;
+                    seg.t[i] = t;
                 } else {
-                    failptr[i] = true;
-                    vigptr[i] = true;
+                    fail |= bit;
+                    vig |= bit;
                 }
             }
+            seg.failed[iw] = fail;
+            seg.vignetted[iw] = vig;
+        }
+    }
+
+
+    void wavefront(
+        const RayVector& rv, const size_t* bounds, size_t nseg,
+        double sphereRadius, long chief, double wavelength,
+        double* out, bool* mask
+    ) {
+        rv.x.syncToDevice();
+        rv.y.syncToDevice();
+        rv.z.syncToDevice();
+        rv.vx.syncToDevice();
+        rv.vy.syncToDevice();
+        rv.vz.syncToDevice();
+        rv.t.syncToDevice();
+        rv.vignetted.syncToDevice();
+        rv.failed.syncToDevice();
+        size_t size = rv.size;
+        const double* xptr = rv.x.data;
+        const double* yptr = rv.y.data;
+        const double* zptr = rv.z.data;
+        const double* vxptr = rv.vx.data;
+        const double* vyptr = rv.vy.data;
+        const double* vzptr = rv.vz.data;
+        const double* tptr = rv.t.data;
+        size_t nword = rv.failed.size;
+        size_t off = rv.flagOffset;
+        const uint64_t* vigptr = rv.vignetted.data;
+        const uint64_t* failptr = rv.failed.data;
+        size_t vmask = rv.indexMask(rv.vx);
+        size_t tmask = rv.indexMask(rv.t);
+        size_t first = bounds[0];
+        size_t last = bounds[nseg];
+
+        // Reference point of each range: the chief ray, or the mean
+        // unvignetted ray.
+        size_t nsum = 4*nseg;
+        double* ssum = new double[nsum]();
+        #if defined(BATOID_GPU)
+            #pragma omp target teams distribute parallel for \
+                map(to:bounds[:nseg+1]) reduction(+:ssum[:nsum])
+        #else
+            #pragma omp parallel for reduction(+:ssum[:nsum])
+        #endif
+        for(int iw=0; iw<nword; iw++) {
+            uint64_t vig = vigptr[iw];
+            size_t i0 = 64*size_t(iw);
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+size-i0 < 64) ? int(off+size-i0) : 64;
+            size_t k = _segmentOf(bounds, nseg, i0+ib0-off);
+            for(int ib=ib0; ib<ib1; ib++) {
+                size_t i = i0+ib-off;
+                if (i < first || i >= last)
+                    continue;
+                while (i >= bounds[k+1])
+                    k++;
+                bool use = (chief >= 0) ? (i-bounds[k] == size_t(chief)) : !((vig >> ib) & 1);
+                if (use) {
+                    ssum[4*k] += xptr[i];
+                    ssum[4*k+1] += yptr[i];
+                    ssum[4*k+2] += zptr[i];
+                    ssum[4*k+3] += 1.0;
+                }
+            }
+        }
+        // Shift so the sphere's vertex, a radius toward +z, is the origin.
+        double* ref = new double[3*nseg];
+        for(size_t k=0; k<nseg; k++) {
+            ref[3*k] = ssum[4*k]/ssum[4*k+3];
+            ref[3*k+1] = ssum[4*k+1]/ssum[4*k+3];
+            ref[3*k+2] = ssum[4*k+2]/ssum[4*k+3] + sphereRadius;
+        }
+
+        // Time at the sphere for each ray, and the reference time of each
+        // range.
+        Sphere sphere(-sphereRadius);
+        const Surface* spherePtr = sphere.getDevPtr();
+        size_t ntsum = 2*nseg;
+        double* tsum = new double[ntsum]();
+        #if defined(BATOID_GPU)
+            #pragma omp target teams distribute parallel for \
+                is_device_ptr(spherePtr) \
+                map(to:bounds[:nseg+1], ref[:3*nseg]) \
+                map(from:out[first:last-first], mask[first:last-first]) \
+                reduction(+:tsum[:ntsum])
+        #else
+            #pragma omp parallel for reduction(+:tsum[:ntsum])
+        #endif
+        for(int iw=0; iw<nword; iw++) {
+            uint64_t fail = failptr[iw];
+            uint64_t vig = vigptr[iw];
+            size_t i0 = 64*size_t(iw);
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+size-i0 < 64) ? int(off+size-i0) : 64;
+            size_t k = _segmentOf(bounds, nseg, i0+ib0-off);
+            for(int ib=ib0; ib<ib1; ib++) {
+                size_t i = i0+ib-off;
+                if (i < first || i >= last)
+                    continue;
+                while (i >= bounds[k+1])
+                    k++;
+                double t = tptr[i&tmask];
+                bool masked = (vig >> ib) & 1;
+                if (!((fail >> ib) & 1)) {
+                    double dt = 0.0;
+                    bool success = spherePtr->timeToIntersect(
+                        xptr[i]-ref[3*k], yptr[i]-ref[3*k+1], zptr[i]-ref[3*k+2],
+                        vxptr[i&vmask], vyptr[i&vmask], vzptr[i&vmask],
+                        dt
+                    );
+                    if (success)
+                        t += dt;
+                    else
+                        masked = true;
+                }
+                out[i] = t;
+                mask[i] = masked;
+                bool use = (chief >= 0) ? (i-bounds[k] == size_t(chief)) : !masked;
+                if (use) {
+                    tsum[2*k] += t;
+                    tsum[2*k+1] += 1.0;
+                }
+            }
+        }
+
+        #pragma omp parallel for
+        for(int i=first; i<last; i++) {
+            size_t k = _segmentOf(bounds, nseg, i);
+            out[i] = (tsum[2*k]/tsum[2*k+1]-out[i])/wavelength;
+        }
+        delete[] ssum;
+        delete[] ref;
+        delete[] tsum;
+    }
+
+
+    void tabulateSurface(
+        const Surface& surface,
+        double x0, double y0, double dx, double dy, size_t nx, size_t ny,
+        double* z, double* dzdx, double* dzdy, double* d2zdxdy
+    ) {
+        // Output arrays are row-major [ny, nx], matching Table.
+        size_t size = nx*ny;
+        const Surface* surfacePtr = surface.getDevPtr();
+
+        #if defined(BATOID_GPU)
+            #pragma omp target teams distribute parallel for \
+                is_device_ptr(surfacePtr) \
+                map(from:z[:size], dzdx[:size], dzdy[:size])
+        #else
+            #pragma omp parallel for
+        #endif
+        for(int i=0; i<size; i++) {
+            double x = x0 + (i%nx)*dx;
+            double y = y0 + (i/nx)*dy;
+            z[i] = surfacePtr->sag(x, y);
+            surfacePtr->grad(x, y, dzdx[i], dzdy[i]);
+        }
+
+        // Mixed derivative from central differences of the analytic dz/dy along
+        // x (one-sided at the edges).  Cheap compared to the pass above.
+        #pragma omp parallel for
+        for(int i=0; i<size; i++) {
+            size_t ix = i%nx;
+            size_t lo = (ix == 0) ? i : i-1;
+            size_t hi = (ix == nx-1) ? i : i+1;
+            d2zdxdy[i] = (dzdy[hi]-dzdy[lo])/((hi-lo)*dx);
+        }
+    }
+
+    double maxTableError(
+        const Surface& surface, const Surface& approx,
+        double x0, double y0, double dx, double dy, size_t nx, size_t ny
+    ) {
+        // Compare sags at the cell centers, where interpolation error peaks.
+        // Cells where either surface is nan are skipped.
+        size_t ncx = nx-1;
+        size_t size = ncx*(ny-1);
+        const Surface* surfacePtr = surface.getDevPtr();
+        const Surface* approxPtr = approx.getDevPtr();
+        double maxerr = 0.0;
+
+        #if defined(BATOID_GPU)
+            #pragma omp target teams distribute parallel for \
+                is_device_ptr(surfacePtr, approxPtr) \
+                reduction(max:maxerr) map(tofrom:maxerr)
+        #else
+            #pragma omp parallel for reduction(max:maxerr)
+        #endif
+        for(int i=0; i<size; i++) {
+            double x = x0 + (i%ncx + 0.5)*dx;
+            double y = y0 + (i/ncx + 0.5)*dy;
+            double err = std::abs(surfacePtr->sag(x, y) - approxPtr->sag(x, y));
+            if (err > maxerr)
+                maxerr = err;
         }
+        return maxerr;
     }
 }
@@ -1,5 +1,7 @@
 #include "coating.h"
 #include <new>
+#include <cmath>
+#include <complex>
 
 namespace batoid {
 
@@ -73,4 +75,154 @@ namespace batoid {
     }
 
 
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+    TableCoating::TableCoating(
+        double w0, double dw, size_t nw,
+        double c0, double dc, size_t nc,
+        const double* coefs
+    ) :
+        _w0(w0), _dw(dw), _nw(nw),
+        _c0(c0), _dc(dc), _nc(nc),
+        _coefs(coefs)
+    {}
+
+    TableCoating::~TableCoating() {
+        #if defined(BATOID_GPU)
+            if (_devPtr) {
+                const size_t size = 2*_nw*_nc;
+                const double* coefs = _coefs;
+                #pragma omp target exit data map(release:coefs[:size])
+            }
+        #endif
+    }
+
+    void TableCoating::getCoefs(double wavelength, double cosIncidenceAngle, double& reflect, double& transmit) const {
+        double fw = (wavelength-_w0)/_dw;
+        double fc = (std::abs(cosIncidenceAngle)-_c0)/_dc;
+        fw = fw < 0.0 ? 0.0 : (fw > _nw-1 ? _nw-1 : fw);
+        fc = fc < 0.0 ? 0.0 : (fc > _nc-1 ? _nc-1 : fc);
+        int iw = int(fw);
+        int ic = int(fc);
+        if (iw > int(_nw)-2)
+            iw = int(_nw)-2;
+        if (ic > int(_nc)-2)
+            ic = int(_nc)-2;
+        fw -= iw;
+        fc -= ic;
+
+        // Both corners along c are adjacent in memory.
+        const double* row0 = _coefs + 2*(iw*_nc + ic);
+        const double* row1 = row0 + 2*_nc;
+        double w00 = (1-fw)*(1-fc);
+        double w01 = (1-fw)*fc;
+        double w10 = fw*(1-fc);
+        double w11 = fw*fc;
+        reflect = w00*row0[0] + w01*row0[2] + w10*row1[0] + w11*row1[2];
+        transmit = w00*row0[1] + w01*row0[3] + w10*row1[1] + w11*row1[3];
+    }
+
+    double TableCoating::getReflect(double wavelength, double cosIncidenceAngle) const {
+        double reflect, transmit;
+        getCoefs(wavelength, cosIncidenceAngle, reflect, transmit);
+        return reflect;
+    }
+
+    double TableCoating::getTransmit(double wavelength, double cosIncidenceAngle) const {
+        double reflect, transmit;
+        getCoefs(wavelength, cosIncidenceAngle, reflect, transmit);
+        return transmit;
+    }
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
+    const Coating* TableCoating::getDevPtr() const {
+        #if defined(BATOID_GPU)
+            if (!_devPtr) {
+                Coating* ptr;
+                const size_t size = 2*_nw*_nc;
+                const double* coefs = _coefs;
+                #pragma omp target enter data map(to:coefs[:size])
+                #pragma omp target map(from:ptr)
+                {
+                    ptr = new TableCoating(_w0, _dw, _nw, _c0, _dc, _nc, coefs);
+                }
+                _devPtr = ptr;
+            }
+            return _devPtr;
+        #else
+            return this;
+        #endif
+    }
+
+
+    void multilayerCoefs(
+        size_t nlayer, const double* ns, const double* thicknesses,
+        const double* wavelengths, size_t nw,
+        const double* cosIncidenceAngles, size_t nc,
+        double* coefs
+    ) {
+        using cdouble = std::complex<double>;
+        const cdouble I(0.0, 1.0);
+        size_t size = nw*nc;
+
+        #pragma omp parallel for
+        for(int k=0; k<size; k++) {
+            size_t iw = k/nc;
+            double wavelength = wavelengths[iw];
+            double cos0 = std::abs(cosIncidenceAngles[k%nc]);
+            if (cos0 == 0.0) {
+                // Grazing incidence reflects everything.
+                coefs[2*k] = 1.0;
+                coefs[2*k+1] = 0.0;
+                continue;
+            }
+            double n0 = ns[iw];
+            // Snell invariant n sin(theta)
+            double nsin2 = n0*n0*(1-cos0*cos0);
+
+            double R = 0.0;
+            double T = 0.0;
+            for(int pol=0; pol<2; pol++) {  // s, then p
+                // Tilted optical admittance.  Purely imaginary cosines mean
+                // evanescent waves; the sign convention drops out of R and T
+                // for lossless layers.
+                auto admittance = [&](double n, cdouble cost) {
+                    return pol == 0 ? n*cost : n/cost;
+                };
+                cdouble eta0 = admittance(n0, cos0);
+
+                // Characteristic matrix of the stack, [[m00, m01], [m10, m11]]
+                cdouble m00(1.0), m01(0.0), m10(0.0), m11(1.0);
+                for(size_t j=0; j<nlayer; j++) {
+                    double n = ns[(j+1)*nw+iw];
+                    cdouble cost = std::sqrt(cdouble(1.0-nsin2/(n*n)));
+                    cdouble eta = admittance(n, cost);
+                    cdouble delta = 2*M_PI*n*thicknesses[j]*cost/wavelength;
+                    cdouble c = std::cos(delta);
+                    cdouble s = std::sin(delta);
+                    cdouble a00 = m00*c + m01*I*eta*s;
+                    cdouble a01 = m00*I*s/eta + m01*c;
+                    cdouble a10 = m10*c + m11*I*eta*s;
+                    cdouble a11 = m10*I*s/eta + m11*c;
+                    m00 = a00; m01 = a01; m10 = a10; m11 = a11;
+                }
+                double nsub = ns[(nlayer+1)*nw+iw];
+                cdouble etasub = admittance(
+                    nsub, std::sqrt(cdouble(1.0-nsin2/(nsub*nsub)))
+                );
+                cdouble B = m00 + m01*etasub;
+                cdouble C = m10 + m11*etasub;
+                cdouble denom = eta0*B + C;
+                R += std::norm((eta0*B - C)/denom);
+                T += 4*eta0.real()*etasub.real()/std::norm(denom);
+            }
+            coefs[2*k] = 0.5*R;
+            coefs[2*k+1] = 0.5*T;
+        }
+    }
 }
@@ -1,4 +1,6 @@
 #include "dualView.h"
+#include "alloc.h"
+#include <cstdint>
 
 namespace batoid {
     template<typename T>
@@ -11,7 +13,7 @@ namespace batoid {
 
     template<typename T>
     DualView<T>::DualView(size_t _size, SyncState _syncState) :
-        data(new T[_size]), size(_size), syncState(_syncState), ownsHostData(true) {
+        data(allocateArray<T>(_size)), size(_size), syncState(_syncState), ownsHostData(true) {
             #if defined(BATOID_GPU)
                 #pragma omp target enter data map(alloc:data[:size])
             #endif
@@ -22,7 +24,7 @@ namespace batoid {
         #if defined(BATOID_GPU)
             #pragma omp target exit data map(release:data[:size])
         #endif
-        if (ownsHostData) delete[] data;
+        if (ownsHostData) freeArray(data);
     }
 
     template<typename T>
@@ -79,5 +81,6 @@ namespace batoid {
     template class DualView<double>;
     template class DualView<bool>;
     template class DualView<int>;
+    template class DualView<uint64_t>;
 
 }
@@ -48,6 +48,15 @@ namespace batoid {
     }
     #endif
 
+    void Medium::getNMany(
+        size_t size, const double* wavelength, double* out
+    ) const {
+        #pragma omp parallel for
+        for(int i=0; i<size; i++) {
+            out[i] = getN(wavelength[i]);
+        }
+    }
+
     const Medium* ConstMedium::getDevPtr() const {
         #if defined(BATOID_GPU)
             if (_devPtr)
@@ -70,10 +79,21 @@ namespace batoid {
     #endif
 
         TableMedium::TableMedium(
-            const double* args, const double* vals, const size_t size
+            const double* args, const double* vals, const double* ders,
+            const size_t size
         ) :
-            Medium(), _args(args), _vals(vals), _size(size)
-        {}
+            Medium(), _args(args), _vals(vals), _ders(ders), _size(size)
+        {
+            _dx = (_args[_size-1]-_args[0])/(_size-1);
+            _uniform = true;
+            double tol = 1e-10*std::abs(_dx);
+            for(int i=1; i<_size-1; i++) {
+                if (std::abs(_args[i]-(_args[0]+i*_dx)) > tol) {
+                    _uniform = false;
+                    break;
+                }
+            }
+        }
 
         TableMedium::~TableMedium() {
             #if defined(BATOID_GPU)
@@ -82,26 +102,52 @@ namespace batoid {
                     const double* vals = _vals;
                     #pragma omp target exit data \
                         map(release:args[:_size], vals[:_size])
+                    if (_ders) {
+                        const double* ders = _ders;
+                        #pragma omp target exit data map(release:ders[:_size])
+                    }
                 }
             #endif
         }
 
         double TableMedium::getN(double wavelength) const {
-            // Linear search.  Better for GPU's?  and not that painful for small arrays?
             if (wavelength < _args[0])
                 return NAN;
             if (wavelength > _args[_size-1])
                 return NAN;
-            int upperIdx;
-            for(upperIdx=1; upperIdx<_size; upperIdx++) {
-                if (wavelength < _args[upperIdx])
-                    break;
+
+            // Find idx such that args[idx] <= wavelength <= args[idx+1].
+            int idx;
+            if (_uniform) {
+                idx = int((wavelength - _args[0])/_dx);
+                if (idx > int(_size)-2)
+                    idx = int(_size)-2;
+            } else {
+                // Branchless binary search; the conditional compiles to a
+                // select, so there is no data-dependent branch to mispredict
+                // (or to diverge on GPU).
+                const double* base = _args;
+                size_t n = _size-1;
+                while (n > 1) {
+                    size_t half = n/2;
+                    base = (base[half] <= wavelength) ? base+half : base;
+                    n -= half;
+                }
+                idx = base-_args;
             }
-            double out = (wavelength - _args[upperIdx-1]);
-            out *= (_vals[upperIdx] - _vals[upperIdx-1]);
-            out /= (_args[upperIdx] - _args[upperIdx-1]);
-            out += _vals[upperIdx-1];
-            return out;
+
+            double h = _args[idx+1] - _args[idx];
+            double frac = (wavelength - _args[idx])/h;
+            double val0 = _vals[idx];
+            double val1 = _vals[idx+1];
+            if (!_ders)
+                return val0 + frac*(val1-val0);
+
+            double der0 = _ders[idx]*h;
+            double der1 = _ders[idx+1]*h;
+            double a = 2*(val0-val1) + der0 + der1;
+            double b = 3*(val1-val0) - 2*der0 - der1;
+            return val0 + frac*(der0 + frac*(b + frac*a));
         }
 
     #if defined(BATOID_GPU)
@@ -115,11 +161,15 @@ namespace batoid {
                 // Allocate arrays on device
                 const double* args = _args;
                 const double* vals = _vals;
+                const double* ders = _ders;
                 #pragma omp target enter data \
                     map(to:args[:_size], vals[:_size])
+                if (ders) {
+                    #pragma omp target enter data map(to:ders[:_size])
+                }
                 #pragma omp target map(from:ptr)
                 {
-                    ptr = new TableMedium(args, vals, _size);
+                    ptr = new TableMedium(args, vals, ders, _size);
                 }
                 _devPtr = ptr;
             }
@@ -0,0 +1,431 @@
+#include "obscCompiled.h"
+#include <new>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+
+namespace batoid {
+
+    // Host-only helper that emits instructions.  Jump targets are symbolic
+    // labels while compiling, and are resolved to instruction indices once
+    // the whole program has been laid out.
+    struct ObscCompiled::Compiler {
+        std::vector<ObscInstr> prog;
+        std::vector<const Obscuration*> leaves;
+        std::vector<int> cells;
+        std::vector<int> labelPos;
+        // Grid index is worth it only for wide unions.
+        static const int minGridItems = 8;
+
+        int newLabel() {
+            labelPos.push_back(-1);
+            return labelPos.size()-1;
+        }
+
+        void bind(int label) {
+            labelPos[label] = prog.size();
+        }
+
+        int resolve(int target) const {
+            return target < 0 ? target : labelPos[target];
+        }
+
+        static bool bounded(double xmin, double xmax, double ymin, double ymax) {
+            return std::isfinite(xmin) && std::isfinite(xmax)
+                && std::isfinite(ymin) && std::isfinite(ymax);
+        }
+
+        static void paddedBounds(
+            const Obscuration* obsc,
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) {
+            // Pad a little so rounding in the bounds can never reject a point
+            // the exact test would accept.
+            obsc->getBounds(xmin, xmax, ymin, ymax);
+            double px = 1e-10*(xmax-xmin) + 1e-14*(std::abs(xmin)+std::abs(xmax));
+            double py = 1e-10*(ymax-ymin) + 1e-14*(std::abs(ymin)+std::abs(ymax));
+            if (std::isfinite(px)) {
+                xmin -= px;
+                xmax += px;
+            }
+            if (std::isfinite(py)) {
+                ymin -= py;
+                ymax += py;
+            }
+        }
+
+        ObscInstr& emit(const Obscuration* obsc, int op, int onTrue, int onFalse) {
+            ObscInstr instr;
+            instr.op = op;
+            instr.onTrue = onTrue;
+            instr.onFalse = onFalse;
+            instr.leaf = -1;
+            if (obsc) {
+                paddedBounds(obsc, instr.xmin, instr.xmax, instr.ymin, instr.ymax);
+            } else {
+                instr.xmin = instr.ymin = -INFINITY;
+                instr.xmax = instr.ymax = INFINITY;
+            }
+            std::fill(instr.p, instr.p+6, 0.0);
+            prog.push_back(instr);
+            return prog.back();
+        }
+
+        void compile(const Obscuration* obsc, int onTrue, int onFalse, bool inGrid) {
+            if (auto c = dynamic_cast<const ObscCompiled*>(obsc)) {
+                compile(c->_source, onTrue, onFalse, inGrid);
+            } else if (auto c = dynamic_cast<const ObscCircle*>(obsc)) {
+                ObscInstr& instr = emit(obsc, CIRCLE, onTrue, onFalse);
+                instr.p[0] = c->_radius;
+                instr.p[1] = c->_x0;
+                instr.p[2] = c->_y0;
+            } else if (auto c = dynamic_cast<const ObscAnnulus*>(obsc)) {
+                ObscInstr& instr = emit(obsc, ANNULUS, onTrue, onFalse);
+                instr.p[0] = c->_inner;
+                instr.p[1] = c->_outer;
+                instr.p[2] = c->_x0;
+                instr.p[3] = c->_y0;
+            } else if (auto c = dynamic_cast<const ObscRectangle*>(obsc)) {
+                ObscInstr& instr = emit(obsc, RECTANGLE, onTrue, onFalse);
+                instr.p[0] = c->_width;
+                instr.p[1] = c->_height;
+                instr.p[2] = c->_x0;
+                instr.p[3] = c->_y0;
+                instr.p[4] = c->_sth;
+                instr.p[5] = c->_cth;
+            } else if (auto c = dynamic_cast<const ObscRay*>(obsc)) {
+                ObscInstr& instr = emit(obsc, RAY, onTrue, onFalse);
+                instr.p[0] = c->_width;
+                instr.p[2] = c->_x0;
+                instr.p[3] = c->_y0;
+                instr.p[4] = c->_sth;
+                instr.p[5] = c->_cth;
+            } else if (auto c = dynamic_cast<const ObscNegation*>(obsc)) {
+                compile(c->_original, onFalse, onTrue, inGrid);
+            } else if (auto c = dynamic_cast<const ObscUnion*>(obsc)) {
+                compileUnion(c, onTrue, onFalse, inGrid);
+            } else if (auto c = dynamic_cast<const ObscIntersection*>(obsc)) {
+                compileIntersection(c, onTrue, onFalse, inGrid);
+            } else {
+                // Anything else is evaluated through its own contains().
+                ObscInstr& instr = emit(obsc, LEAF, onTrue, onFalse);
+                instr.leaf = leaves.size();
+                leaves.push_back(obsc);
+            }
+        }
+
+        void compileUnion(const ObscUnion* u, int onTrue, int onFalse, bool inGrid) {
+            // An empty union contains nothing.
+            if (u->_nobsc == 0) {
+                emit(nullptr, BBOX, onFalse, onFalse);
+                return;
+            }
+            double xmin, xmax, ymin, ymax;
+            u->getBounds(xmin, xmax, ymin, ymax);
+            if (bounded(xmin, xmax, ymin, ymax)) {
+                int start = newLabel();
+                emit(u, BBOX, start, onFalse);
+                bind(start);
+            }
+
+            // Split items into those that can go into a grid index and those
+            // that must always be tested.
+            std::vector<const Obscuration*> always, indexed;
+            for (size_t i=0; i<u->_nobsc; i++) {
+                u->_obscs[i]->getBounds(xmin, xmax, ymin, ymax);
+                if (bounded(xmin, xmax, ymin, ymax))
+                    indexed.push_back(u->_obscs[i]);
+                else
+                    always.push_back(u->_obscs[i]);
+            }
+            if (inGrid || indexed.size() < minGridItems) {
+                always.insert(always.end(), indexed.begin(), indexed.end());
+                indexed.clear();
+            }
+
+            // First true short-circuits; otherwise fall through to the next
+            // item.
+            for (size_t i=0; i<always.size(); i++) {
+                bool last = (i == always.size()-1) && indexed.empty();
+                int next = last ? onFalse : newLabel();
+                compile(always[i], onTrue, next, inGrid);
+                if (!last)
+                    bind(next);
+            }
+            if (!indexed.empty())
+                compileGrid(indexed, onTrue, onFalse);
+        }
+
+        void compileGrid(
+            const std::vector<const Obscuration*>& items, int onTrue, int onFalse
+        ) {
+            size_t nitem = items.size();
+            std::vector<double> bounds(4*nitem);
+            double gxmin = INFINITY, gxmax = -INFINITY;
+            double gymin = INFINITY, gymax = -INFINITY;
+            for (size_t i=0; i<nitem; i++) {
+                double* b = &bounds[4*i];
+                paddedBounds(items[i], b[0], b[1], b[2], b[3]);
+                gxmin = std::min(gxmin, b[0]);
+                gxmax = std::max(gxmax, b[1]);
+                gymin = std::min(gymin, b[2]);
+                gymax = std::max(gymax, b[3]);
+            }
+            int n = std::min(256, int(std::ceil(std::sqrt(4.0*nitem))));
+            int nx = gxmax > gxmin ? n : 1;
+            int ny = gymax > gymin ? n : 1;
+            double dx = nx > 1 ? (gxmax-gxmin)/nx : 1.0;
+            double dy = ny > 1 ? (gymax-gymin)/ny : 1.0;
+
+            ObscInstr& grid = emit(nullptr, GRID, onFalse, onFalse);
+            grid.xmin = gxmin;
+            grid.xmax = gxmax;
+            grid.ymin = gymin;
+            grid.ymax = gymax;
+            grid.p[0] = gxmin;
+            grid.p[1] = gymin;
+            grid.p[2] = dx;
+            grid.p[3] = dy;
+            grid.p[4] = nx;
+            grid.p[5] = ny;
+            size_t gridIdx = prog.size()-1;
+
+            // Each item's entry point; items report back via NEXT_ITEM when
+            // they don't contain the point.
+            std::vector<int> entries(nitem);
+            for (size_t i=0; i<nitem; i++) {
+                entries[i] = newLabel();
+                bind(entries[i]);
+                compile(items[i], onTrue, NEXT_ITEM, true);
+            }
+
+            // Bucket items by cell.  The cell of a point is computed with
+            // the same arithmetic as the cells of an item's bounds, so an
+            // item is always listed in the cell of any point it contains.
+            std::vector<std::vector<int>> buckets(nx*ny);
+            for (size_t i=0; i<nitem; i++) {
+                const double* b = &bounds[4*i];
+                int ix0 = std::min(nx-1, int((b[0]-gxmin)/dx));
+                int ix1 = std::min(nx-1, int((b[1]-gxmin)/dx));
+                int iy0 = std::min(ny-1, int((b[2]-gymin)/dy));
+                int iy1 = std::min(ny-1, int((b[3]-gymin)/dy));
+                for (int iy=iy0; iy<=iy1; iy++)
+                    for (int ix=ix0; ix<=ix1; ix++)
+                        buckets[iy*nx+ix].push_back(entries[i]);
+            }
+            prog[gridIdx].leaf = cells.size();
+            size_t offset = nx*ny+1;
+            for (int k=0; k<nx*ny; k++) {
+                cells.push_back(offset);
+                offset += buckets[k].size();
+            }
+            cells.push_back(offset);
+            for (int k=0; k<nx*ny; k++)
+                for (int entry : buckets[k])
+                    cells.push_back(entry);  // resolved later
+        }
+
+        void compileIntersection(
+            const ObscIntersection* u, int onTrue, int onFalse, bool inGrid
+        ) {
+            // An empty intersection contains everything.
+            if (u->_nobsc == 0) {
+                emit(nullptr, BBOX, onTrue, onTrue);
+                return;
+            }
+            double xmin, xmax, ymin, ymax;
+            u->getBounds(xmin, xmax, ymin, ymax);
+            if (std::isfinite(xmin) || std::isfinite(xmax)
+                || std::isfinite(ymin) || std::isfinite(ymax)) {
+                int start = newLabel();
+                emit(u, BBOX, start, onFalse);
+                bind(start);
+            }
+            // First false short-circuits; otherwise continue to the next item.
+            for (size_t i=0; i<u->_nobsc; i++) {
+                bool last = (i == u->_nobsc-1);
+                int next = last ? onTrue : newLabel();
+                compile(u->_obscs[i], next, onFalse, inGrid);
+                if (!last)
+                    bind(next);
+            }
+        }
+
+        void finish() {
+            for (auto& instr : prog) {
+                instr.onTrue = resolve(instr.onTrue);
+                instr.onFalse = resolve(instr.onFalse);
+                if (instr.op == GRID) {
+                    int ncell = int(instr.p[4])*int(instr.p[5]);
+                    int* block = &cells[instr.leaf];
+                    for (int k=block[0]; k<block[ncell]; k++)
+                        block[k] = resolve(block[k]);
+                }
+            }
+        }
+    };
+
+
+    ObscCompiled::ObscCompiled(const Obscuration* source) :
+        Obscuration(), _source(source), _owner(true)
+    {
+        Compiler compiler;
+        compiler.compile(source, OBSCURED, CLEAR, false);
+        compiler.finish();
+
+        _nprog = compiler.prog.size();
+        ObscInstr* prog = new ObscInstr[_nprog];
+        std::copy(compiler.prog.begin(), compiler.prog.end(), prog);
+        _prog = prog;
+
+        _nleaves = compiler.leaves.size();
+        const Obscuration** leaves = new const Obscuration*[_nleaves];
+        std::copy(compiler.leaves.begin(), compiler.leaves.end(), leaves);
+        _leaves = leaves;
+
+        _ncells = compiler.cells.size();
+        int* cells = new int[_ncells];
+        std::copy(compiler.cells.begin(), compiler.cells.end(), cells);
+        _cells = cells;
+    }
+
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+        ObscCompiled::ObscCompiled(
+            const ObscInstr* prog, size_t nprog,
+            const Obscuration** leaves, size_t nleaves,
+            const int* cells, size_t ncells
+        ) :
+            Obscuration(), _source(nullptr),
+            _prog(prog), _nprog(nprog),
+            _leaves(leaves), _nleaves(nleaves),
+            _cells(cells), _ncells(ncells),
+            _owner(false)
+        {}
+
+        ObscCompiled::~ObscCompiled() {
+            #if defined(BATOID_GPU)
+                if (_devPtr) {
+                    const ObscInstr* prog = _prog;
+                    const Obscuration** leaves = _leaves;
+                    const int* cells = _cells;
+                    #pragma omp target exit data \
+                        map(release:prog[:_nprog], leaves[:_nleaves], cells[:_ncells])
+                }
+            #endif
+            if (_owner) {
+                delete[] _prog;
+                delete[] _leaves;
+                delete[] _cells;
+            }
+        }
+
+        bool ObscCompiled::contains(double x, double y) const {
+            int pc = 0;
+            // Pending candidates of the active grid index.
+            const int* cells = nullptr;
+            int next = 0;
+            int end = 0;
+            int gridClear = CLEAR;
+            while (true) {
+                if (pc == NEXT_ITEM)
+                    pc = (next < end) ? cells[next++] : gridClear;
+                if (pc < 0)
+                    return pc == OBSCURED;
+                const ObscInstr& instr = _prog[pc];
+                // Written so that nan coordinates are rejected too, as they
+                // are by every primitive.
+                if (!(x >= instr.xmin && x <= instr.xmax && y >= instr.ymin && y <= instr.ymax)) {
+                    pc = instr.onFalse;
+                    continue;
+                }
+                const double* p = instr.p;
+                bool result;
+                switch (instr.op) {
+                    case BBOX:
+                        result = true;
+                        break;
+                    case CIRCLE:
+                        result = std::hypot(x-p[1], y-p[2]) < p[0];
+                        break;
+                    case ANNULUS: {
+                        double h = std::hypot(x-p[2], y-p[3]);
+                        result = (p[0] <= h) && (h < p[1]);
+                        break;
+                    }
+                    case RECTANGLE: {
+                        double xp = (x-p[2])*p[5] + (y-p[3])*p[4];
+                        double yp = -(x-p[2])*p[4] + (y-p[3])*p[5];
+                        result = (xp > -p[0]/2 && xp < p[0]/2 && yp > -p[1]/2 && yp < p[1]/2);
+                        break;
+                    }
+                    case RAY: {
+                        double xp = (x-p[2])*p[5] + (y-p[3])*p[4];
+                        double yp = -(x-p[2])*p[4] + (y-p[3])*p[5];
+                        result = (xp > 0.0 && yp > -p[0]/2 && yp < p[0]/2);
+                        break;
+                    }
+                    case LEAF:
+                        result = _leaves[instr.leaf]->contains(x, y);
+                        break;
+                    case GRID: {
+                        int nx = int(p[4]);
+                        int ny = int(p[5]);
+                        int ix = std::min(nx-1, int((x-p[0])/p[2]));
+                        int iy = std::min(ny-1, int((y-p[1])/p[3]));
+                        const int* block = _cells + instr.leaf;
+                        cells = block;
+                        next = block[iy*nx+ix];
+                        end = block[iy*nx+ix+1];
+                        gridClear = instr.onFalse;
+                        pc = NEXT_ITEM;
+                        continue;
+                    }
+                    default:
+                        result = false;
+                }
+                pc = result ? instr.onTrue : instr.onFalse;
+            }
+        }
+
+        void ObscCompiled::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            if (_source) {
+                _source->getBounds(xmin, xmax, ymin, ymax);
+            } else {
+                Obscuration::getBounds(xmin, xmax, ymin, ymax);
+            }
+        }
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
+    const Obscuration* ObscCompiled::getDevPtr() const {
+        #if defined(BATOID_GPU)
+            if (_devPtr)
+                return _devPtr;
+            const Obscuration** leaves = new const Obscuration*[_nleaves];
+            for (int i=0; i<_nleaves; i++) {
+                leaves[i] = _leaves[i]->getDevPtr();
+            }
+            const ObscInstr* prog = _prog;
+            const int* cells = _cells;
+            Obscuration* ptr;
+            #pragma omp target enter data \
+                map(to:prog[:_nprog], leaves[:_nleaves], cells[:_ncells])
+            #pragma omp target map(from:ptr)
+            {
+                ptr = new ObscCompiled(prog, _nprog, leaves, _nleaves, cells, _ncells);
+            }
+            _devPtr = ptr;
+            return ptr;
+        #else
+            return this;
+        #endif
+    }
+}
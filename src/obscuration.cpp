@@ -1,8 +1,10 @@
 #include "obscuration.h"
+#include "obscCompiled.h"
 #include <new>
 #include <cmath>
 #include <algorithm>
 #include <vector>
+#include <cstring>
 
 
 namespace batoid {
@@ -23,6 +25,15 @@ namespace batoid {
             #endif
         }
 
+        void Obscuration::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            xmin = -INFINITY;
+            xmax = INFINITY;
+            ymin = -INFINITY;
+            ymax = INFINITY;
+        }
+
         ObscCircle::ObscCircle(double radius, double x0, double y0) :
             Obscuration(), _radius(radius), _x0(x0), _y0(y0)
         {}
@@ -33,6 +44,15 @@ namespace batoid {
             return std::hypot(x-_x0, y-_y0) < _radius;
         }
 
+        void ObscCircle::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            xmin = _x0-_radius;
+            xmax = _x0+_radius;
+            ymin = _y0-_radius;
+            ymax = _y0+_radius;
+        }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
@@ -82,6 +102,15 @@ namespace batoid {
             return (_inner <= h) && (h < _outer);
         }
 
+        void ObscAnnulus::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            xmin = _x0-_outer;
+            xmax = _x0+_outer;
+            ymin = _y0-_outer;
+            ymax = _y0+_outer;
+        }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
@@ -120,6 +149,17 @@ namespace batoid {
             return (xp > -_width/2 && xp < _width/2 && yp > -_height/2 && yp < _height/2);
         }
 
+        void ObscRectangle::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            double hx = 0.5*(std::abs(_width*_cth) + std::abs(_height*_sth));
+            double hy = 0.5*(std::abs(_width*_sth) + std::abs(_height*_cth));
+            xmin = _x0-hx;
+            xmax = _x0+hx;
+            ymin = _y0-hy;
+            ymax = _y0+hy;
+        }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
@@ -158,6 +198,19 @@ namespace batoid {
             return (xp > 0.0 && yp > -_width/2 && yp < _width/2);
         }
 
+        void ObscRay::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            // Half-infinite strip starting at the segment through (x0, y0)
+            // perpendicular to theta.
+            double hx = 0.5*std::abs(_width*_sth);
+            double hy = 0.5*std::abs(_width*_cth);
+            xmin = _cth < 0.0 ? -INFINITY : _x0-hx;
+            xmax = _cth > 0.0 ? INFINITY : _x0+hx;
+            ymin = _sth < 0.0 ? -INFINITY : _y0-hy;
+            ymax = _sth > 0.0 ? INFINITY : _y0+hy;
+        }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
@@ -179,12 +232,88 @@ namespace batoid {
     }
 
 
+    ObscPolygon::ObscPolygon(const double* xp, const double* yp, const size_t size) :
+        Obscuration(), _xp(xp), _yp(yp), _size(size), _owner(true)
+    {
+        _xmin = _xmax = xp[0];
+        _ymin = _ymax = yp[0];
+        for (size_t i=1; i<size; i++) {
+            _xmin = std::min(_xmin, xp[i]);
+            _xmax = std::max(_xmax, xp[i]);
+            _ymin = std::min(_ymin, yp[i]);
+            _ymax = std::max(_ymax, yp[i]);
+        }
+
+        // Roughly two edges per slab.  Edges spanning many slabs are stored
+        // once per slab, so coarsen if that blows up the table.
+        _nslab = std::max(size_t(1), std::min(size_t(4096), size/2));
+        if (!(_ymax > _ymin))
+            _nslab = 1;
+        std::vector<int> k0(size), k1(size);
+        while (true) {
+            _dy = (_nslab > 1) ? (_ymax-_ymin)/_nslab : 1.0;
+            size_t total = 0;
+            for (size_t i=0; i<size; i++) {
+                double y1 = yp[i];
+                double y2 = yp[(i+1) % size];
+                // Horizontal edges never cross a query row.
+                if (y1 == y2) {
+                    k0[i] = 0;
+                    k1[i] = -1;
+                    continue;
+                }
+                // Same arithmetic as the lookup in contains, so that an edge
+                // is always listed in the slab of any y it spans.
+                k0[i] = std::min(int(_nslab)-1, int((std::min(y1, y2)-_ymin)/_dy));
+                k1[i] = std::min(int(_nslab)-1, int((std::max(y1, y2)-_ymin)/_dy));
+                total += k1[i]-k0[i]+1;
+            }
+            if (_nslab == 1 || total <= 8*size)
+                break;
+            _nslab /= 2;
+        }
+
+        std::vector<std::vector<int>> buckets(_nslab);
+        for (size_t i=0; i<size; i++)
+            for (int k=k0[i]; k<=k1[i]; k++)
+                buckets[k].push_back(i);
+
+        int* slabs = new int[_nslab+1];
+        _nedge = 0;
+        for (size_t k=0; k<_nslab; k++) {
+            slabs[k] = _nedge;
+            _nedge += buckets[k].size();
+        }
+        slabs[_nslab] = _nedge;
+        double* edges = new double[4*_nedge];
+        double* e = edges;
+        for (size_t k=0; k<_nslab; k++) {
+            for (int i : buckets[k]) {
+                e[0] = xp[i];
+                e[1] = yp[i];
+                e[2] = xp[(i+1) % size];
+                e[3] = yp[(i+1) % size];
+                e += 4;
+            }
+        }
+        _slabs = slabs;
+        _edges = edges;
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp declare target
     #endif
 
-        ObscPolygon::ObscPolygon(const double* xp, const double* yp, const size_t size) :
-            Obscuration(), _xp(xp), _yp(yp), _size(size)
+        ObscPolygon::ObscPolygon(
+            const double* xp, const double* yp, const size_t size,
+            double xmin, double xmax, double ymin, double ymax,
+            size_t nslab, const int* slabs, const double* edges, size_t nedge
+        ) :
+            Obscuration(), _xp(xp), _yp(yp), _size(size),
+            _xmin(xmin), _xmax(xmax), _ymin(ymin), _ymax(ymax),
+            _nslab(nslab), _dy(nslab > 1 ? (ymax-ymin)/nslab : 1.0),
+            _slabs(slabs), _edges(edges), _nedge(nedge),
+            _owner(false)
         {}
 
         ObscPolygon::~ObscPolygon() {
@@ -192,111 +321,172 @@ namespace batoid {
                 if (_devPtr) {
                     const double* xp = _xp;
                     const double* yp = _yp;
+                    const int* slabs = _slabs;
+                    const double* edges = _edges;
                     #pragma omp target exit data \
-                        map(release:xp[:_size], yp[:_size])
+                        map(release:xp[:_size], yp[:_size], slabs[:_nslab+1], edges[:4*_nedge])
                 }
             #endif
+            if (_owner) {
+                delete[] _slabs;
+                delete[] _edges;
+            }
         }
 
         bool ObscPolygon::contains(double x, double y) const {
-            double x1 = _xp[0];  // first point of segment
-            double y1 = _yp[0];
-            double xinters = 0.0;
+            // Crossing number test, restricted to the edges in y's slab.  A
+            // point needs an edge with x <= max(x1, x2) and ymin < y <= ymax
+            // to be inside, so these checks don't change the result.
+            if (!(y > _ymin && y <= _ymax && x <= _xmax))
+                return false;
+            int k = std::min(int(_nslab)-1, int((y-_ymin)/_dy));
             bool inside = false;
-            for (int i=1; i<=_size; i++) {  // Loop over polygon edges
-                double x2 = _xp[i % _size];  // second point of segment
-                double y2 = _yp[i % _size];
+            for (int j=_slabs[k]; j<_slabs[k+1]; j++) {
+                const double* e = _edges + 4*j;
+                double x1 = e[0];
+                double y1 = e[1];
+                double x2 = e[2];
+                double y2 = e[3];
                 if (y > std::min(y1,y2)) {
                     if (y <= std::max(y1,y2)) {
                         if (x <= std::max(x1,x2)) {
-                            if (y1 != y2) {
-                                xinters = (y-y1)*(x2-x1)/(y2-y1)+x1;
-                            }
+                            double xinters = (y-y1)*(x2-x1)/(y2-y1)+x1;
                             if (x1 == x2 or x <= xinters) {
                                 inside = !inside;
                             }
                         }
                     }
                 }
-                x1 = x2;
-                y1 = y2;
             }
             return inside;
         }
 
+        void ObscPolygon::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            xmin = _xmin;
+            xmax = _xmax;
+            ymin = _ymin;
+            ymax = _ymax;
+        }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
 
 
-    // CPU only for now.
-    void ObscPolygon::containsGrid(
-        const double* xgrid, const double* ygrid, bool* out, const size_t nx, const size_t ny
-    ) const {
-        // xgrid is [nx], ygrid is [ny]
-        // out is [ny, nx]
-
-        // Compute polygon y min/max
-        double ymin = _yp[0];
-        double ymax = _yp[0];
-        for (int k=1; k<_size; k++) {
-            if (_yp[k] < ymin)
-                ymin = _yp[k];
-            if (_yp[k] > ymax)
-                ymax = _yp[k];
-        }
-
-        // Proceed row by row
-        std::vector<double> xinters;
-        xinters.reserve(16);  // 2 is probably most common, but it's cheap to allocate 16
-        for (int j=0; j<ny; j++) {
-            double y = ygrid[j];
-            if ((y < ymin) or (y > ymax)) {
-                for (int i=0; i<nx; i++) {
-                    out[j*nx+i] = false;
+    const Obscuration* ObscPolygon::getDevPtr() const {
+        #if defined(BATOID_GPU)
+            if (!_devPtr) {
+                Obscuration* ptr;
+                // Allocate arrays on device
+                const double* xp = _xp;
+                const double* yp = _yp;
+                const int* slabs = _slabs;
+                const double* edges = _edges;
+                #pragma omp target enter data \
+                    map(to:xp[:_size], yp[:_size], slabs[:_nslab+1], edges[:4*_nedge])
+                #pragma omp target map(from:ptr)
+                {
+                    ptr = new ObscPolygon(
+                        xp, yp, _size, _xmin, _xmax, _ymin, _ymax,
+                        _nslab, slabs, edges, _nedge
+                    );
                 }
-                continue;
-            }
-            xinters.clear();
-            // Loop through edges to find all relevant x intercepts
-            double x1 = _xp[0];  // first point of segment
-            double y1 = _yp[0];
-            for (int k=0; k<_size; k++) {
-                double x2 = _xp[k % _size];  // second point of segment
-                double y2 = _yp[k % _size];
-                if ((y > std::min(y1, y2)) && (y <= std::max(y1, y2)))
-                    xinters.push_back((y-y1)*(x2-x1)/(y2-y1)+x1);
-                x1 = x2;
-                y1 = y2;
-            }
-            std::sort(xinters.begin(), xinters.end());
-            // All points to the left of first intercept are outside the polygon
-            // Alternate after that.
-            bool contained = false;
-            auto xptr = xinters.begin();
-            for (int i=0; i<nx; i++) {
-                if (xptr != xinters.end()) {
-                    if (xgrid[i] > *xptr) {
-                        contained = !contained;
-                        xptr++;
-                    }
+                _devPtr = ptr;
+            }
+            return _devPtr;
+        #else
+            return this;
+        #endif
+    }
+
+
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+        ObscBitmap::ObscBitmap(
+            double xmin, double xmax, double ymin, double ymax,
+            size_t nx, size_t ny, const uint8_t* bits, bool bilinear
+        ) :
+            Obscuration(),
+            _xmin(xmin), _xmax(xmax), _ymin(ymin), _ymax(ymax),
+            _nx(nx), _ny(ny),
+            _dx((xmax-xmin)/nx), _dy((ymax-ymin)/ny),
+            _rowbytes((nx+7)/8),
+            _bits(bits), _bilinear(bilinear)
+        {}
+
+        ObscBitmap::~ObscBitmap() {
+            #if defined(BATOID_GPU)
+                if (_devPtr) {
+                    const uint8_t* bits = _bits;
+                    #pragma omp target exit data \
+                        map(release:bits[:_ny*_rowbytes])
                 }
-                out[j*ny+i] = contained;
+            #endif
+        }
+
+        bool ObscBitmap::_bit(int i, int j) const {
+            return (_bits[j*_rowbytes + (i>>3)] >> (i&7)) & 1;
+        }
+
+        bool ObscBitmap::contains(double x, double y) const {
+            double u = (x-_xmin)/_dx;
+            double v = (y-_ymin)/_dy;
+            if (!_bilinear) {
+                // Also rejects nan.
+                if (!(u >= 0 && u < _nx && v >= 0 && v < _ny))
+                    return false;
+                return _bit(int(u), int(v));
             }
+            // Interpolate between pixel centers; pixels beyond the edges count
+            // as clear.
+            u -= 0.5;
+            v -= 0.5;
+            if (!(u > -1 && u < _nx && v > -1 && v < _ny))
+                return false;
+            int i0 = int(std::floor(u));
+            int j0 = int(std::floor(v));
+            double s = u-i0;
+            double t = v-j0;
+            bool ilo = i0 >= 0;
+            bool ihi = i0+1 < int(_nx);
+            bool jlo = j0 >= 0;
+            bool jhi = j0+1 < int(_ny);
+            double b00 = (ilo && jlo) ? _bit(i0, j0) : 0.0;
+            double b10 = (ihi && jlo) ? _bit(i0+1, j0) : 0.0;
+            double b01 = (ilo && jhi) ? _bit(i0, j0+1) : 0.0;
+            double b11 = (ihi && jhi) ? _bit(i0+1, j0+1) : 0.0;
+            double val = (1-t)*((1-s)*b00 + s*b10) + t*((1-s)*b01 + s*b11);
+            return val > 0.5;
         }
-    }
 
-    const Obscuration* ObscPolygon::getDevPtr() const {
+        void ObscBitmap::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            xmin = _xmin;
+            xmax = _xmax;
+            ymin = _ymin;
+            ymax = _ymax;
+        }
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
+    const Obscuration* ObscBitmap::getDevPtr() const {
         #if defined(BATOID_GPU)
             if (!_devPtr) {
                 Obscuration* ptr;
-                // Allocate arrays on device
-                const double* xp = _xp;
-                const double* yp = _yp;
-                #pragma omp target enter data map(to:xp[:_size], yp[:_size])
+                const uint8_t* bits = _bits;
+                #pragma omp target enter data map(to:bits[:_ny*_rowbytes])
                 #pragma omp target map(from:ptr)
                 {
-                    ptr = new ObscPolygon(xp, yp, _size);
+                    ptr = new ObscBitmap(
+                        _xmin, _xmax, _ymin, _ymax, _nx, _ny, bits, _bilinear
+                    );
                 }
                 _devPtr = ptr;
             }
@@ -369,6 +559,21 @@ namespace batoid {
             return ret;
         }
 
+        void ObscUnion::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            xmin = ymin = INFINITY;
+            xmax = ymax = -INFINITY;
+            for (int i=0; i<_nobsc; i++) {
+                double x0, x1, y0, y1;
+                _obscs[i]->getBounds(x0, x1, y0, y1);
+                xmin = std::min(xmin, x0);
+                xmax = std::max(xmax, x1);
+                ymin = std::min(ymin, y0);
+                ymax = std::max(ymax, y1);
+            }
+        }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
@@ -420,6 +625,21 @@ namespace batoid {
             return ret;
         }
 
+        void ObscIntersection::getBounds(
+            double& xmin, double& xmax, double& ymin, double& ymax
+        ) const {
+            xmin = ymin = -INFINITY;
+            xmax = ymax = INFINITY;
+            for (int i=0; i<_nobsc; i++) {
+                double x0, x1, y0, y1;
+                _obscs[i]->getBounds(x0, x1, y0, y1);
+                xmin = std::max(xmin, x0);
+                xmax = std::min(xmax, x1);
+                ymin = std::max(ymin, y0);
+                ymax = std::min(ymax, y1);
+            }
+        }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
@@ -444,4 +664,284 @@ namespace batoid {
             return this;
         #endif
     }
+
+
+    // Host-only helper that finds, for one row of a grid, the sorted and
+    // disjoint index ranges [begin, end) of xgrid that are obscured.
+    // Primitives compute their row intervals analytically and then nudge the
+    // endpoints with contains(), so the result agrees exactly with testing
+    // each grid point.  Compound obscurations combine the spans of their
+    // items.
+    class ObscRasterizer {
+    public:
+        ObscRasterizer(const double* xgrid, size_t nx) :
+            _x(xgrid), _nx(nx)
+        {}
+
+        void row(const Obscuration* obsc, double y, std::vector<int>& spans) const {
+            spans.clear();
+            if (auto o = dynamic_cast<const ObscCompiled*>(obsc)) {
+                row(o->_source, y, spans);
+            } else if (auto o = dynamic_cast<const ObscCircle*>(obsc)) {
+                double dy = y-o->_y0;
+                double h2 = o->_radius*o->_radius - dy*dy;
+                if (h2 > 0) {
+                    double h = std::sqrt(h2);
+                    addInterval(obsc, y, o->_x0-h, o->_x0+h, spans);
+                }
+            } else if (auto o = dynamic_cast<const ObscAnnulus*>(obsc)) {
+                double dy = y-o->_y0;
+                double ho2 = o->_outer*o->_outer - dy*dy;
+                double hi2 = o->_inner*o->_inner - dy*dy;
+                if (ho2 > 0) {
+                    double ho = std::sqrt(ho2);
+                    if (hi2 > 0) {
+                        double hi = std::sqrt(hi2);
+                        addInterval(obsc, y, o->_x0-ho, o->_x0-hi, spans);
+                        addInterval(obsc, y, o->_x0+hi, o->_x0+ho, spans);
+                    } else {
+                        addInterval(obsc, y, o->_x0-ho, o->_x0+ho, spans);
+                    }
+                }
+            } else if (auto o = dynamic_cast<const ObscRectangle*>(obsc)) {
+                // Both rotated coordinates are linear in x along the row.
+                double a0, b0, a1, b1;
+                double dy = y-o->_y0;
+                linearInterval(
+                    o->_cth, o->_sth*dy - o->_cth*o->_x0,
+                    -o->_width/2, o->_width/2, a0, b0
+                );
+                linearInterval(
+                    -o->_sth, o->_sth*o->_x0 + o->_cth*dy,
+                    -o->_height/2, o->_height/2, a1, b1
+                );
+                addInterval(obsc, y, std::max(a0, a1), std::min(b0, b1), spans);
+            } else if (auto o = dynamic_cast<const ObscRay*>(obsc)) {
+                double a0, b0, a1, b1;
+                double dy = y-o->_y0;
+                linearInterval(
+                    o->_cth, o->_sth*dy - o->_cth*o->_x0,
+                    0.0, INFINITY, a0, b0
+                );
+                linearInterval(
+                    -o->_sth, o->_sth*o->_x0 + o->_cth*dy,
+                    -o->_width/2, o->_width/2, a1, b1
+                );
+                addInterval(obsc, y, std::max(a0, a1), std::min(b0, b1), spans);
+            } else if (auto o = dynamic_cast<const ObscPolygon*>(obsc)) {
+                polygonRow(o, y, spans);
+            } else if (auto o = dynamic_cast<const ObscNegation*>(obsc)) {
+                row(o->_original, y, spans);
+                complement(spans);
+            } else if (auto o = dynamic_cast<const ObscUnion*>(obsc)) {
+                std::vector<int> item;
+                for (size_t i=0; i<o->_nobsc; i++) {
+                    row(o->_obscs[i], y, item);
+                    spans.insert(spans.end(), item.begin(), item.end());
+                }
+                normalize(spans);
+            } else if (auto o = dynamic_cast<const ObscIntersection*>(obsc)) {
+                std::vector<int> item;
+                spans.push_back(0);
+                spans.push_back(_nx);
+                for (size_t i=0; i<o->_nobsc && !spans.empty(); i++) {
+                    row(o->_obscs[i], y, item);
+                    intersect(spans, item);
+                }
+            } else {
+                // Fall back to testing every point.
+                int begin = -1;
+                for (int i=0; i<_nx; i++) {
+                    bool c = obsc->contains(_x[i], y);
+                    if (c && begin < 0) {
+                        begin = i;
+                    } else if (!c && begin >= 0) {
+                        spans.push_back(begin);
+                        spans.push_back(i);
+                        begin = -1;
+                    }
+                }
+                if (begin >= 0) {
+                    spans.push_back(begin);
+                    spans.push_back(_nx);
+                }
+            }
+        }
+
+    private:
+        const double* _x;
+        const int _nx;
+
+        // Solve lo < alpha*x + beta < hi for x.  Empty intervals have a > b.
+        static void linearInterval(
+            double alpha, double beta, double lo, double hi,
+            double& a, double& b
+        ) {
+            if (alpha > 0) {
+                a = (lo-beta)/alpha;
+                b = (hi-beta)/alpha;
+            } else if (alpha < 0) {
+                a = (hi-beta)/alpha;
+                b = (lo-beta)/alpha;
+            } else if (lo < beta && beta < hi) {
+                a = -INFINITY;
+                b = INFINITY;
+            } else {
+                a = INFINITY;
+                b = -INFINITY;
+            }
+        }
+
+        // Append the grid points in [a, b], after correcting each end for
+        // rounding so it agrees with obsc->contains.
+        void addInterval(
+            const Obscuration* obsc, double y, double a, double b,
+            std::vector<int>& spans
+        ) const {
+            if (!(a <= b))  // also rejects nan
+                return;
+            int i0 = std::lower_bound(_x, _x+_nx, a) - _x;
+            int i1 = std::upper_bound(_x, _x+_nx, b) - _x;
+            if (i0 >= i1) {
+                // Interval may fall between grid points; check neighbors.
+                i1 = i0;
+                if (i0 < _nx && obsc->contains(_x[i0], y))
+                    i1 = i0+1;
+                else if (i0 > 0 && obsc->contains(_x[i0-1], y))
+                    i0 = i0-1;
+                else
+                    return;
+            }
+            while (i0 > 0 && obsc->contains(_x[i0-1], y))
+                i0--;
+            while (i0 < i1 && !obsc->contains(_x[i0], y))
+                i0++;
+            while (i1 < _nx && obsc->contains(_x[i1], y))
+                i1++;
+            while (i1 > i0 && !obsc->contains(_x[i1-1], y))
+                i1--;
+            if (i0 < i1) {
+                spans.push_back(i0);
+                spans.push_back(i1);
+            }
+        }
+
+        // The crossing points of the row with the polygon edges, with the
+        // same arithmetic and parity rule as ObscPolygon::contains.
+        void polygonRow(
+            const ObscPolygon* o, double y, std::vector<int>& spans
+        ) const {
+            if (!(y > o->_ymin && y <= o->_ymax))
+                return;
+            int k = std::min(int(o->_nslab)-1, int((y-o->_ymin)/o->_dy));
+            std::vector<double> xc;
+            for (int j=o->_slabs[k]; j<o->_slabs[k+1]; j++) {
+                const double* e = o->_edges + 4*j;
+                double x1 = e[0];
+                double y1 = e[1];
+                double x2 = e[2];
+                double y2 = e[3];
+                if (y > std::min(y1,y2) && y <= std::max(y1,y2)) {
+                    double xinters = (y-y1)*(x2-x1)/(y2-y1)+x1;
+                    xc.push_back(std::min(xinters, std::max(x1,x2)));
+                }
+            }
+            // A point is inside if an odd number of crossings lie at or to
+            // its right.
+            std::sort(xc.begin(), xc.end());
+            for (int m=xc.size(); m>0; m-=2) {
+                int i0 = (m >= 2) ? std::upper_bound(_x, _x+_nx, xc[m-2]) - _x : 0;
+                int i1 = std::upper_bound(_x, _x+_nx, xc[m-1]) - _x;
+                if (i0 < i1) {
+                    spans.push_back(i0);
+                    spans.push_back(i1);
+                }
+            }
+            normalize(spans);
+        }
+
+        // Sort spans and merge any that overlap or touch.
+        static void normalize(std::vector<int>& spans) {
+            size_t n = spans.size()/2;
+            std::vector<std::pair<int,int>> pairs(n);
+            for (size_t i=0; i<n; i++)
+                pairs[i] = {spans[2*i], spans[2*i+1]};
+            std::sort(pairs.begin(), pairs.end());
+            spans.clear();
+            for (const auto& p : pairs) {
+                if (!spans.empty() && p.first <= spans.back())
+                    spans.back() = std::max(spans.back(), p.second);
+                else {
+                    spans.push_back(p.first);
+                    spans.push_back(p.second);
+                }
+            }
+        }
+
+        void complement(std::vector<int>& spans) const {
+            std::vector<int> out;
+            int prev = 0;
+            for (size_t i=0; i<spans.size(); i+=2) {
+                if (spans[i] > prev) {
+                    out.push_back(prev);
+                    out.push_back(spans[i]);
+                }
+                prev = spans[i+1];
+            }
+            if (prev < _nx) {
+                out.push_back(prev);
+                out.push_back(_nx);
+            }
+            spans.swap(out);
+        }
+
+        static void intersect(std::vector<int>& spans, const std::vector<int>& other) {
+            std::vector<int> out;
+            size_t i=0, j=0;
+            while (i < spans.size() && j < other.size()) {
+                int begin = std::max(spans[i], other[j]);
+                int end = std::min(spans[i+1], other[j+1]);
+                if (begin < end) {
+                    out.push_back(begin);
+                    out.push_back(end);
+                }
+                if (spans[i+1] < other[j+1])
+                    i += 2;
+                else
+                    j += 2;
+            }
+            spans.swap(out);
+        }
+    };
+
+
+    void Obscuration::containsGrid(
+        const double* xgrid, const double* ygrid, uint8_t* out,
+        const size_t nx, const size_t ny
+    ) const {
+        ObscRasterizer raster(xgrid, nx);
+        const size_t rowbytes = (nx+7)/8;
+        #pragma omp parallel
+        {
+            std::vector<int> spans;
+            #pragma omp for schedule(dynamic, 16)
+            for (int j=0; j<int(ny); j++) {
+                raster.row(this, ygrid[j], spans);
+                uint8_t* bits = out + j*rowbytes;
+                std::memset(bits, 0, rowbytes);
+                for (size_t k=0; k<spans.size(); k+=2) {
+                    int i = spans[k];
+                    int end = spans[k+1];
+                    for (; i<end && (i&7); i++)
+                        bits[i>>3] |= 1 << (i&7);
+                    if (end-i >= 8) {
+                        std::memset(bits+(i>>3), 0xff, (end-i)>>3);
+                        i += (end-i) & ~7;
+                    }
+                    for (; i<end; i++)
+                        bits[i>>3] |= 1 << (i&7);
+                }
+            }
+        }
+    }
 }
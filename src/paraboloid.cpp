@@ -70,6 +70,15 @@ namespace batoid {
         return true;
     }
 
+    void Paraboloid::hessian(
+        double x, double y,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) const {
+        dzdxx = (_R != 0) ? _Rinv : 0.0;
+        dzdxy = 0.0;
+        dzdyy = dzdxx;
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
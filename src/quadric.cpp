@@ -76,6 +76,23 @@ namespace batoid {
         return 0.0;
     }
 
+    void Quadric::hessian(
+        double x, double y,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) const {
+        if (_R == 0.0) {
+            dzdxx = 0.0;
+            dzdxy = 0.0;
+            dzdyy = 0.0;
+            return;
+        }
+        // dz/dr = r/(R s) and d2z/dr2 = 1/(R s^3), s = sqrt(1-(1+k)r^2/R^2)
+        double s = std::sqrt(1-(x*x + y*y)*_cp1RR);
+        _radialHessian(
+            x, y, 1/(_R*s), 1/(_R*s*s*s), dzdxx, dzdxy, dzdyy
+        );
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
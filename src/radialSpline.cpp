@@ -0,0 +1,162 @@
+#include "radialSpline.h"
+#include <new>
+#include <cmath>
+
+
+namespace batoid {
+
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+    RadialSpline::RadialSpline(
+        double r0, double dr, const double* zdzdr, size_t n, bool use_nan
+    ) :
+        Surface(),
+        _r0(r0), _dr(dr), _rmax(r0+(n-1)*dr),
+        _zdzdr(zdzdr),
+        _n(n),
+        _use_nan(use_nan)
+    {}
+
+    RadialSpline::~RadialSpline() {
+        #if defined(BATOID_GPU)
+            if (_devPtr) {
+                const size_t size = 2*_n;
+                const double* zdzdr = _zdzdr;
+                #pragma omp target exit data map(release:zdzdr[:size])
+            }
+        #endif
+    }
+
+    bool RadialSpline::_eval(double r, double& z, double& dzdr) const {
+        if ((r < _r0) or (r > _rmax)) {
+            z = _use_nan ? NAN : 0.0;
+            dzdr = _use_nan ? NAN : 0.0;
+            return false;
+        }
+        int ir = int((r-_r0)/_dr);
+        if (ir > int(_n)-2)  // Only happens when r == _rmax
+            ir = int(_n)-2;
+        double frac = (r - (_r0 + ir*_dr))/_dr;
+
+        // Cubic Hermite segment; both knots live in 4 consecutive doubles.
+        const double* knot = _zdzdr + 2*ir;
+        double val0 = knot[0];
+        double der0 = knot[1]*_dr;
+        double val1 = knot[2];
+        double der1 = knot[3]*_dr;
+        double a = 2*(val0-val1) + der0 + der1;
+        double b = 3*(val1-val0) - 2*der0 - der1;
+
+        z = val0 + frac*(der0 + frac*(b + frac*a));
+        dzdr = (der0 + frac*(2*b + frac*3*a))/_dr;
+        return true;
+    }
+
+    double RadialSpline::sag(double x, double y) const {
+        double z, dzdr;
+        _eval(std::sqrt(x*x + y*y), z, dzdr);
+        return z;
+    }
+
+    void RadialSpline::normal(
+        double x, double y,
+        double& nx, double& ny, double& nz
+    ) const {
+        double r = std::sqrt(x*x + y*y);
+        double z, dzdr;
+        _eval(r, z, dzdr);
+        if (std::isnan(dzdr)) {
+            nx = NAN;
+            ny = NAN;
+            nz = NAN;
+            return;
+        }
+        if (r == 0.0) {
+            nx = 0.0;
+            ny = 0.0;
+            nz = 1.0;
+            return;
+        }
+        nz = 1/std::sqrt(1+dzdr*dzdr);
+        nx = -x/r*dzdr*nz;
+        ny = -y/r*dzdr*nz;
+    }
+
+    void RadialSpline::grad(
+        double x, double y,
+        double& dzdx, double& dzdy
+    ) const {
+        double r = std::sqrt(x*x + y*y);
+        double z, dzdr;
+        _eval(r, z, dzdr);
+        if (r == 0.0 && !std::isnan(dzdr)) {
+            dzdx = 0.0;
+            dzdy = 0.0;
+            return;
+        }
+        dzdx = x/r*dzdr;
+        dzdy = y/r*dzdr;
+    }
+
+    bool RadialSpline::timeToIntersect(
+        const double x, const double y, const double z,
+        const double vx, const double vy, const double vz,
+        double& dt
+    ) const {
+        // Same fixed-iteration scheme as Surface::timeToIntersect, but with the
+        // sag and slope coming out of a single table lookup per iteration.
+        double rPx = x+vx*dt;
+        double rPy = y+vy*dt;
+        double rPz = z+vz*dt;
+
+        double r = std::sqrt(rPx*rPx + rPy*rPy);
+        double sz, dzdr;
+        _eval(r, sz, dzdr);
+        for (int iter=0; iter<5; iter++) {
+            double nx, ny, nz;
+            if (r == 0.0) {
+                nx = 0.0;
+                ny = 0.0;
+                nz = 1.0;
+            } else {
+                nz = 1/std::sqrt(1+dzdr*dzdr);
+                nx = -rPx/r*dzdr*nz;
+                ny = -rPy/r*dzdr*nz;
+            }
+            dt = (rPx-x)*nx + (rPy-y)*ny + (sz-z)*nz;
+            dt /= (nx*vx + ny*vy + nz*vz);
+            rPx = x+vx*dt;
+            rPy = y+vy*dt;
+            rPz = z+vz*dt;
+            r = std::sqrt(rPx*rPx + rPy*rPy);
+            _eval(r, sz, dzdr);
+        }
+        return (std::abs(sz-rPz) < 1e-12);
+    }
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
+    const Surface* RadialSpline::getDevPtr() const {
+        #if defined(BATOID_GPU)
+            if (!_devPtr) {
+                Surface* ptr;
+                // Allocate knot array on device
+                const size_t size = 2*_n;
+                const double* zdzdr = _zdzdr;
+                #pragma omp target enter data map(to:zdzdr[:size])
+                #pragma omp target map(from:ptr)
+                {
+                    ptr = new RadialSpline(_r0, _dr, zdzdr, _n, _use_nan);
+                }
+                _devPtr = ptr;
+            }
+            return _devPtr;
+        #else
+            return this;
+        #endif
+    }
+}
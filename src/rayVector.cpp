@@ -1,4 +1,6 @@
 #include "rayVector.h"
+#include <cmath>
+#include <cstring>
 
 namespace batoid {
     RayVector::RayVector(
@@ -6,21 +8,22 @@ namespace batoid {
         double* _vx, double* _vy, double* _vz,
         double* _t,
         double* _wavelength, double* _flux,
-        bool* _vignetted, bool* _failed,
-        size_t _size
+        uint64_t* _vignetted, uint64_t* _failed,
+        size_t _size, int uniform, size_t _flagOffset
     ) :
         x(_x, _size),
         y(_y, _size),
         z(_z, _size),
-        vx(_vx, _size),
-        vy(_vy, _size),
-        vz(_vz, _size),
-        t(_t, _size),
-        wavelength(_wavelength, _size),
-        flux(_flux, _size),
-        vignetted(_vignetted, _size),
-        failed(_failed, _size),
-        size(_size)
+        vx(_vx, (uniform & VELOCITY) ? 1 : _size),
+        vy(_vy, (uniform & VELOCITY) ? 1 : _size),
+        vz(_vz, (uniform & VELOCITY) ? 1 : _size),
+        t(_t, (uniform & TIME) ? 1 : _size),
+        wavelength(_wavelength, (uniform & WAVELENGTH) ? 1 : _size),
+        flux(_flux, (uniform & FLUX) ? 1 : _size),
+        vignetted(_vignetted, (_flagOffset+_size+63)/64),
+        failed(_failed, (_flagOffset+_size+63)/64),
+        size(_size),
+        flagOffset(_flagOffset)
     { }
 
     void RayVector::positionAtTime(double _t, double* xout, double* yout, double* zout) const {
@@ -38,6 +41,8 @@ namespace batoid {
         double* vyptr = vy.data;
         double* vzptr = vz.data;
         double* tptr = t.data;
+        size_t vmask = indexMask(vx);
+        size_t tmask = indexMask(t);
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for \
                 map(from:xout[:size],yout[:size],zout[:size])
@@ -45,9 +50,9 @@ namespace batoid {
             #pragma omp parallel for
         #endif
         for(int i=0; i<size; i++) {
-            xout[i] = xptr[i] + vxptr[i] * (_t-tptr[i]);
-            yout[i] = yptr[i] + vyptr[i] * (_t-tptr[i]);
-            zout[i] = zptr[i] + vzptr[i] * (_t-tptr[i]);
+            xout[i] = xptr[i] + vxptr[i&vmask] * (_t-tptr[i&tmask]);
+            yout[i] = yptr[i] + vyptr[i&vmask] * (_t-tptr[i&tmask]);
+            zout[i] = zptr[i] + vzptr[i&vmask] * (_t-tptr[i&tmask]);
         }
     }
 
@@ -66,16 +71,27 @@ namespace batoid {
         double* vyptr = vy.data;
         double* vzptr = vz.data;
         double* tptr = t.data;
+        size_t vmask = indexMask(vx);
+        size_t tmask = indexMask(t);
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for
         #else
             #pragma omp parallel for
         #endif
         for(int i=0; i<size; i++) {
-            xptr[i] += vxptr[i] * (_t - tptr[i]);
-            yptr[i] += vyptr[i] * (_t - tptr[i]);
-            zptr[i] += vzptr[i] * (_t - tptr[i]);
-            tptr[i] = _t;
+            xptr[i] += vxptr[i&vmask] * (_t - tptr[i&tmask]);
+            yptr[i] += vyptr[i&vmask] * (_t - tptr[i&tmask]);
+            zptr[i] += vzptr[i&vmask] * (_t - tptr[i&tmask]);
+            if (tmask)
+                tptr[i] = _t;
+        }
+        if (!tmask) {
+            // Uniform times stay uniform; update the shared value last, after
+            // every ray has read it.
+            #if defined(BATOID_GPU)
+                #pragma omp target
+            #endif
+            tptr[0] = _t;
         }
     }
 
@@ -98,6 +114,9 @@ namespace batoid {
         double* vzptr = vz.data;
         double* tptr = t.data;
         double* wptr = wavelength.data;
+        size_t vmask = indexMask(vx);
+        size_t tmask = indexMask(t);
+        size_t wmask = indexMask(wavelength);
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for map(from:out[:size])
         #else
@@ -107,13 +126,16 @@ namespace batoid {
             // phi = k.(r-r0) - (t-t0)omega
             // k = 2 pi v / lambda |v|^2
             // omega = 2 pi / lambda
-            double v2 = vxptr[i]*vxptr[i] + vyptr[i]*vyptr[i] + vzptr[i]*vzptr[i];
-            out[i] = (_x-xptr[i])*vxptr[i];
-            out[i] += (_y-yptr[i])*vyptr[i];
-            out[i] += (_z-zptr[i])*vzptr[i];
+            double vxi = vxptr[i&vmask];
+            double vyi = vyptr[i&vmask];
+            double vzi = vzptr[i&vmask];
+            double v2 = vxi*vxi + vyi*vyi + vzi*vzi;
+            out[i] = (_x-xptr[i])*vxi;
+            out[i] += (_y-yptr[i])*vyi;
+            out[i] += (_z-zptr[i])*vzi;
             out[i] /= v2;
-            out[i] -= _t-tptr[i];
-            out[i] *= 2 * PI / wptr[i];
+            out[i] -= _t-tptr[i&tmask];
+            out[i] *= 2 * PI / wptr[i&wmask];
         }
     }
 
@@ -141,19 +163,25 @@ namespace batoid {
         double* tptr = t.data;
         double* wptr = wavelength.data;
         double* outptr = reinterpret_cast<double*>(out);
+        size_t vmask = indexMask(vx);
+        size_t tmask = indexMask(t);
+        size_t wmask = indexMask(wavelength);
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for map(from:outptr[:2*size])
         #else
             #pragma omp parallel for
         #endif
         for(int i=0; i<size; i++) {
-            double v2 = vxptr[i]*vxptr[i] + vyptr[i]*vyptr[i] + vzptr[i]*vzptr[i];
-            double phase = (_x-xptr[i])*vxptr[i];
-            phase += (_y-yptr[i])*vyptr[i];
-            phase += (_z-zptr[i])*vzptr[i];
+            double vxi = vxptr[i&vmask];
+            double vyi = vyptr[i&vmask];
+            double vzi = vzptr[i&vmask];
+            double v2 = vxi*vxi + vyi*vyi + vzi*vzi;
+            double phase = (_x-xptr[i])*vxi;
+            phase += (_y-yptr[i])*vyi;
+            phase += (_z-zptr[i])*vzi;
             phase /= v2;
-            phase -= _t-tptr[i];
-            phase *= 2 * PI / wptr[i];
+            phase -= _t-tptr[i&tmask];
+            phase *= 2 * PI / wptr[i&wmask];
             outptr[2*i] = std::cos(phase);
             outptr[2*i+1] = std::sin(phase);
         }
@@ -187,45 +215,1024 @@ namespace batoid {
         double* tptr = t.data;
         double* wptr = wavelength.data;
         double* fluxptr = flux.data;
-        bool* vigptr = vignetted.data;
-        bool* failptr = failed.data;
+        uint64_t* vigptr = vignetted.data;
+        uint64_t* failptr = failed.data;
+        size_t nword = failed.size;
+        size_t off = flagOffset;
         double real=0;
         double imag=0;
+        size_t vmask = indexMask(vx);
+        size_t tmask = indexMask(t);
+        size_t wmask = indexMask(wavelength);
+        size_t fmask = indexMask(flux);
         #if defined(BATOID_GPU)
             #pragma omp target teams distribute parallel for reduction(+:real,imag)
         #else
             #pragma omp parallel for reduction(+:real, imag)
         #endif
+        for(int iw=0; iw<nword; iw++) {
+            uint64_t skip = failptr[iw];
+            if (ignoreVignetted)
+                skip |= vigptr[iw];
+            if (skip == ~uint64_t(0))
+                continue;
+            size_t i0 = 64*size_t(iw);
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+size-i0 < 64) ? int(off+size-i0) : 64;
+            for(int ib=ib0; ib<ib1; ib++) {
+                if ((skip >> ib) & 1)
+                    continue;
+                int i = i0+ib-off;
+                double vxi = vxptr[i&vmask];
+                double vyi = vyptr[i&vmask];
+                double vzi = vzptr[i&vmask];
+                double v2 = vxi*vxi + vyi*vyi + vzi*vzi;
+                double phase = (_x-xptr[i])*vxi;
+                phase += (_y-yptr[i])*vyi;
+                phase += (_z-zptr[i])*vzi;
+                phase /= v2;
+                phase -= _t-tptr[i&tmask];
+                phase *= 2 * PI / wptr[i&wmask];
+                real += std::cos(phase)*fluxptr[i&fmask];
+                imag += std::sin(phase)*fluxptr[i&fmask];
+            }
+        }
+        return std::complex<double>(real, imag);
+    }
+
+    #if defined(BATOID_GPU)
+        #pragma omp declare target
+    #endif
+
+    // sin and cos of x from a shared range reduction, in plain arithmetic so
+    // that the Huygens loops below vectorize.  Errors are below 1e-15 for
+    // |x| < 1e6; the polynomials are fdlibm's __kernel_sin and __kernel_cos.
+    struct SinCos { double s, c; };
+
+    static inline SinCos sincos_(double x) {
+        const double INV_PIO2 = 6.36619772367581382433e-01;
+        const double PIO2_1 = 1.57079632673412561417e+00;
+        const double PIO2_2 = 6.07710050650619224932e-11;
+        const double PIO2_3 = 2.02226624879595063154e-21;
+        const double ROUND = 6755399441055744.0;  // 1.5*2^52
+        // Round to the nearest quadrant; the low mantissa bits of qr are then
+        // the quadrant number, which selects and negates below with integer
+        // ops only.
+        double qr = x*INV_PIO2 + ROUND;
+        double q = qr - ROUND;
+        uint64_t k;
+        std::memcpy(&k, &qr, sizeof(k));
+        double r = ((x - q*PIO2_1) - q*PIO2_2) - q*PIO2_3;
+        double r2 = r*r;
+        double sr = r + r*r2*(-1.66666666666666324348e-01 + r2*(
+            8.33333333332248946124e-03 + r2*(-1.98412698298579493134e-04 + r2*(
+            2.75573137070700676789e-06 + r2*(-2.50507602534068634195e-08 + r2*
+            1.58969099521155010221e-10)))));
+        double cr = 1.0 - 0.5*r2 + r2*r2*(4.16666666666666019037e-02 + r2*(
+            -1.38888888888741095749e-03 + r2*(2.48015872894767294178e-05 + r2*(
+            -2.75573143513906633035e-07 + r2*(2.08757232129817482790e-09 + r2*
+            -1.13596475577881948265e-11)))));
+        uint64_t sbits, cbits;
+        std::memcpy(&sbits, &sr, sizeof(sbits));
+        std::memcpy(&cbits, &cr, sizeof(cbits));
+        uint64_t odd = -(k & 1);
+        uint64_t sout = (cbits & odd) | (sbits & ~odd);
+        uint64_t cout = (sbits & odd) | (cbits & ~odd);
+        sout ^= (k & 2) << 62;
+        cout ^= ((k+1) & 2) << 62;
+        SinCos result;
+        std::memcpy(&result.s, &sout, sizeof(sout));
+        std::memcpy(&result.c, &cout, sizeof(cout));
+        return result;
+    }
+
+    #if defined(BATOID_GPU)
+        #pragma omp end declare target
+    #endif
+
+    // Per-ray terms of the Huygens sum over a lattice r0 + iu*du + iv*dv.  The
+    // phase of ray j at lattice point (iu, iv) is a[j] + iu*bu[j] + iv*bv[j],
+    // where a is the sumAmplitude phase at r0.  Rays that sumAmplitude would
+    // skip are left out, so n <= size.
+    struct HuygensTerms {
+        double* a;
+        double* bu;
+        double* bv;
+        double* flux;
+        size_t n;
+
+        HuygensTerms(
+            const RayVector& rv, double x0, double y0, double z0, double t,
+            const double* du, const double* dv, bool ignoreVignetted
+        );
+        ~HuygensTerms();
+    };
+
+    HuygensTerms::HuygensTerms(
+        const RayVector& rv, double x0, double y0, double z0, double t,
+        const double* du, const double* dv, bool ignoreVignetted
+    ) {
+        const double PI = 3.14159265358979323846;
+        rv.x.syncToHost();
+        rv.y.syncToHost();
+        rv.z.syncToHost();
+        rv.vx.syncToHost();
+        rv.vy.syncToHost();
+        rv.vz.syncToHost();
+        rv.t.syncToHost();
+        rv.wavelength.syncToHost();
+        rv.flux.syncToHost();
+        rv.vignetted.syncToHost();
+        rv.failed.syncToHost();
+        double* xptr = rv.x.data;
+        double* yptr = rv.y.data;
+        double* zptr = rv.z.data;
+        double* vxptr = rv.vx.data;
+        double* vyptr = rv.vy.data;
+        double* vzptr = rv.vz.data;
+        double* tptr = rv.t.data;
+        double* wptr = rv.wavelength.data;
+        double* fluxptr = rv.flux.data;
+        uint64_t* vigptr = rv.vignetted.data;
+        uint64_t* failptr = rv.failed.data;
+        size_t size = rv.size;
+        size_t off = rv.flagOffset;
+        size_t nword = rv.failed.size;
+        size_t vmask = rv.indexMask(rv.vx);
+        size_t tmask = rv.indexMask(rv.t);
+        size_t wmask = rv.indexMask(rv.wavelength);
+        size_t fmask = rv.indexMask(rv.flux);
+
+        // Bits of the rays to keep in each flag word, and where each word's
+        // rays start in the compacted arrays.
+        uint64_t* keep = new uint64_t[nword];
+        size_t* start = new size_t[nword+1];
+        #pragma omp parallel for
+        for(int iw=0; iw<nword; iw++) {
+            size_t i0 = 64*size_t(iw);
+            int ib0 = (iw == 0) ? int(off) : 0;
+            int ib1 = (off+size-i0 < 64) ? int(off+size-i0) : 64;
+            uint64_t range = (ib1 == 64 ? ~uint64_t(0) : (uint64_t(1) << ib1) - 1);
+            range &= ~((uint64_t(1) << ib0) - 1);
+            uint64_t skip = failptr[iw];
+            if (ignoreVignetted)
+                skip |= vigptr[iw];
+            keep[iw] = range & ~skip;
+        }
+        start[0] = 0;
+        for(size_t iw=0; iw<nword; iw++)
+            start[iw+1] = start[iw] + __builtin_popcountll(keep[iw]);
+        n = start[nword];
+
+        a = new double[n];
+        bu = new double[n];
+        bv = new double[n];
+        flux = new double[n];
+        #pragma omp parallel for
+        for(int iw=0; iw<nword; iw++) {
+            uint64_t bits = keep[iw];
+            size_t j = start[iw];
+            for(int ib=0; ib<64; ib++) {
+                if (!((bits >> ib) & 1))
+                    continue;
+                int i = 64*size_t(iw)+ib-off;
+                double vxi = vxptr[i&vmask];
+                double vyi = vyptr[i&vmask];
+                double vzi = vzptr[i&vmask];
+                double v2 = vxi*vxi + vyi*vyi + vzi*vzi;
+                double scale = 2 * PI / wptr[i&wmask] / v2;
+                double phase = (x0-xptr[i])*vxi;
+                phase += (y0-yptr[i])*vyi;
+                phase += (z0-zptr[i])*vzi;
+                phase -= (t-tptr[i&tmask])*v2;
+                a[j] = phase*scale;
+                bu[j] = (du[0]*vxi + du[1]*vyi + du[2]*vzi)*scale;
+                bv[j] = (dv[0]*vxi + dv[1]*vyi + dv[2]*vzi)*scale;
+                flux[j] = fluxptr[i&fmask];
+                j++;
+            }
+        }
+        delete[] keep;
+        delete[] start;
+    }
+
+    HuygensTerms::~HuygensTerms() {
+        delete[] a;
+        delete[] bu;
+        delete[] bv;
+        delete[] flux;
+    }
+
+    // Huygens sums along rows of the lattice by phase recurrence: the phase of
+    // each ray grows by bu[j] from one point of a row to the next, so its
+    // phasor advances by a complex multiplication instead of a sin and cos.
+    // Rounding errors accumulate linearly, so phasors are recomputed exactly
+    // every resync points.
+    static void _sumAmplitudeRecurrence(
+        const HuygensTerms& terms, size_t nu, size_t nv, size_t resync,
+        size_t RB, double* outptr
+    ) {
+        const double* a = terms.a;
+        const double* bu = terms.bu;
+        const double* bv = terms.bv;
+        const double* fluxptr = terms.flux;
+        size_t n = terms.n;
+        double* stepc = new double[n];
+        double* steps = new double[n];
+        #pragma omp parallel for
+        for(int j=0; j<n; j++) {
+            SinCos sc = sincos_(bu[j]);
+            stepc[j] = sc.c;
+            steps[j] = sc.s;
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for(int iv=0; iv<nv; iv++) {
+            double* row = outptr + 2*iv*nu;
+            for(size_t iu=0; iu<2*nu; iu++)
+                row[iu] = 0;
+            double* c = new double[RB];
+            double* s = new double[RB];
+            for(size_t j0=0; j0<n; j0+=RB) {
+                size_t nb = (n-j0 < RB) ? n-j0 : RB;
+                const double* ab = a+j0;
+                const double* bub = bu+j0;
+                const double* bvb = bv+j0;
+                const double* fb = fluxptr+j0;
+                const double* scb = stepc+j0;
+                const double* ssb = steps+j0;
+                for(size_t iu=0; iu<nu; iu++) {
+                    double re = 0;
+                    double im = 0;
+                    if (iu % resync == 0) {
+                        double up = iu;
+                        double vp = iv;
+                        #pragma omp simd reduction(+:re,im)
+                        for(size_t k=0; k<nb; k++) {
+                            SinCos sc = sincos_(ab[k] + up*bub[k] + vp*bvb[k]);
+                            c[k] = sc.c;
+                            s[k] = sc.s;
+                            re += sc.c*fb[k];
+                            im += sc.s*fb[k];
+                        }
+                    } else {
+                        #pragma omp simd reduction(+:re,im)
+                        for(size_t k=0; k<nb; k++) {
+                            double cn = c[k]*scb[k] - s[k]*ssb[k];
+                            double sn = c[k]*ssb[k] + s[k]*scb[k];
+                            c[k] = cn;
+                            s[k] = sn;
+                            re += cn*fb[k];
+                            im += sn*fb[k];
+                        }
+                    }
+                    row[2*iu] += re;
+                    row[2*iu+1] += im;
+                }
+            }
+            delete[] c;
+            delete[] s;
+        }
+        delete[] stepc;
+        delete[] steps;
+    }
+
+    void RayVector::sumAmplitudeGrid(
+        double _x, double _y, double _z, double _t,
+        const double* du, const double* dv, size_t nu, size_t nv,
+        bool ignoreVignetted, std::complex<double>* out, size_t resync
+    ) const {
+        HuygensTerms terms(*this, _x, _y, _z, _t, du, dv, ignoreVignetted);
+        const double* a = terms.a;
+        const double* bu = terms.bu;
+        const double* bv = terms.bv;
+        const double* fluxptr = terms.flux;
+        size_t n = terms.n;
+        size_t npix = nu*nv;
+        double* outptr = reinterpret_cast<double*>(out);
+
+        #if defined(BATOID_GPU)
+            // One thread per pixel; the phase recurrence would need each
+            // thread to own rays instead, so resync is ignored here.
+            #pragma omp target teams distribute parallel for \
+                map(to:a[:n], bu[:n], bv[:n], fluxptr[:n]) \
+                map(from:outptr[:2*npix])
+            for(int ipix=0; ipix<npix; ipix++) {
+                double iu = ipix % nu;
+                double iv = ipix / nu;
+                double real = 0;
+                double imag = 0;
+                for(size_t j=0; j<n; j++) {
+                    double phase = a[j] + iu*bu[j] + iv*bv[j];
+                    SinCos sc = sincos_(phase);
+                    real += sc.c*fluxptr[j];
+                    imag += sc.s*fluxptr[j];
+                }
+                outptr[2*ipix] = real;
+                outptr[2*ipix+1] = imag;
+            }
+        #else
+            const size_t RB = 256;
+            if (resync) {
+                _sumAmplitudeRecurrence(terms, nu, nv, resync, RB, outptr);
+                return;
+            }
+            // Each task takes a tile of pixels and streams the rays through
+            // it one L1-sized block at a time, so every block loaded is used
+            // for all pixels of the tile.
+            const int PT = 16;
+            size_t ntile = (npix+PT-1)/PT;
+            #pragma omp parallel for schedule(dynamic)
+            for(int it=0; it<ntile; it++) {
+                size_t p0 = it*size_t(PT);
+                int np = (npix-p0 < PT) ? int(npix-p0) : PT;
+                double iu[PT], iv[PT], real[PT], imag[PT];
+                for(int p=0; p<np; p++) {
+                    iu[p] = (p0+p) % nu;
+                    iv[p] = (p0+p) / nu;
+                    real[p] = 0;
+                    imag[p] = 0;
+                }
+                for(size_t j0=0; j0<n; j0+=RB) {
+                    size_t j1 = (n-j0 < RB) ? n : j0+RB;
+                    for(int p=0; p<np; p++) {
+                        double up = iu[p];
+                        double vp = iv[p];
+                        double re = 0;
+                        double im = 0;
+                        #pragma omp simd reduction(+:re,im)
+                        for(size_t j=j0; j<j1; j++) {
+                            SinCos sc = sincos_(a[j] + up*bu[j] + vp*bv[j]);
+                            re += sc.c*fluxptr[j];
+                            im += sc.s*fluxptr[j];
+                        }
+                        real[p] += re;
+                        imag[p] += im;
+                    }
+                }
+                for(int p=0; p<np; p++) {
+                    outptr[2*(p0+p)] = real[p];
+                    outptr[2*(p0+p)+1] = imag[p];
+                }
+            }
+        #endif
+    }
+
+    void RayVector::spreadAmplitude(
+        double _x, double _y, double _z, double _t,
+        const double* du, const double* dv, size_t nu, size_t nv,
+        size_t mu, size_t mv, int nspread, double tauu, double tauv,
+        bool ignoreVignetted, std::complex<double>* grid
+    ) const {
+        // Spreading runs on the host; HuygensTerms has already synced there.
+        const double PI = 3.14159265358979323846;
+        HuygensTerms terms(*this, _x, _y, _z, _t, du, dv, ignoreVignetted);
+        size_t n = terms.n;
+        double hu = 2*PI/mu;
+        double hv = 2*PI/mv;
+        double su = double(nu/2);
+        double sv = double(nv/2);
+        int W = 2*nspread;
+
+        // Wrapped source positions, first grid cell of each window, and
+        // shifted amplitudes.
+        double* xs = new double[n];
+        double* ys = new double[n];
+        double* cre = new double[n];
+        double* cim = new double[n];
+        long* iu0 = new long[n];
+        long* iv0 = new long[n];
+        #pragma omp parallel for
+        for(int j=0; j<n; j++) {
+            double x = terms.bu[j] - 2*PI*std::nearbyint(terms.bu[j]/(2*PI));
+            double y = terms.bv[j] - 2*PI*std::nearbyint(terms.bv[j]/(2*PI));
+            SinCos sc = sincos_(terms.a[j] + su*x + sv*y);
+            xs[j] = x;
+            ys[j] = y;
+            cre[j] = sc.c*terms.flux[j];
+            cim[j] = sc.s*terms.flux[j];
+            iu0[j] = long(std::floor(x/hu)) - nspread + 1;
+            iv0[j] = long(std::floor(y/hv)) - nspread + 1;
+        }
+
+        // Bucket the rays by the block of grid rows their window starts in.
+        // Blocks are at least W rows, so a window touches only its own block
+        // and the next, and blocks of one color can be spread concurrently.
+        size_t nb = mv/W;
+        size_t rowsPerBlock = mv/nb;
+        size_t* bstart = new size_t[nb+1]();
+        size_t* order = new size_t[n];
+        size_t* blk = new size_t[n];
+        for(size_t j=0; j<n; j++) {
+            size_t row = size_t((iv0[j] % long(mv) + long(mv)) % long(mv));
+            size_t b = row/rowsPerBlock;
+            blk[j] = (b < nb) ? b : nb-1;
+            bstart[blk[j]+1]++;
+        }
+        for(size_t b=0; b<nb; b++)
+            bstart[b+1] += bstart[b];
+        {
+            size_t* fill = new size_t[nb];
+            std::memcpy(fill, bstart, nb*sizeof(size_t));
+            for(size_t j=0; j<n; j++)
+                order[fill[blk[j]]++] = j;
+            delete[] fill;
+        }
+        delete[] blk;
+
+        // Even blocks, then odd ones; with an odd count the last block
+        // wraps onto block 0 and gets a pass of its own.
+        int ncolor = (nb == 1) ? 1 : (nb%2 == 0) ? 2 : 3;
+        double* gptr = reinterpret_cast<double*>(grid);
+        #pragma omp parallel
+        {
+            double* wre = new double[W];
+            double* wim = new double[W];
+            for(int color=0; color<ncolor; color++) {
+                #pragma omp for schedule(dynamic)
+                for(int b=0; b<nb; b++) {
+                    int bc = (nb > 1 && nb%2 == 1 && b == nb-1) ? 2 : b%2;
+                    if (bc != color)
+                        continue;
+                    for(size_t k=bstart[b]; k<bstart[b+1]; k++) {
+                        size_t j = order[k];
+                        for(int c=0; c<W; c++) {
+                            double d = (iu0[j]+c)*hu - xs[j];
+                            double w = std::exp(-d*d/(4*tauu));
+                            wre[c] = w*cre[j];
+                            wim[c] = w*cim[j];
+                        }
+                        size_t col0 = size_t((iu0[j] % long(mu) + long(mu)) % long(mu));
+                        int n1 = (mu-col0 < size_t(W)) ? int(mu-col0) : W;
+                        for(int r=0; r<W; r++) {
+                            double d = (iv0[j]+r)*hv - ys[j];
+                            double w = std::exp(-d*d/(4*tauv));
+                            long row = (iv0[j]+r) % long(mv);
+                            if (row < 0) row += mv;
+                            double* g = gptr + 2*size_t(row)*mu;
+                            double* g1 = g + 2*col0;
+                            for(int c=0; c<n1; c++) {
+                                g1[2*c] += w*wre[c];
+                                g1[2*c+1] += w*wim[c];
+                            }
+                            for(int c=n1; c<W; c++) {
+                                g[2*(c-n1)] += w*wre[c];
+                                g[2*(c-n1)+1] += w*wim[c];
+                            }
+                        }
+                    }
+                }
+            }
+            delete[] wre;
+            delete[] wim;
+        }
+        delete[] xs;
+        delete[] ys;
+        delete[] cre;
+        delete[] cim;
+        delete[] iu0;
+        delete[] iv0;
+        delete[] bstart;
+        delete[] order;
+    }
+
+    void RayVector::gather(const int64_t* idx, RayVector& out) const {
+        // Selections are assembled on the host, where the caller will look at
+        // them anyway.
+        const DualView<double>* src[9] = {&x, &y, &z, &vx, &vy, &vz, &t, &wavelength, &flux};
+        DualView<double>* dst[9] = {&out.x, &out.y, &out.z, &out.vx, &out.vy, &out.vz, &out.t, &out.wavelength, &out.flux};
+        double* srcptr[9];
+        double* dstptr[9];
+        int nfield = 0;
+        for(int k=0; k<9; k++) {
+            if (!indexMask(*src[k]))
+                continue;  // Uniform; out already holds the shared value.
+            src[k]->syncToHost();
+            srcptr[nfield] = src[k]->data;
+            dstptr[nfield] = dst[k]->data;
+            nfield++;
+        }
+        vignetted.syncToHost();
+        failed.syncToHost();
+        uint64_t* vigptr = vignetted.data;
+        uint64_t* failptr = failed.data;
+        uint64_t* vigptr2 = out.vignetted.data;
+        uint64_t* failptr2 = out.failed.data;
+        size_t off = flagOffset;
+        size_t outsize = out.size;
+        size_t nword = out.failed.size;
+
+        // Each iteration owns one output flag word and the 64 rays it covers.
+        #pragma omp parallel for
+        for(int iw=0; iw<nword; iw++) {
+            size_t j0 = 64*size_t(iw);
+            int nbit = (outsize-j0 < 64) ? int(outsize-j0) : 64;
+            uint64_t vig = 0;
+            uint64_t fail = 0;
+            for(int ib=0; ib<nbit; ib++) {
+                size_t j = j0+ib;
+                size_t i = idx[j];
+                for(int k=0; k<nfield; k++)
+                    dstptr[k][j] = srcptr[k][i];
+                size_t bi = i+off;
+                vig |= ((vigptr[bi/64] >> (bi%64)) & 1) << ib;
+                fail |= ((failptr[bi/64] >> (bi%64)) & 1) << ib;
+            }
+            vigptr2[iw] = vig;
+            failptr2[iw] = fail;
+        }
+        for(int k=0; k<9; k++)
+            dst[k]->syncState = SyncState::host;
+        out.vignetted.syncState = SyncState::host;
+        out.failed.syncState = SyncState::host;
+    }
+
+    void RayVector::compact(const bool* mask, RayVector& out) const {
+        // Two passes over the mask: count the selected rays in each block,
+        // then write their indices at the block's running offset.
+        const size_t blocksize = 1<<14;
+        size_t nblock = (size+blocksize-1)/blocksize;
+        int64_t* start = new int64_t[nblock+1];
+        start[0] = 0;
+        #pragma omp parallel for
+        for(int ib=0; ib<nblock; ib++) {
+            size_t i1 = (ib+1)*blocksize < size ? (ib+1)*blocksize : size;
+            int64_t count = 0;
+            for(size_t i=ib*blocksize; i<i1; i++)
+                count += mask[i];
+            start[ib+1] = count;
+        }
+        for(size_t ib=0; ib<nblock; ib++)
+            start[ib+1] += start[ib];
+
+        int64_t* idx = new int64_t[out.size > 0 ? out.size : 1];
+        #pragma omp parallel for
+        for(int ib=0; ib<nblock; ib++) {
+            size_t i1 = (ib+1)*blocksize < size ? (ib+1)*blocksize : size;
+            int64_t j = start[ib];
+            for(size_t i=ib*blocksize; i<i1; i++)
+                if (mask[i])
+                    idx[j++] = i;
+        }
+        gather(idx, out);
+        delete[] idx;
+        delete[] start;
+    }
+
+    // Device address of host array p, which must be mapped.
+    template<typename T>
+    static T* _devicePtr(T* p) {
+        T* out = p;
+        #if defined(BATOID_GPU)
+            #pragma omp target data use_device_ptr(p)
+            {
+                out = p;
+            }
+        #endif
+        return out;
+    }
+
+    RaySegments::RaySegments(
+        const RayVector* const* rvs, size_t n, const RayDifferentials* diffs
+    ) : nray(0) {
+        segs.reserve(n);
+        wordStart.reserve(n+1);
+        wordStart.push_back(0);
+        for(size_t k=0; k<n; k++)
+            _add(*rvs[k], diffs && diffs[k].data ? &diffs[k] : nullptr);
+    }
+
+    RaySegments::RaySegments(const RayVector& rv, const RayDifferentials* diff) :
+        nray(0)
+    {
+        wordStart.push_back(0);
+        _add(rv, diff && diff->data ? diff : nullptr);
+    }
+
+    RaySegments::~RaySegments() {
+        #if defined(BATOID_GPU)
+            for(auto& mapped : _mappedDiffs) {
+                double* d = mapped.first;
+                size_t dsize = mapped.second;
+                #pragma omp target exit data map(from:d[:dsize])
+            }
+        #endif
+    }
+
+    void RaySegments::_add(const RayVector& rv, const RayDifferentials* diff) {
+        rv.x.syncToDevice();
+        rv.y.syncToDevice();
+        rv.z.syncToDevice();
+        rv.vx.syncToDevice();
+        rv.vy.syncToDevice();
+        rv.vz.syncToDevice();
+        rv.t.syncToDevice();
+        rv.wavelength.syncToDevice();
+        rv.flux.syncToDevice();
+        rv.vignetted.syncToDevice();
+        rv.failed.syncToDevice();
+        RaySegment seg;
+        seg.x = _devicePtr(rv.x.data);
+        seg.y = _devicePtr(rv.y.data);
+        seg.z = _devicePtr(rv.z.data);
+        seg.vx = _devicePtr(rv.vx.data);
+        seg.vy = _devicePtr(rv.vy.data);
+        seg.vz = _devicePtr(rv.vz.data);
+        seg.t = _devicePtr(rv.t.data);
+        seg.wavelength = _devicePtr(rv.wavelength.data);
+        seg.flux = _devicePtr(rv.flux.data);
+        seg.vignetted = _devicePtr(rv.vignetted.data);
+        seg.failed = _devicePtr(rv.failed.data);
+        seg.size = rv.size;
+        seg.flagOffset = rv.flagOffset;
+        seg.vmask = rv.indexMask(rv.vx);
+        seg.tmask = rv.indexMask(rv.t);
+        seg.wmask = rv.indexMask(rv.wavelength);
+        seg.fmask = rv.indexMask(rv.flux);
+        seg.diff = RayDifferentials{nullptr, 0, 0};
+        if (diff) {
+            double* d = diff->data;
+            #if defined(BATOID_GPU)
+                size_t dsize = (7*diff->nd-1)*diff->stride+rv.size;
+                #pragma omp target enter data map(to:d[:dsize])
+                _mappedDiffs.emplace_back(d, dsize);
+            #endif
+            seg.diff = RayDifferentials{_devicePtr(d), diff->nd, diff->stride};
+        }
+        seg.word0 = wordStart.back();
+        seg.ray0 = nray;
+        segs.push_back(seg);
+        wordStart.push_back(seg.word0 + rv.failed.size);
+        nray += rv.size;
+    }
+
+    void RaySegments::stats(
+        const size_t* bounds, size_t nseg, bool weighted, bool ignoreVignetted,
+        double* out
+    ) const {
+        const RaySegment* segptr = segs.data();
+        const size_t* wordptr = wordStart.data();
+        size_t nsegs = segs.size();
+        size_t nword = wordStart.back();
+        size_t first = bounds[0];
+        size_t last = bounds[nseg];
+
+        // First pass: count, weight and weighted sums of x, y, z, t.  Second
+        // pass: second moments about the means, which avoids the
+        // cancellation of a one-pass variance for small spots far from the
+        // origin.
+        size_t nsum1 = 6*nseg;
+        size_t nsum2 = 3*nseg;
+        double* sum1 = new double[nsum1]();
+        double* sum2 = new double[nsum2]();
+        double* mean = new double[2*nseg];
+        for(int pass=0; pass<2; pass++) {
+            #if defined(BATOID_GPU)
+                #pragma omp target teams distribute parallel for \
+                    map(to:segptr[:nsegs], wordptr[:nsegs+1]) \
+                    map(to:bounds[:nseg+1], mean[:2*nseg]) \
+                    reduction(+:sum1[:nsum1], sum2[:nsum2])
+            #else
+                #pragma omp parallel for reduction(+:sum1[:nsum1], sum2[:nsum2])
+            #endif
+            for(int jw=0; jw<nword; jw++) {
+                const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+                size_t iw = jw-seg.word0;
+                uint64_t skip = seg.failed[iw];
+                if (ignoreVignetted)
+                    skip |= seg.vignetted[iw];
+                if (skip == ~uint64_t(0))
+                    continue;
+                size_t off = seg.flagOffset;
+                size_t i0 = 64*iw;
+                int ib0 = (iw == 0) ? int(off) : 0;
+                int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+                size_t k = _segmentOf(bounds, nseg, seg.ray0+i0+ib0-off);
+                for(int ib=ib0; ib<ib1; ib++) {
+                    if ((skip >> ib) & 1)
+                        continue;
+                    size_t i = i0+ib-off;
+                    size_t ig = seg.ray0+i;
+                    if (ig < first || ig >= last)
+                        continue;
+                    while (ig >= bounds[k+1])
+                        k++;
+                    double w = weighted ? seg.flux[i&seg.fmask] : 1.0;
+                    if (pass == 0) {
+                        sum1[6*k] += 1.0;
+                        sum1[6*k+1] += w;
+                        sum1[6*k+2] += w*seg.x[i];
+                        sum1[6*k+3] += w*seg.y[i];
+                        sum1[6*k+4] += w*seg.z[i];
+                        sum1[6*k+5] += w*seg.t[i&seg.tmask];
+                    } else {
+                        double dx = seg.x[i]-mean[2*k];
+                        double dy = seg.y[i]-mean[2*k+1];
+                        sum2[3*k] += w*dx*dx;
+                        sum2[3*k+1] += w*dx*dy;
+                        sum2[3*k+2] += w*dy*dy;
+                    }
+                }
+            }
+            if (pass == 0) {
+                for(size_t k=0; k<nseg; k++) {
+                    mean[2*k] = sum1[6*k+2]/sum1[6*k+1];
+                    mean[2*k+1] = sum1[6*k+3]/sum1[6*k+1];
+                }
+            }
+        }
+
+        for(size_t k=0; k<nseg; k++) {
+            double w = sum1[6*k+1];
+            double* o = out + 9*k;
+            o[0] = sum1[6*k];
+            o[1] = w;
+            o[2] = sum1[6*k+2]/w;
+            o[3] = sum1[6*k+3]/w;
+            o[4] = sum1[6*k+4]/w;
+            o[5] = sum1[6*k+5]/w;
+            o[6] = sum2[3*k]/w;
+            o[7] = sum2[3*k+1]/w;
+            o[8] = sum2[3*k+2]/w;
+        }
+        delete[] sum1;
+        delete[] sum2;
+        delete[] mean;
+    }
+
+    void RayVector::stats(
+        const size_t* bounds, size_t nseg, bool weighted, bool ignoreVignetted,
+        double* out
+    ) const {
+        RaySegments(*this).stats(bounds, nseg, weighted, ignoreVignetted, out);
+    }
+
+    void RaySegments::focus(
+        const size_t* bounds, size_t nseg, const double* point,
+        const double* axis, bool weighted, bool ignoreVignetted, double* out
+    ) const {
+        const RaySegment* segptr = segs.data();
+        const size_t* wordptr = wordStart.data();
+        size_t nsegs = segs.size();
+        size_t nword = wordStart.back();
+        size_t first = bounds[0];
+        size_t last = bounds[nseg];
+        double qx = point[0], qy = point[1], qz = point[2];
+        double ax = axis[0], ay = axis[1], az = axis[2];
+
+        // All positions are taken relative to point.  First pass: counts,
+        // weights, sums of the closest approach points and axis parameters,
+        // and the normal equations sum(w (I - u u^T)) f = sum(w (I - u u^T) p)
+        // for the best focus f.  Second pass: spread of the axis parameters
+        // and distances of the rays from the best focus, about the first pass
+        // results.
+        size_t nsum1 = 18*nseg;
+        size_t nsum2 = 2*nseg;
+        double* sum1 = new double[nsum1]();
+        double* sum2 = new double[nsum2]();
+        // Mean axis parameter and best focus of each range.
+        double* ref = new double[4*nseg];
+        for(int pass=0; pass<2; pass++) {
+            #if defined(BATOID_GPU)
+                #pragma omp target teams distribute parallel for \
+                    map(to:segptr[:nsegs], wordptr[:nsegs+1]) \
+                    map(to:bounds[:nseg+1], ref[:4*nseg]) \
+                    reduction(+:sum1[:nsum1], sum2[:nsum2])
+            #else
+                #pragma omp parallel for reduction(+:sum1[:nsum1], sum2[:nsum2])
+            #endif
+            for(int jw=0; jw<nword; jw++) {
+                const RaySegment& seg = segptr[_segmentOf(wordptr, nsegs, jw)];
+                size_t iw = jw-seg.word0;
+                uint64_t skip = seg.failed[iw];
+                if (ignoreVignetted)
+                    skip |= seg.vignetted[iw];
+                if (skip == ~uint64_t(0))
+                    continue;
+                size_t off = seg.flagOffset;
+                size_t i0 = 64*iw;
+                int ib0 = (iw == 0) ? int(off) : 0;
+                int ib1 = (off+seg.size-i0 < 64) ? int(off+seg.size-i0) : 64;
+                size_t k = _segmentOf(bounds, nseg, seg.ray0+i0+ib0-off);
+                for(int ib=ib0; ib<ib1; ib++) {
+                    if ((skip >> ib) & 1)
+                        continue;
+                    size_t i = i0+ib-off;
+                    size_t ig = seg.ray0+i;
+                    if (ig < first || ig >= last)
+                        continue;
+                    while (ig >= bounds[k+1])
+                        k++;
+                    double w = weighted ? seg.flux[i&seg.fmask] : 1.0;
+                    double px = seg.x[i]-qx;
+                    double py = seg.y[i]-qy;
+                    double pz = seg.z[i]-qz;
+                    double ux = seg.vx[i&seg.vmask];
+                    double uy = seg.vy[i&seg.vmask];
+                    double uz = seg.vz[i&seg.vmask];
+                    double norm = 1.0/std::sqrt(ux*ux + uy*uy + uz*uz);
+                    ux *= norm;
+                    uy *= norm;
+                    uz *= norm;
+                    // Closest approach of the ray p + s u to the axis t a.
+                    // With n = u x a, sc = -(p x a).n/|n|^2 and tc =
+                    // -(p x u).n/|n|^2; unlike 1 - (u.a)^2, |n|^2 has no
+                    // cancellation for rays nearly along the axis, so only
+                    // exactly parallel rays are left out.
+                    double nx = uy*az - uz*ay;
+                    double ny = uz*ax - ux*az;
+                    double nz = ux*ay - uy*ax;
+                    double den = nx*nx + ny*ny + nz*nz;
+                    bool parallel = den == 0.0;
+                    double tc = 0.0;
+                    if (!parallel) {
+                        double pux = py*uz - pz*uy;
+                        double puy = pz*ux - px*uz;
+                        double puz = px*uy - py*ux;
+                        tc = -(pux*nx + puy*ny + puz*nz)/den;
+                    }
+                    if (pass == 0) {
+                        double* s1 = sum1 + 18*k;
+                        s1[0] += 1.0;
+                        s1[1] += w;
+                        if (parallel) {
+                            s1[3] += 1.0;
+                        } else {
+                            double pax = py*az - pz*ay;
+                            double pay = pz*ax - px*az;
+                            double paz = px*ay - py*ax;
+                            double sc = -(pax*nx + pay*ny + paz*nz)/den;
+                            double cx = px + sc*ux;
+                            double cy = py + sc*uy;
+                            double cz = pz + sc*uz;
+                            double mx = cx - tc*ax;
+                            double my = cy - tc*ay;
+                            double mz = cz - tc*az;
+                            s1[2] += w;
+                            s1[4] += w*cx;
+                            s1[5] += w*cy;
+                            s1[6] += w*cz;
+                            s1[7] += w*tc;
+                            s1[8] += w*(mx*mx + my*my + mz*mz);
+                        }
+                        double mxx = w*(1.0-ux*ux);
+                        double mxy = -w*ux*uy;
+                        double mxz = -w*ux*uz;
+                        double myy = w*(1.0-uy*uy);
+                        double myz = -w*uy*uz;
+                        double mzz = w*(1.0-uz*uz);
+                        s1[9] += mxx;
+                        s1[10] += mxy;
+                        s1[11] += mxz;
+                        s1[12] += myy;
+                        s1[13] += myz;
+                        s1[14] += mzz;
+                        s1[15] += mxx*px + mxy*py + mxz*pz;
+                        s1[16] += mxy*px + myy*py + myz*pz;
+                        s1[17] += mxz*px + myz*py + mzz*pz;
+                    } else {
+                        if (!parallel) {
+                            double dt = tc - ref[4*k];
+                            sum2[2*k] += w*dt*dt;
+                        }
+                        double fx = ref[4*k+1] - px;
+                        double fy = ref[4*k+2] - py;
+                        double fz = ref[4*k+3] - pz;
+                        // Distance from the ray is |(f - p) x u|.
+                        double dx = fy*uz - fz*uy;
+                        double dy = fz*ux - fx*uz;
+                        double dz = fx*uy - fy*ux;
+                        sum2[2*k+1] += w*(dx*dx + dy*dy + dz*dz);
+                    }
+                }
+            }
+            if (pass == 0) {
+                for(size_t k=0; k<nseg; k++) {
+                    const double* s1 = sum1 + 18*k;
+                    ref[4*k] = s1[7]/s1[2];
+                    // Solve the symmetric normal equations by Cramer's rule.
+                    // When the rays are (nearly) all parallel there is no
+                    // focus.
+                    double c00 = s1[12]*s1[14] - s1[13]*s1[13];
+                    double c01 = s1[11]*s1[13] - s1[10]*s1[14];
+                    double c02 = s1[10]*s1[13] - s1[11]*s1[12];
+                    double c11 = s1[9]*s1[14] - s1[11]*s1[11];
+                    double c12 = s1[10]*s1[11] - s1[9]*s1[13];
+                    double c22 = s1[9]*s1[12] - s1[10]*s1[10];
+                    double det = s1[9]*c00 + s1[10]*c01 + s1[11]*c02;
+                    double tr = (s1[9] + s1[12] + s1[14])/3;
+                    if (!(det > 1e-12*tr*tr*tr)) {
+                        ref[4*k+1] = ref[4*k+2] = ref[4*k+3] = NAN;
+                        continue;
+                    }
+                    ref[4*k+1] = (c00*s1[15] + c01*s1[16] + c02*s1[17])/det;
+                    ref[4*k+2] = (c01*s1[15] + c11*s1[16] + c12*s1[17])/det;
+                    ref[4*k+3] = (c02*s1[15] + c12*s1[16] + c22*s1[17])/det;
+                }
+            }
+        }
+
+        for(size_t k=0; k<nseg; k++) {
+            const double* s1 = sum1 + 18*k;
+            double wa = s1[2];
+            double* o = out + 12*k;
+            o[0] = s1[0];
+            o[1] = s1[1];
+            o[2] = qx + s1[4]/wa;
+            o[3] = qy + s1[5]/wa;
+            o[4] = qz + s1[6]/wa;
+            o[5] = std::sqrt(sum2[2*k]/wa);
+            o[6] = std::sqrt(s1[8]/wa);
+            o[7] = qx + ref[4*k+1];
+            o[8] = qy + ref[4*k+2];
+            o[9] = qz + ref[4*k+3];
+            o[10] = std::sqrt(sum2[2*k+1]/s1[1]);
+            o[11] = s1[3];
+        }
+        delete[] sum1;
+        delete[] sum2;
+        delete[] ref;
+    }
+
+    void RayVector::focus(
+        const size_t* bounds, size_t nseg, const double* point,
+        const double* axis, bool weighted, bool ignoreVignetted, double* out
+    ) const {
+        RaySegments(*this).focus(
+            bounds, nseg, point, axis, weighted, ignoreVignetted, out
+        );
+    }
+
+    // Compare fields of two RayVectors of the same size, either of which may be
+    // uniform.
+    static bool fieldEqual(
+        const DualView<double>& lhs, const DualView<double>& rhs, size_t size
+    ) {
+        if (lhs.size == rhs.size)
+            return lhs == rhs;
+        lhs.syncToHost();
+        rhs.syncToHost();
+        size_t lmask = lhs.size == size ? ~size_t(0) : 0;
+        size_t rmask = rhs.size == size ? ~size_t(0) : 0;
+        bool result{true};
+        #pragma omp parallel for reduction(&:result)
         for(int i=0; i<size; i++) {
-            double v2 = vxptr[i]*vxptr[i] + vyptr[i]*vyptr[i] + vzptr[i]*vzptr[i];
-            double phase = (_x-xptr[i])*vxptr[i];
-            phase += (_y-yptr[i])*vyptr[i];
-            phase += (_z-zptr[i])*vzptr[i];
-            phase /= v2;
-            phase -= _t-tptr[i];
-            phase *= 2 * PI / wptr[i];
+            result &= lhs.data[i&lmask] == rhs.data[i&rmask];
+        }
+        return result;
+    }
 
-            if (!failptr[i] && !(ignoreVignetted && vigptr[i])) {
-                real += std::cos(phase)*fluxptr[i];
-                imag += std::sin(phase)*fluxptr[i];
+    // Compare packed flags ray by ray, since either side may be a view with its
+    // own bit offset.
+    static bool flagsEqual(
+        const DualView<uint64_t>& lhs, size_t loff,
+        const DualView<uint64_t>& rhs, size_t roff,
+        size_t size
+    ) {
+        if (loff == 0 && roff == 0) {
+            // Only whole words can be compared directly; the last may carry
+            // bits of a parent RayVector past the end.
+            lhs.syncToHost();
+            rhs.syncToHost();
+            size_t nfull = size/64;
+            uint64_t tail = (uint64_t(1) << (size%64)) - 1;
+            bool result{true};
+            #pragma omp parallel for reduction(&:result)
+            for(int iw=0; iw<nfull; iw++) {
+                result &= lhs.data[iw] == rhs.data[iw];
             }
+            if (tail)
+                result &= ((lhs.data[nfull] ^ rhs.data[nfull]) & tail) == 0;
+            return result;
         }
-        return std::complex<double>(real, imag);
+        lhs.syncToHost();
+        rhs.syncToHost();
+        bool result{true};
+        #pragma omp parallel for reduction(&:result)
+        for(int i=0; i<size; i++) {
+            size_t li = i+loff;
+            size_t ri = i+roff;
+            bool lbit = (lhs.data[li/64] >> (li%64)) & 1;
+            bool rbit = (rhs.data[ri/64] >> (ri%64)) & 1;
+            result &= lbit == rbit;
+        }
+        return result;
     }
 
     bool RayVector::operator==(const RayVector& rhs) const {
         return (
-            x == rhs.x
+            size == rhs.size
+            && x == rhs.x
             && y == rhs.y
             && z == rhs.z
-            && vx == rhs.vx
-            && vy == rhs.vy
-            && vz == rhs.vz
-            && t == rhs.t
-            && wavelength == rhs.wavelength
-            && flux == rhs.flux
-            && vignetted == rhs.vignetted
-            && failed == rhs.failed
+            && fieldEqual(vx, rhs.vx, size)
+            && fieldEqual(vy, rhs.vy, size)
+            && fieldEqual(vz, rhs.vz, size)
+            && fieldEqual(t, rhs.t, size)
+            && fieldEqual(wavelength, rhs.wavelength, size)
+            && fieldEqual(flux, rhs.flux, size)
+            && flagsEqual(vignetted, flagOffset, rhs.vignetted, rhs.flagOffset, size)
+            && flagsEqual(failed, flagOffset, rhs.failed, rhs.flagOffset, size)
         );
     }
 
@@ -71,6 +71,20 @@ namespace batoid {
         return rat/sqrt(1-rat*rat);
     }
 
+    void Sphere::hessian(
+        double x, double y,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) const {
+        if (_R == 0.0) {
+            dzdxx = 0.0;
+            dzdxy = 0.0;
+            dzdyy = 0.0;
+            return;
+        }
+        double s = std::sqrt(1-(x*x + y*y)*_Rinvsq);
+        _radialHessian(x, y, _Rinv/s, _Rinv/(s*s*s), dzdxx, dzdxy, dzdyy);
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
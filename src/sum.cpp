@@ -55,6 +55,22 @@ namespace batoid {
         return Surface::timeToIntersect(x, y, z, vx, vy, vz, dt);
     }
 
+    void Sum::hessian(
+        double x, double y,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) const {
+        dzdxx = 0.0;
+        dzdxy = 0.0;
+        dzdyy = 0.0;
+        for (int i=0; i<_nsurf; i++) {
+            double hxx, hxy, hyy;
+            _surfaces[i]->hessian(x, y, hxx, hxy, hyy);
+            dzdxx += hxx;
+            dzdxy += hxy;
+            dzdyy += hyy;
+        }
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
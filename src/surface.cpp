@@ -60,6 +60,42 @@ namespace batoid {
         dzdy = -ny/nz;
     }
 
+    void Surface::hessian(
+        double x, double y,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) const {
+        // Step in meters; rounding and truncation errors are both near 1e-10
+        // relative for surfaces curved on scales of centimeters or more.
+        const double h = 1e-5;
+        double gxp, gyp, gxm, gym;
+        grad(x+h, y, gxp, gyp);
+        grad(x-h, y, gxm, gym);
+        dzdxx = (gxp-gxm)/(2*h);
+        double dzdyx = (gyp-gym)/(2*h);
+        grad(x, y+h, gxp, gyp);
+        grad(x, y-h, gxm, gym);
+        dzdyy = (gyp-gym)/(2*h);
+        dzdxy = 0.5*(dzdyx + (gxp-gxm)/(2*h));
+    }
+
+    void Surface::_radialHessian(
+        double x, double y, double dzdr_r, double d2zdr2,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) {
+        double rsqr = x*x + y*y;
+        if (rsqr == 0.0) {
+            dzdxx = d2zdr2;
+            dzdxy = 0.0;
+            dzdyy = d2zdr2;
+            return;
+        }
+        double cxx = x*x/rsqr;
+        double cyy = y*y/rsqr;
+        dzdxx = d2zdr2*cxx + dzdr_r*cyy;
+        dzdxy = (d2zdr2-dzdr_r)*x*y/rsqr;
+        dzdyy = d2zdr2*cyy + dzdr_r*cxx;
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
@@ -36,6 +36,15 @@ namespace batoid {
         return true;
     }
 
+    void Tilted::hessian(
+        double x, double y,
+        double& dzdxx, double& dzdxy, double& dzdyy
+    ) const {
+        dzdxx = 0.0;
+        dzdxy = 0.0;
+        dzdyy = 0.0;
+    }
+
     #if defined(BATOID_GPU)
         #pragma omp end declare target
     #endif
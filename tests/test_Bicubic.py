@@ -446,6 +446,57 @@ def test_fail():
     np.testing.assert_equal(rv2.failed, np.array([False]))
 
 
+@timer
+def test_tabulated():
+    rng = np.random.default_rng(5772156649)
+    xtest = rng.uniform(-0.9, 0.9, size=1000)
+    ytest = rng.uniform(-0.9, 0.9, size=1000)
+
+    for i in range(3):
+        asphere = batoid.Asphere(
+            rng.normal(20.0, 1.0), rng.uniform(-2.0, 1.0),
+            [rng.normal(0, 1e-10) for _ in range(3)]
+        )
+        zernike = batoid.Zernike(
+            rng.normal(0, 1e-7, size=23), R_outer=1.3
+        )
+        surface = batoid.Sum(asphere, zernike)
+        bc = surface.tabulated(1000, tolerance=1e-11, radius=1.3)
+        assert isinstance(bc, batoid.Bicubic)
+
+        np.testing.assert_allclose(
+            surface.sag(xtest, ytest),
+            bc.sag(xtest, ytest),
+            atol=1e-11, rtol=0
+        )
+        np.testing.assert_allclose(
+            surface.normal(xtest, ytest),
+            bc.normal(xtest, ytest),
+            atol=1e-9, rtol=0
+        )
+
+        rv = batoid.RayVector(
+            xtest, ytest, np.full_like(xtest, -1.0),
+            rng.uniform(-1e-3, 1e-3, size=1000),
+            rng.uniform(-1e-3, 1e-3, size=1000),
+            np.ones_like(xtest)
+        )
+        rays_allclose(
+            batoid.intersect(surface, rv.copy()),
+            batoid.intersect(bc, rv.copy()),
+            atol=1e-10
+        )
+
+    # Coarse grid can't meet a tight tolerance
+    with np.testing.assert_raises(ValueError):
+        surface.tabulated(10, tolerance=1e-12, radius=1.3)
+
+    # Need at least two grid points per axis
+    for resolution in [0, 1]:
+        with np.testing.assert_raises(ValueError):
+            surface.tabulated(resolution)
+
+
 if __name__ == '__main__':
     init_gpu()
     test_properties()
@@ -455,5 +506,6 @@ if __name__ == '__main__':
     test_reflect()
     test_refract()
     test_asphere_approximation()
+    test_tabulated()
     test_ne()
     test_fail()
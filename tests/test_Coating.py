@@ -75,12 +75,145 @@ def test_refract():
         assert(rv.flux[0] == transmissivity)
 
 
+@timer
+def test_TableCoating():
+    rng = np.random.default_rng(57721)
+    ws = np.linspace(400e-9, 1000e-9, 13)
+    cs = np.linspace(0, 1, 11)
+    reflect = rng.uniform(0, 1, size=(13, 11))
+    transmit = 1 - reflect
+    tc = batoid.TableCoating(ws, cs, reflect, transmit)
+    do_pickle(tc)
+
+    # Exact at grid points
+    for iw, ic in zip(rng.integers(13, size=20), rng.integers(11, size=20)):
+        r, t = tc.getCoefs(ws[iw], cs[ic])
+        np.testing.assert_allclose(r, reflect[iw, ic], rtol=0, atol=1e-14)
+        np.testing.assert_allclose(t, transmit[iw, ic], rtol=0, atol=1e-14)
+        # Only the magnitude of the incidence cosine matters
+        assert tc.getCoefs(ws[iw], -cs[ic]) == (r, t)
+
+    # Bilinear in between
+    from scipy.interpolate import RegularGridInterpolator
+    interp = RegularGridInterpolator((ws, cs), reflect)
+    for _ in range(100):
+        w = rng.uniform(ws[0], ws[-1])
+        c = rng.uniform(0, 1)
+        np.testing.assert_allclose(
+            tc.getReflect(w, c), interp([w, c])[0], rtol=0, atol=1e-14
+        )
+        np.testing.assert_allclose(
+            tc.getTransmit(w, c), 1-interp([w, c])[0], rtol=0, atol=1e-14
+        )
+
+    # Clamped outside
+    assert tc.getCoefs(300e-9, 0.0) == tc.getCoefs(400e-9, 0.0)
+    assert tc.getCoefs(1100e-9, 1.0) == tc.getCoefs(1000e-9, 1.0)
+
+
+@timer
+def test_MultilayerCoating():
+    import yaml
+    rng = np.random.default_rng(577215)
+    air = batoid.ConstMedium(1.0)
+    glass = batoid.ConstMedium(1.5)
+
+    # No layers is a bare Fresnel interface
+    bare = batoid.MultilayerCoating([], air, glass)
+    for _ in range(100):
+        w = rng.uniform(300e-9, 1200e-9)
+        ci = rng.uniform(0.3, 1.0)
+        ct = np.sqrt(1 - (1-ci**2)/1.5**2)
+        rs = (ci - 1.5*ct)/(ci + 1.5*ct)
+        rp = (1.5*ci - ct)/(1.5*ci + ct)
+        r, t = bare.getCoefs(w, ci)
+        np.testing.assert_allclose(r, 0.5*(rs**2 + rp**2), rtol=0, atol=1e-3)
+        np.testing.assert_allclose(r+t, 1.0, rtol=0, atol=1e-12)
+    np.testing.assert_allclose(bare.getReflect(500e-9, 1.0), 0.04, atol=1e-12)
+
+    # Quarter-wave antireflection coating
+    nl = np.sqrt(1.5)
+    ar = batoid.MultilayerCoating(
+        [(batoid.ConstMedium(nl), 550e-9/(4*nl))], air, glass,
+        nwavelength=901
+    )
+    np.testing.assert_allclose(ar.getReflect(550e-9, 1.0), 0.0, atol=1e-12)
+    assert ar.getReflect(550e-9, 1.0) < ar.getReflect(400e-9, 1.0) < 0.04
+    do_pickle(ar)
+
+    # Lossless stack conserves energy everywhere, including total internal
+    # reflection from the glass side.
+    stack = batoid.MultilayerCoating(
+        [
+            (batoid.ConstMedium(2.3), 80e-9),
+            (batoid.ConstMedium(1.38), 120e-9),
+            (batoid.ConstMedium(2.3), 60e-9),
+        ],
+        glass, air
+    )
+    r = stack.table.reflect
+    t = stack.table.transmit
+    np.testing.assert_allclose(r+t, 1.0, rtol=0, atol=1e-12)
+    assert np.all(r >= 0) and np.all(t >= 0)
+    tir = stack.table.cosIncidenceAngles < np.sqrt(1-1/1.5**2)
+    np.testing.assert_allclose(r[:, tir], 1.0, rtol=0, atol=1e-12)
+
+    # rSplit conserves flux
+    x = rng.uniform(-0.1, 0.1, size=1000)
+    y = rng.uniform(-0.1, 0.1, size=1000)
+    vx = rng.uniform(-0.1, 0.1, size=1000)
+    vy = rng.uniform(-0.1, 0.1, size=1000)
+    vz = np.sqrt(1 - vx*vx - vy*vy)
+    wavelength = rng.uniform(300e-9, 1200e-9, size=1000)
+    rv = batoid.RayVector(
+        x, y, -1.0, vx, vy, vz, 0.0, wavelength, 1.0
+    )
+    trv, rrv = batoid.Sphere(5.0).rSplit(rv, air, glass, ar)
+    np.testing.assert_allclose(rrv.flux + trv.flux, 1.0, rtol=0, atol=1e-12)
+    assert np.all(rrv.flux < 0.05)
+
+    # YAML, with media defaulting to those of the optic
+    config = yaml.safe_load(f"""
+        type: RefractiveInterface
+        surface:
+          type: Plane
+        inMedium: 1.0
+        outMedium: 1.5
+        forwardCoating:
+          type: MultilayerCoating
+          layers:
+            - medium: {nl}
+              thickness: {550e-9/(4*nl)}
+          nwavelength: 901
+        reverseCoating:
+          type: SimpleCoating
+          reflectivity: 0.02
+          transmissivity: 0.98
+    """)
+    optic = batoid.parse.parse_optic(config)
+    assert optic.forwardCoating == ar
+    assert optic.reverseCoating == batoid.SimpleCoating(0.02, 0.98)
+
+
 @timer
 def test_ne():
     objs = [
         batoid.SimpleCoating(0.0, 1.0),
         batoid.SimpleCoating(0.0, 0.1),
         batoid.SimpleCoating(0.1, 0.1),
+        batoid.TableCoating([0, 1], [0, 1], [[0, 1], [0, 1]], [[1, 0], [1, 0]]),
+        batoid.TableCoating([0, 1], [0, 1], [[0, 1], [0, 1]], [[1, 0], [1, 1]]),
+        batoid.MultilayerCoating(
+            [], batoid.ConstMedium(1.0), batoid.ConstMedium(1.5)
+        ),
+        batoid.MultilayerCoating(
+            [(batoid.ConstMedium(1.3), 1e-7)],
+            batoid.ConstMedium(1.0), batoid.ConstMedium(1.5)
+        ),
+        batoid.MultilayerCoating(
+            [(batoid.ConstMedium(1.3), 1e-7)],
+            batoid.ConstMedium(1.0), batoid.ConstMedium(1.5), ncos=11
+        ),
         batoid.CoordSys()
     ]
     all_obj_diff(objs)
@@ -91,4 +224,6 @@ if __name__ == '__main__':
     test_intersect()
     test_reflect()
     test_refract()
+    test_TableCoating()
+    test_MultilayerCoating()
     test_ne()
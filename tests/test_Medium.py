@@ -42,6 +42,56 @@ def test_TableMedium():
         )
     do_pickle(table_medium)
 
+    # Non-uniform spacing uses the binary search path
+    for i in range(100):
+        ws = np.sort(rng.uniform(300e-9, 1100e-9, size=50))
+        ws[0], ws[-1] = 300e-9, 1100e-9
+        ns = rng.uniform(1.0, 1.5, size=50)
+        table_medium = batoid.TableMedium(ws, ns)
+        testws = rng.uniform(300e-9, 1100e-9, size=100)
+        np.testing.assert_allclose(
+            table_medium.getN(testws),
+            np.interp(testws, ws, ns),
+            rtol=0, atol=1e-14
+        )
+        # Table endpoints are inside the domain
+        np.testing.assert_allclose(
+            table_medium.getN(ws[[0, -1]]), ns[[0, -1]], rtol=0, atol=1e-14
+        )
+        assert np.isnan(table_medium.getN(1200e-9))
+        assert np.isnan(table_medium.getN(200e-9))
+
+    # Batch evaluation preserves shape
+    testws = rng.uniform(300e-9, 1100e-9, size=(10, 10))
+    out = table_medium.getN(testws)
+    assert out.shape == (10, 10)
+    np.testing.assert_array_equal(
+        out[3], [table_medium.getN(w) for w in testws[3]]
+    )
+
+    # Cubic spline interpolant
+    from scipy.interpolate import CubicSpline
+    silica = batoid.SellmeierMedium([
+        0.6961663, 0.4079426, 0.8974794,
+        0.0684043**2, 0.1162414**2, 9.896161**2
+    ])
+    for ws in [
+        np.linspace(300e-9, 1100e-9, 81),
+        np.sort(rng.uniform(300e-9, 1100e-9, size=81))
+    ]:
+        ns = silica.getN(ws)
+        table_medium = batoid.TableMedium(ws, ns, interpolant='cubic')
+        testws = rng.uniform(ws[0], ws[-1], size=1000)
+        np.testing.assert_allclose(
+            table_medium.getN(testws),
+            CubicSpline(ws, ns)(testws),
+            rtol=0, atol=1e-14
+        )
+        do_pickle(table_medium)
+
+    with np.testing.assert_raises(AssertionError):
+        batoid.TableMedium(ws, ns, interpolant='quintic')
+
     # Test load from file
     filename = os.path.join(
         os.path.dirname(__file__),
@@ -152,12 +202,68 @@ def test_air():
     do_pickle(air)
 
 
+@timer
+def test_TabulatedMedium():
+    import yaml
+    rng = np.random.default_rng(5772)
+    silica = batoid.SellmeierMedium([
+        0.6961663, 0.4079426, 0.8974794,
+        0.0684043**2, 0.1162414**2, 9.896161**2
+    ])
+    for medium in [silica, batoid.Air(), batoid.Air(pressure=100)]:
+        for tol in [1e-9, 1e-12]:
+            tab = batoid.TabulatedMedium(medium, tolerance=tol)
+            # Dense check, not just at the sampled test points
+            ws = np.linspace(300e-9, 1200e-9, 100_001)
+            np.testing.assert_allclose(
+                tab.getN(ws), medium.getN(ws), rtol=0, atol=tol
+            )
+            ws = rng.uniform(300e-9, 1200e-9, size=100)
+            np.testing.assert_array_equal(
+                tab.getN(ws), [tab.getN(w) for w in ws]
+            )
+            assert np.isnan(tab.getN(1300e-9))
+        do_pickle(tab)
+
+    # Tighter tolerance needs more knots
+    assert (
+        len(batoid.TabulatedMedium(silica, tolerance=1e-12).wavelengths)
+        > len(batoid.TabulatedMedium(silica, tolerance=1e-9).wavelengths)
+    )
+
+    # Custom range
+    tab = batoid.TabulatedMedium(silica, 500e-9, 600e-9)
+    assert np.isnan(tab.getN(400e-9))
+    np.testing.assert_allclose(
+        tab.getN(550e-9), silica.getN(550e-9), rtol=0, atol=1e-12
+    )
+
+    # Can't tabulate outside the domain of the underlying medium
+    table_medium = batoid.TableMedium.fromTxt("silica_dispersion.txt")
+    with np.testing.assert_raises(ValueError):
+        batoid.TabulatedMedium(table_medium, 1e-9, 1e-3)
+
+    # Parse from yaml
+    config = yaml.safe_load("""
+        type: TabulatedMedium
+        medium:
+          type: Air
+          pressure: 100
+        tolerance: 1.0e-10
+    """)
+    tab = batoid.parse.parse_medium(config)
+    assert tab == batoid.TabulatedMedium(
+        batoid.Air(pressure=100), tolerance=1e-10
+    )
+
+
 @timer
 def test_ne():
     objs = [
         batoid.ConstMedium(1.0),
         batoid.ConstMedium(1.1),
         batoid.TableMedium([1, 2, 3], [3, 4, 3]),
+        batoid.TableMedium([1, 2, 3], [3, 4, 3], interpolant='cubic'),
         batoid.SellmeierMedium([
             0.6961663, 0.4079426, 0.8974794,
             0.0684043**2, 0.1162414**2, 9.896161**2]),
@@ -173,7 +279,11 @@ def test_ne():
             0.00028872517, -2.2214495e-5, 1.4258559e-6
         ]),
         batoid.Air(),
-        batoid.Air(pressure=100)
+        batoid.Air(pressure=100),
+        batoid.TabulatedMedium(batoid.Air()),
+        batoid.TabulatedMedium(batoid.Air(), tolerance=1e-10),
+        batoid.TabulatedMedium(batoid.Air(), 400e-9, 1200e-9),
+        batoid.TabulatedMedium(batoid.Air(pressure=100)),
     ]
     all_obj_diff(objs)
 
@@ -184,4 +294,5 @@ if __name__ == '__main__':
     test_SellmeierMedium()
     test_SumitaMedium()
     test_air()
+    test_TabulatedMedium()
     test_ne()
@@ -221,6 +221,26 @@ def test_ObscPolygon():
         o2.contains(x, y)
     )
 
+    # Many-vertex outline, compared against a brute-force crossing number
+    # test over all edges.
+    th = np.linspace(0, 2*np.pi, 3000, endpoint=False)
+    r = 0.5 + 0.4*np.sin(7*th) + 0.01*rng.uniform(size=len(th))
+    xs = r*np.cos(th)
+    ys = r*np.sin(th)
+    poly = batoid.ObscPolygon(xs, ys)
+    x = rng.uniform(-1.0, 1.0, size=size)
+    y = rng.uniform(-1.0, 1.0, size=size)
+    # Include rows passing exactly through vertices.
+    y[::10] = rng.choice(ys, size=len(y[::10]))
+    expected = np.zeros_like(x, dtype=bool)
+    for x1, y1, x2, y2 in zip(xs, ys, np.roll(xs, -1), np.roll(ys, -1)):
+        if y1 == y2:
+            continue
+        w = (y > min(y1, y2)) & (y <= max(y1, y2)) & (x <= max(x1, x2))
+        xinters = (y-y1)*(x2-x1)/(y2-y1)+x1
+        expected ^= w & ((x1 == x2) | (x <= xinters))
+    np.testing.assert_array_equal(poly.contains(x, y), expected)
+
     # Check containsGrid
     x = np.linspace(-10.0, 10.0, 25)
     y = np.linspace(-10.0, 10.0, 25)
@@ -231,6 +251,124 @@ def test_ObscPolygon():
     )
 
 
+@timer
+def test_ObscBitmap():
+    rng = np.random.default_rng(5772156649)
+    size = 10_000
+
+    for _ in range(10):
+        nx, ny = rng.integers(1, 100, size=2)
+        mask = rng.uniform(size=(ny, nx)) < 0.3
+        xmin, ymin = rng.uniform(-1, 0, size=2)
+        xmax, ymax = rng.uniform(0.1, 1, size=2)
+        dx = (xmax-xmin)/nx
+        dy = (ymax-ymin)/ny
+        x = rng.uniform(-1.2, 1.2, size=size)
+        y = rng.uniform(-1.2, 1.2, size=size)
+        x[::100] = np.nan
+
+        bitmap = batoid.ObscBitmap(mask, xmin, xmax, ymin, ymax)
+        do_pickle(bitmap)
+        u = (x-xmin)/dx
+        v = (y-ymin)/dy
+        with np.errstate(invalid='ignore'):
+            inside = (u >= 0) & (u < nx) & (v >= 0) & (v < ny)
+        expected = np.zeros_like(inside)
+        expected[inside] = mask[v[inside].astype(int), u[inside].astype(int)]
+        np.testing.assert_array_equal(bitmap.contains(x, y), expected)
+        assert bitmap.contains(x[0], y[0]) == expected[0]
+
+        rv = batoid.RayVector(x, y, 0.0, 0.0, 0.0, 0.0)
+        batoid.obscure(bitmap, rv)
+        np.testing.assert_array_equal(expected, rv.vignetted)
+
+        bitmap = batoid.ObscBitmap(
+            mask, xmin, xmax, ymin, ymax, interpolant='bilinear'
+        )
+        do_pickle(bitmap)
+        padded = np.pad(mask, 1).astype(float)
+        u = (x-xmin)/dx + 0.5
+        v = (y-ymin)/dy + 0.5
+        with np.errstate(invalid='ignore'):
+            inside = (u > 0) & (u < nx+1) & (v > 0) & (v < ny+1)
+        u = u[inside]
+        v = v[inside]
+        i = np.floor(u).astype(int)
+        j = np.floor(v).astype(int)
+        s = u-i
+        t = v-j
+        val = (
+            (1-t)*((1-s)*padded[j, i] + s*padded[j, i+1])
+            + t*((1-s)*padded[j+1, i] + s*padded[j+1, i+1])
+        )
+        expected = np.zeros_like(x, dtype=bool)
+        expected[inside] = val > 0.5
+        # Don't quibble over rounding right at the threshold.
+        w = np.ones_like(x, dtype=bool)
+        w[inside] = np.abs(val-0.5) > 1e-10
+        np.testing.assert_array_equal(bitmap.contains(x, y)[w], expected[w])
+
+    # A pixel-aligned rectangle is reproduced exactly away from its edges.
+    mask = np.zeros((20, 30), dtype=bool)
+    mask[5:15, 10:25] = True
+    bitmap = batoid.ObscBitmap(mask, 0.0, 3.0, 0.0, 2.0)
+    rect = batoid.ObscRectangle(1.5, 1.0, 1.75, 1.0)
+    x = rng.uniform(-1.0, 4.0, size=size)
+    y = rng.uniform(-1.0, 3.0, size=size)
+    np.testing.assert_array_equal(bitmap.contains(x, y), rect.contains(x, y))
+
+    # Composes with other obscurations
+    circle = batoid.ObscCircle(0.5, 0.5, 0.5)
+    for obsc, expected in [
+        (
+            batoid.ObscUnion(bitmap, circle),
+            rect.contains(x, y) | circle.contains(x, y)
+        ),
+        (
+            batoid.ObscIntersection(bitmap, circle),
+            rect.contains(x, y) & circle.contains(x, y)
+        ),
+        (batoid.ObscNegation(bitmap), ~rect.contains(x, y)),
+    ]:
+        np.testing.assert_array_equal(obsc.contains(x, y), expected)
+        do_pickle(obsc)
+
+    # Load from file, directly or via yaml
+    import os
+    import tempfile
+    import yaml
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for filename, save in [
+            ("mask.npy", lambda f: np.save(f, mask)),
+            ("mask.txt", lambda f: np.savetxt(f, mask.astype(int), fmt="%d")),
+        ]:
+            filename = os.path.join(tmpdir, filename)
+            save(filename)
+            assert batoid.ObscBitmap.fromFile(
+                filename, 0.0, 3.0, 0.0, 2.0
+            ) == bitmap
+            config = yaml.safe_load(f"""
+                type: ClearBitmap
+                file: {filename}
+                xmin: 0.0
+                xmax: 3.0
+                ymin: 0.0
+                ymax: 2.0
+                interpolant: bilinear
+            """)
+            assert batoid.parse.parse_obscuration(config) == batoid.ObscNegation(
+                batoid.ObscBitmap(
+                    mask, 0.0, 3.0, 0.0, 2.0, interpolant='bilinear'
+                )
+            )
+    with np.testing.assert_raises(FileNotFoundError):
+        batoid.ObscBitmap.fromFile("Giraffe.npy", 0.0, 1.0, 0.0, 1.0)
+    with np.testing.assert_raises(ValueError):
+        batoid.ObscBitmap(mask, 0.0, 1.0, 0.0, 1.0, interpolant='Giraffe')
+    with np.testing.assert_raises(ValueError):
+        batoid.ObscBitmap(mask, 1.0, 0.0, 0.0, 1.0)
+
+
 @timer
 def test_ObscNegation():
     rng = np.random.default_rng(577215)
@@ -351,6 +489,142 @@ def test_ObscCompound():
         batoid.ObscIntersection()
 
 
+def _random_obscuration(rng, depth):
+    """Random nested obscuration for comparing compiled and tree evaluation."""
+    kind = rng.integers(8) if depth > 0 else rng.integers(5)
+    cx, cy = rng.uniform(-1, 1, size=2)
+    if kind == 0:
+        return batoid.ObscCircle(rng.uniform(0.05, 0.3), cx, cy)
+    elif kind == 1:
+        inner = rng.uniform(0.05, 0.2)
+        return batoid.ObscAnnulus(inner, inner+rng.uniform(0.05, 0.2), cx, cy)
+    elif kind == 2:
+        return batoid.ObscRectangle(
+            *rng.uniform(0.05, 0.5, size=2), cx, cy, rng.uniform(0, 2*np.pi)
+        )
+    elif kind == 3:
+        return batoid.ObscRay(
+            rng.uniform(0.01, 0.1), rng.uniform(0, 2*np.pi), cx, cy
+        )
+    elif kind == 4:
+        n = rng.integers(3, 8)
+        th = np.linspace(0, 2*np.pi, n, endpoint=False)
+        r = rng.uniform(0.05, 0.3, size=n)
+        return batoid.ObscPolygon(cx+r*np.cos(th), cy+r*np.sin(th))
+    elif kind == 5:
+        return batoid.ObscNegation(_random_obscuration(rng, depth-1))
+    elif kind == 6:
+        # Wide enough to trigger the grid index sometimes
+        return batoid.ObscUnion([
+            _random_obscuration(rng, depth-1)
+            for _ in range(rng.integers(1, 30))
+        ])
+    else:
+        return batoid.ObscIntersection([
+            _random_obscuration(rng, depth-1)
+            for _ in range(rng.integers(1, 4))
+        ])
+
+
+@timer
+def test_compiled():
+    rng = np.random.default_rng(5772156)
+    size = 10_000
+
+    ntested = 0
+    while ntested < 50:
+        obsc = _random_obscuration(rng, 4)
+        if not hasattr(obsc, '_tree'):
+            continue
+        ntested += 1
+        x = rng.uniform(-1.5, 1.5, size=size)
+        y = rng.uniform(-1.5, 1.5, size=size)
+        x[::1000] = np.nan
+        np.testing.assert_array_equal(
+            obsc.contains(x, y),
+            obsc._tree.contains(x, y)
+        )
+        rv = batoid.RayVector(x, y, 0.0, 0.0, 0.0, 0.0)
+        batoid.obscure(obsc, rv)
+        np.testing.assert_array_equal(obsc.contains(x, y), rv.vignetted)
+
+    # A union of many small rectangles, as in a focal plane layout, gets
+    # indexed.  Check points right on the rectangle edges too.
+    rects = []
+    for ix in range(-10, 10):
+        for iy in range(-10, 10):
+            rects.append(batoid.ObscRectangle(0.09, 0.09, 0.1*ix, 0.1*iy))
+    union = batoid.ObscUnion(rects)
+    x = np.concatenate([
+        rng.uniform(-1.2, 1.2, size=size),
+        0.1*rng.integers(-10, 10, size=size) + 0.045
+    ])
+    y = np.concatenate([
+        rng.uniform(-1.2, 1.2, size=size),
+        0.1*rng.integers(-10, 10, size=size) + rng.uniform(-0.05, 0.05, size=size)
+    ])
+    expected = np.zeros_like(x, dtype=bool)
+    for rect in rects:
+        expected |= rect.contains(x, y)
+    np.testing.assert_array_equal(union.contains(x, y), expected)
+    np.testing.assert_array_equal(union._tree.contains(x, y), expected)
+    # One bbox check, one grid lookup, one instruction per rectangle.
+    assert union._obsc.programSize == len(rects) + 2
+
+    # Empty unions contain nothing and empty intersections everything, also
+    # when nested as the last item of another compound.
+    circle = batoid.ObscCircle(1.0)
+    emptyUnion = batoid.ObscUnion([])
+    emptyIntersection = batoid.ObscIntersection([])
+    x = rng.uniform(-1.5, 1.5, size=size)
+    y = rng.uniform(-1.5, 1.5, size=size)
+    for obsc in [
+        emptyUnion,
+        emptyIntersection,
+        batoid.ObscUnion(circle, batoid.ObscUnion([])),
+        batoid.ObscUnion(circle, batoid.ObscIntersection([])),
+        batoid.ObscIntersection(circle, batoid.ObscUnion([])),
+        batoid.ObscIntersection(
+            circle, batoid.ObscCircle(0.5, 1.0, 0.0),
+            batoid.ObscIntersection([])
+        ),
+    ]:
+        np.testing.assert_array_equal(
+            obsc.contains(x, y),
+            obsc._tree.contains(x, y)
+        )
+    assert not np.any(emptyUnion.contains(x, y))
+    assert np.all(emptyIntersection.contains(x, y))
+
+
+@timer
+def test_containsGrid():
+    rng = np.random.default_rng(57721566490)
+
+    obscs = [_random_obscuration(rng, 3) for _ in range(50)]
+    obscs.append(batoid.ObscBitmap(
+        rng.uniform(size=(30, 40)) < 0.5, -1.0, 1.0, -0.5, 0.5
+    ))
+    for obsc in obscs:
+        nx, ny = rng.integers(1, 300, size=2)
+        x = np.linspace(-1.5, 1.5, nx)
+        y = np.linspace(-1.5, 1.5, ny)
+        # Also check grids with points exactly on edges and vertices
+        if rng.uniform() < 0.3:
+            x = np.round(x*8)/8
+            y = np.round(y*8)/8
+        xx, yy = np.meshgrid(x, y)
+        expected = obsc.contains(xx, yy)
+        np.testing.assert_array_equal(obsc.containsGrid(x, y), expected)
+        np.testing.assert_array_equal(
+            obsc.containsGrid(x, y, packed=True),
+            np.packbits(expected, axis=1, bitorder='little')
+        )
+
+    with np.testing.assert_raises(ValueError):
+        obscs[0].containsGrid([1.0, 0.0], [0.0])
+
+
 @timer
 def test_ne():
     objs = [
@@ -367,6 +641,13 @@ def test_ne():
         batoid.ObscRay(1.0, 2.0, 0.1, 0.1),
         batoid.ObscNegation(batoid.ObscCircle(1.0)),
         batoid.ObscPolygon([0,1,1,0],[0,0,1,1]),
+        batoid.ObscBitmap([[True, False]], 0.0, 1.0, 0.0, 1.0),
+        batoid.ObscBitmap([[False, True]], 0.0, 1.0, 0.0, 1.0),
+        batoid.ObscBitmap([[True], [False]], 0.0, 1.0, 0.0, 1.0),
+        batoid.ObscBitmap([[True, False]], 0.0, 1.0, 0.0, 2.0),
+        batoid.ObscBitmap(
+            [[True, False]], 0.0, 1.0, 0.0, 1.0, interpolant='bilinear'
+        ),
         batoid.ObscUnion([batoid.ObscCircle(1.0)]),
         batoid.ObscUnion([
             batoid.ObscCircle(1.0),
@@ -405,6 +686,9 @@ if __name__ == '__main__':
     test_ObscRectangle()
     test_ObscRay()
     test_ObscPolygon()
+    test_ObscBitmap()
     test_ObscNegation()
     test_ObscCompound()
+    test_compiled()
+    test_containsGrid()
     test_ne()
@@ -0,0 +1,291 @@
+import batoid
+import numpy as np
+from test_helpers import timer, do_pickle, all_obj_diff, rays_allclose, init_gpu
+
+
+@timer
+def test_properties():
+    rng = np.random.default_rng(5)
+
+    for _ in range(10):
+        rs = np.linspace(0, 1, 10)
+        zs = rng.uniform(0, 1, size=10)
+        rsp = batoid.RadialSpline(rs, zs)
+        np.testing.assert_array_equal(rs, rsp.rs)
+        np.testing.assert_array_equal(zs, rsp.zs)
+        # Zero slope imposed at the origin
+        assert rsp.dzdrs[0] == 0.0
+        do_pickle(rsp)
+
+    with np.testing.assert_raises(AssertionError):
+        batoid.RadialSpline(rs, zs, nanpolicy='Giraffe')
+
+    # Check reprability here for zero nanpolicy
+    do_pickle(batoid.RadialSpline(rs, zs, nanpolicy='ZERO'))
+
+
+@timer
+def test_sag():
+    rng = np.random.default_rng(57)
+    # Cubic Hermite interpolation with exact derivatives reproduces cubics.
+    def f1(r):
+        return 0.1*r**2
+    def df1(r):
+        return 0.2*r
+    def f2(r):
+        return 0.3*r**3 - 0.1*r**2 + 0.02
+    def df2(r):
+        return 0.9*r**2 - 0.2*r
+    rs = np.linspace(0, 1, 1000)
+
+    x = rng.uniform(-0.7, 0.7, size=1000)
+    y = rng.uniform(-0.7, 0.7, size=1000)
+    r = np.hypot(x, y)
+
+    for f, df in [(f1, df1), (f2, df2)]:
+        rsp = batoid.RadialSpline(rs, f(rs), df(rs))
+        np.testing.assert_allclose(
+            f(r),
+            rsp.sag(x, y),
+            atol=1e-14, rtol=0
+        )
+        assert rsp.sag(x[0], y[0]) == rsp.sag(x, y)[0]
+        assert np.array_equal(
+            rsp.sag(x[::5], y[::5]),
+            rsp.sag(x, y)[::5]
+        )
+
+        # Without explicit derivatives, still very close.
+        rsp = batoid.RadialSpline(rs, f(rs))
+        np.testing.assert_allclose(
+            f(r),
+            rsp.sag(x, y),
+            atol=1e-12, rtol=0
+        )
+
+    # sag returns nan outside of table domain
+    assert np.isnan(rsp.sag(1.0, 1.0))
+    # or zero if nanpolicy is set to 'zero'
+    rsp = batoid.RadialSpline(rs, f(rs), nanpolicy='ZERO')
+    np.testing.assert_equal(rsp.sag(1.0, 1.0), 0.0)
+
+
+@timer
+def test_normal():
+    rng = np.random.default_rng(577)
+    def f(r):
+        return 0.3*r**3 - 0.1*r**2
+    def df(r):
+        return 0.9*r**2 - 0.2*r
+    rs = np.linspace(0, 1, 1000)
+    rsp = batoid.RadialSpline(rs, f(rs), df(rs))
+
+    x = rng.uniform(-0.7, 0.7, size=1000)
+    y = rng.uniform(-0.7, 0.7, size=1000)
+    r = np.hypot(x, y)
+    dzdr = df(r)
+    arr = np.vstack([-x/r*dzdr, -y/r*dzdr, np.ones_like(x)]).T
+    arr /= np.sqrt(np.sum(arr**2, axis=1))[:, None]
+    np.testing.assert_allclose(
+        rsp.normal(x, y),
+        arr,
+        atol=1e-12, rtol=0
+    )
+    np.testing.assert_array_equal(rsp.normal(0.0, 0.0), [0.0, 0.0, 1.0])
+
+    # normal returns (nan, nan, nan) outside of table domain
+    out = rsp.normal(1.0, 1.0)
+    assert all(np.isnan(o) for o in out)
+    # unless nanpolicy == 'ZERO'
+    rsp = batoid.RadialSpline(rs, f(rs), df(rs), nanpolicy='ZERO')
+    np.testing.assert_equal(rsp.normal(1.0, 1.0), np.array([0.0, 0.0, 1.0]))
+
+
+@timer
+def test_intersect():
+    rng = np.random.default_rng(5772)
+    size = 10_000
+
+    for _ in range(10):
+        a = rng.uniform(size=3)
+        def f(r):
+            return a[0]*r**2 - a[1]*r**3 + a[2]*0.1*np.cos(r)**2
+        rs = np.linspace(0, 1, 1000)
+        rsp = batoid.RadialSpline(rs, f(rs))
+
+        rspCoordSys = batoid.CoordSys(origin=[0, 0, -1])
+        x = rng.uniform(-0.6, 0.6, size=size)
+        y = rng.uniform(-0.6, 0.6, size=size)
+        z = np.full_like(x, -10.0)
+        vx = np.zeros_like(x)
+        vy = np.zeros_like(x)
+        vz = np.ones_like(x)
+        rv = batoid.RayVector(x, y, z, vx, vy, vz)
+        rv2 = batoid.intersect(rsp, rv.copy(), rspCoordSys)
+        assert rv2.coordSys == rspCoordSys
+
+        rv2 = rv2.toCoordSys(batoid.CoordSys())
+        np.testing.assert_allclose(rv2.x, x)
+        np.testing.assert_allclose(rv2.y, y)
+        np.testing.assert_allclose(
+            rv2.z, rsp.sag(x, y)-1,
+            rtol=0, atol=1e-12
+        )
+
+        # Tilted rays; compare against equivalent Bicubic
+        xs = np.linspace(-0.8, 0.8, 1000)
+        bc = batoid.Bicubic(xs, xs, rsp.sag(*np.meshgrid(xs, xs)))
+        rv = batoid.RayVector(
+            x, y, z,
+            rng.uniform(-1e-3, 1e-3, size=size),
+            rng.uniform(-1e-3, 1e-3, size=size),
+            np.ones_like(x)
+        )
+        rv1 = batoid.intersect(rsp, rv.copy())
+        rv2 = batoid.intersect(bc, rv.copy())
+        rays_allclose(rv1, rv2, atol=1e-8)
+
+
+@timer
+def test_reflect_refract():
+    rng = np.random.default_rng(57721)
+    size = 10_000
+
+    rs = np.linspace(0, 1, 1000)
+    rsp = batoid.RadialSpline(rs, 0.05*rs**2 - 0.01*rs**4)
+    m0 = batoid.ConstMedium(1.2)
+    m1 = batoid.ConstMedium(1.3)
+
+    x = rng.uniform(-0.6, 0.6, size=size)
+    y = rng.uniform(-0.6, 0.6, size=size)
+    z = np.full_like(x, -10.0)
+    vx = rng.uniform(-1e-5, 1e-5, size=size)
+    vy = rng.uniform(-1e-5, 1e-5, size=size)
+    vz = np.sqrt(1-vx*vx-vy*vy)/m0.n
+    rv = batoid.RayVector(x, y, z, vx, vy, vz)
+
+    rvr = batoid.reflect(rsp, rv.copy())
+    rays_allclose(rvr, rsp.reflect(rv.copy()))
+    normal = rsp.normal(rvr.x, rvr.y)
+    # Test law of reflection
+    a0 = np.einsum("ad,ad->a", normal, rv.v)[~rvr.failed]
+    a1 = np.einsum("ad,ad->a", normal, -rvr.v)[~rvr.failed]
+    np.testing.assert_allclose(a0, a1, rtol=0, atol=1e-12)
+
+    rvr = batoid.refract(rsp, rv.copy(), m0, m1)
+    rays_allclose(rvr, rsp.refract(rv.copy(), m0, m1))
+    normal = rsp.normal(rvr.x, rvr.y)
+    # Test Snell's law
+    s0 = np.sum(np.cross(normal, rv.v*m0.n)[~rvr.failed], axis=-1)
+    s1 = np.sum(np.cross(normal, rvr.v*m1.n)[~rvr.failed], axis=-1)
+    np.testing.assert_allclose(m0.n*s0, m1.n*s1, rtol=0, atol=1e-9)
+
+
+@timer
+def test_asphere_approximation():
+    rng = np.random.default_rng(5772156)
+
+    rs = np.linspace(0, 1.3, 1000)
+    xtest = rng.uniform(-0.9, 0.9, size=1000)
+    ytest = rng.uniform(-0.9, 0.9, size=1000)
+
+    for i in range(10):
+        R = rng.normal(20.0, 1.0)
+        conic = rng.uniform(-2.0, 1.0)
+        ncoef = rng.choice(4)
+        coefs = [rng.normal(0, 1e-10) for i in range(ncoef)]
+        asphere = batoid.Asphere(R, conic, coefs)
+        rsp = batoid.RadialSpline(rs, asphere.sag(rs, 0))
+
+        np.testing.assert_allclose(
+            asphere.sag(xtest, ytest),
+            rsp.sag(xtest, ytest),
+            atol=1e-12, rtol=0.0
+        )
+
+        np.testing.assert_allclose(
+            asphere.normal(xtest, ytest),
+            rsp.normal(xtest, ytest),
+            atol=1e-9, rtol=0
+        )
+
+
+@timer
+def test_sum():
+    rng = np.random.default_rng(57721566)
+    rs = np.linspace(0, 1, 1000)
+    sphere = batoid.Sphere(rng.uniform(10, 20))
+    rsp = batoid.RadialSpline(rs, 1e-6*np.cos(3*rs))
+    sum = batoid.Sum(sphere, rsp)
+    do_pickle(sum)
+
+    x = rng.uniform(-0.6, 0.6, size=1000)
+    y = rng.uniform(-0.6, 0.6, size=1000)
+    np.testing.assert_allclose(
+        sum.sag(x, y),
+        sphere.sag(x, y) + rsp.sag(x, y),
+        rtol=0, atol=1e-14
+    )
+
+    # Also available from yaml config
+    import yaml
+    config = yaml.safe_load(f"""
+        type: Sum
+        items:
+          - type: Sphere
+            R: {sphere.R}
+          - type: RadialSpline
+            rs: {rs.tolist()}
+            zs: {rsp.zs.tolist()}
+    """)
+    sum2 = batoid.parse.parse_surface(config)
+    np.testing.assert_allclose(
+        sum.sag(x, y),
+        sum2.sag(x, y),
+        rtol=0, atol=1e-14
+    )
+
+
+@timer
+def test_ne():
+    rs1 = np.linspace(0, 1, 10)
+    rs2 = np.linspace(0, 1, 11)
+    zs1 = rs1**2
+    zs2 = rs1**3
+
+    objs = [
+        batoid.RadialSpline(rs1, zs1),
+        batoid.RadialSpline(rs1, zs2),
+        batoid.RadialSpline(rs2, rs2**2),
+        batoid.RadialSpline(rs1, zs1, zs2),
+        batoid.RadialSpline(rs1, zs1, zs2, nanpolicy='ZERO'),
+        batoid.Bicubic(rs1, rs1, np.outer(zs1, zs1)),
+    ]
+    all_obj_diff(objs)
+
+
+@timer
+def test_fail():
+    rs = np.linspace(0, 1, 10)
+    rsp = batoid.RadialSpline(rs, 0.1*rs**2)
+
+    rv = batoid.RayVector(0, 10, 0, 0, 0, -1)  # Too far to side
+    rv2 = batoid.intersect(rsp, rv.copy())
+    np.testing.assert_equal(rv2.failed, np.array([True]))
+    # This one passes
+    rv = batoid.RayVector(0, 0, 0, 0, 0, -1)
+    rv2 = batoid.intersect(rsp, rv.copy())
+    np.testing.assert_equal(rv2.failed, np.array([False]))
+
+
+if __name__ == '__main__':
+    init_gpu()
+    test_properties()
+    test_sag()
+    test_normal()
+    test_intersect()
+    test_reflect_refract()
+    test_asphere_approximation()
+    test_sum()
+    test_ne()
+    test_fail()
@@ -1,3 +1,5 @@
+import pickle
+
 import batoid
 import numpy as np
 from test_helpers import timer, init_gpu, rays_allclose, checkAngle, do_pickle
@@ -292,6 +294,68 @@ def test_sumAmplitude():
         # print(f"np.sum(amplitude()) time: {atime}")
 
 
+@timer
+def test_sumAmplitudeGrid():
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    rv = batoid.RayVector.asPolar(
+        optic=telescope, wavelength=620e-9,
+        theta_x=np.deg2rad(0.3), theta_y=np.deg2rad(-0.2),
+        nrad=30, naz=90
+    )
+    telescope.trace(rv)
+    assert np.any(rv.vignetted)
+    w = ~rv.vignetted
+    r0 = np.mean(rv.r[w], axis=0)
+    r0[2] = 0.0
+    du = np.array([1e-6, 0.0, 0.0])
+    dv = np.array([0.2e-6, 1.1e-6, 1e-7])
+    r0 -= 10*du + 8*dv
+    t = np.mean(rv.t[w])
+
+    # Include a view, whose flags start mid-word.
+    for rays in [rv, rv[37:-5]]:
+        for ignoreVignetted in [True, False]:
+            grid = rays.sumAmplitudeGrid(
+                r0, du, dv, 21, 17, t, ignoreVignetted=ignoreVignetted
+            )
+            assert grid.shape == (17, 21)
+            for j in range(0, 17, 4):
+                for i in range(0, 21, 5):
+                    np.testing.assert_allclose(
+                        grid[j, i],
+                        rays.sumAmplitude(r0 + i*du + j*dv, t, ignoreVignetted),
+                        rtol=0, atol=1e-9*len(rays)
+                    )
+            # Nonuniform FFT, errors bounded by tol times the total flux
+            for tol in [1e-4, 1e-10]:
+                np.testing.assert_allclose(
+                    rays.sumAmplitudeGrid(
+                        r0, du, dv, 21, 17, t,
+                        ignoreVignetted=ignoreVignetted, tol=tol
+                    ),
+                    grid,
+                    rtol=0, atol=tol*len(rays)
+                )
+
+    # Segments sum
+    srv = batoid.SegmentedRayVector([rv[:1000], rv[1000:]])
+    np.testing.assert_allclose(
+        srv.sumAmplitudeGrid(r0, du, dv, 5, 4, t),
+        rv.sumAmplitudeGrid(r0, du, dv, 5, 4, t),
+        rtol=0, atol=1e-9*len(rv)
+    )
+    np.testing.assert_allclose(
+        srv.sumAmplitudeGrid(r0, du, dv, 5, 4, t, tol=1e-10),
+        rv.sumAmplitudeGrid(r0, du, dv, 5, 4, t),
+        rtol=0, atol=1e-10*len(rv)
+    )
+
+    for tol in [0.0, -1e-10, 1.0, 2.0, np.nan]:
+        for rays in [rv, srv]:
+            with np.testing.assert_raises(ValueError):
+                rays.sumAmplitudeGrid(r0, du, dv, 5, 4, t, tol=tol)
+
+
 @timer
 def test_equals():
     rng = np.random.default_rng(577215)
@@ -1068,6 +1132,688 @@ def test_fromFieldAngles():
     assert rv == rv2
 
 
+@timer
+def test_allocation():
+    rng = np.random.default_rng(57721566)
+    prev = batoid.setRayAllocation()
+    assert prev == dict(
+        alignment=64, hugePages=False, firstTouch=True, poolBytes=2**30
+    )
+
+    def check_aligned(rv, alignment):
+        for arr in [
+            rv._x, rv._y, rv._z, rv._vx, rv._vy, rv._vz, rv._t,
+            rv._wavelength, rv._flux, rv._vignetted, rv._failed
+        ]:
+            assert arr.ctypes.data % alignment == 0
+            assert arr.flags.c_contiguous
+
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    results = []
+    try:
+        for options in [
+            dict(),
+            dict(alignment=4096),
+            dict(hugePages=True),
+            dict(firstTouch=False),
+        ]:
+            batoid.setRayAllocation(**options)
+            alignment = options.get('alignment', 64)
+            rv = batoid.RayVector.asPolar(
+                optic=telescope, wavelength=620e-9,
+                theta_x=np.deg2rad(0.1), theta_y=0.0,
+                nrad=300, naz=900
+            )
+            check_aligned(rv, alignment)
+            check_aligned(rv.copy(), alignment)
+            check_aligned(rv[10:20], alignment)
+            x = rng.uniform(size=10)
+            rv2 = batoid.RayVector(x, x, x, 0.0, 0.0, 1.0)
+            check_aligned(rv2, alignment)
+            # Constructor still copies
+            x[0] = 11.0
+            assert rv2.x[0] != 11.0
+            results.append(telescope.trace(rv))
+    finally:
+        batoid.setRayAllocation(**prev)
+    for rv in results[1:]:
+        assert rv == results[0]
+
+    with np.testing.assert_raises(ValueError):
+        batoid.setRayAllocation(alignment=48)
+
+
+@timer
+def test_recycle():
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    kwargs = dict(
+        optic=telescope, wavelength=620e-9,
+        theta_x=np.deg2rad(0.1), theta_y=0.0,
+        nrad=100, naz=300
+    )
+
+    batoid.clearRayPool()
+    rv = batoid.RayVector.asPolar(**kwargs)
+    expected = telescope.trace(rv.copy())
+    ptrs = {arr.ctypes.data for arr in [rv._x, rv._y, rv._z, rv._t]}
+    x = rv.x
+    xcopy = np.copy(x)
+    rv.recycle()
+    assert len(rv) == 0
+
+    # Arrays handed out before recycling aren't reused.
+    rv2 = batoid.RayVector.asPolar(**dict(kwargs, theta_x=0.0))
+    np.testing.assert_array_equal(x, xcopy)
+    del x, rv2
+
+    # Same size, so memory gets reused.
+    with batoid.RayVector.asPolar(**kwargs) as rv:
+        assert ptrs & {arr.ctypes.data for arr in [rv._x, rv._y, rv._z, rv._t]}
+        assert telescope.trace(rv) == expected
+    assert len(rv) == 0
+
+    # Freed without explicit recycle too
+    for _ in range(3):
+        rv = telescope.trace(batoid.RayVector.asPolar(**kwargs))
+        assert rv == expected
+        del rv
+    assert batoid.clearRayPool() > 0
+    assert batoid.clearRayPool() == 0
+
+    # Disabled pool
+    prev = batoid.setRayAllocation(poolBytes=0)
+    try:
+        rv = batoid.RayVector.asPolar(**kwargs)
+        rv.recycle()
+        assert batoid.clearRayPool() == 0
+    finally:
+        batoid.setRayAllocation(**prev)
+
+
+@timer
+def test_flags():
+    rng = np.random.default_rng(577215664)
+    for size in [0, 1, 63, 64, 65, 1000]:
+        x = rng.uniform(size=size)
+        vignetted = rng.uniform(size=size) < 0.3
+        failed = vignetted & (rng.uniform(size=size) < 0.5)
+        rv = batoid.RayVector(
+            x, x, x, 0.0, 0.0, 1.0, vignetted=vignetted, failed=failed
+        )
+        # Stored 64 flags per word, with unused bits cleared.
+        assert rv._vignetted.dtype == np.uint64
+        assert len(rv._vignetted) == len(rv._failed) == (size+63)//64
+        if size % 64:
+            assert rv._vignetted[-1] >> np.uint64(size%64) == 0
+            assert rv._failed[-1] >> np.uint64(size%64) == 0
+
+        assert rv.vignetted.dtype == bool
+        np.testing.assert_array_equal(rv.vignetted, vignetted)
+        np.testing.assert_array_equal(rv.failed, failed)
+        np.testing.assert_array_equal(rv.copy().vignetted, vignetted)
+        np.testing.assert_array_equal(rv[::3].vignetted, vignetted[::3])
+        np.testing.assert_array_equal(rv[::3].failed, failed[::3])
+        np.testing.assert_array_equal(
+            rv[vignetted].vignetted, vignetted[vignetted]
+        )
+        rv2 = batoid.concatenateRayVectors([rv, rv[::2]])
+        np.testing.assert_array_equal(
+            rv2.failed, np.hstack([failed, failed[::2]])
+        )
+        do_pickle(rv)
+
+        # Returned arrays are read-only unpacked copies.
+        with np.testing.assert_raises(ValueError):
+            rv.vignetted[:] = True
+        with np.testing.assert_raises(ValueError):
+            rv.failed[:] = True
+        np.testing.assert_array_equal(rv.vignetted, vignetted)
+
+        # Scalar flags
+        rv = batoid.RayVector(x, x, x, 0.0, 0.0, 1.0, vignetted=True)
+        assert np.all(rv.vignetted)
+        assert not np.any(rv.failed)
+        if size % 64:
+            assert rv._vignetted[-1] >> np.uint64(size%64) == 0
+
+    # Kernels only set bits for rays that fail, and skip rays already failed.
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    rv = batoid.RayVector.asPolar(
+        optic=telescope, wavelength=620e-9,
+        theta_x=np.deg2rad(0.1), theta_y=0.0,
+        nrad=50, naz=200
+    )
+    failed = rng.uniform(size=len(rv)) < 0.2
+    failed[:128] = True  # A couple of whole words
+    rv0 = batoid.RayVector(
+        rv.x, rv.y, rv.z, rv.vx, rv.vy, rv.vz, rv.t, rv.wavelength, rv.flux,
+        vignetted=failed, failed=failed
+    )
+    out0 = telescope.trace(rv.copy())
+    out1 = telescope.trace(rv0.copy())
+    np.testing.assert_array_equal(out1.failed, out0.failed | failed)
+    np.testing.assert_array_equal(out1.vignetted, out0.vignetted | failed)
+    w = ~failed
+    np.testing.assert_array_equal(out1.x[w], out0.x[w])
+
+
+@timer
+def test_uniform():
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    rv = batoid.RayVector.asPolar(
+        optic=telescope, wavelength=620e-9,
+        theta_x=np.deg2rad(0.1), theta_y=0.0,
+        nrad=50, naz=200
+    )
+    # Generators store direction, time, wavelength and flux once.
+    assert rv._uniformMask() == 15
+    assert rv._vx.shape == rv._t.shape == rv._wavelength.shape == (1,)
+    assert rv.copy()._uniformMask() == 15
+    assert rv[rv.x > 0]._uniformMask() == 15
+    do_pickle(rv)
+
+    # Same rays with every field stored per ray.
+    full = batoid.RayVector(
+        rv.x, rv.y, rv.z,
+        np.full(len(rv), rv._vx[0]), np.full(len(rv), rv._vy[0]),
+        np.full(len(rv), rv._vz[0]),
+        np.zeros(len(rv)), np.full(len(rv), 620e-9), np.ones(len(rv))
+    )
+    assert full._uniformMask() == 0
+    assert rv._uniformMask() == 15
+    assert rv == full
+    assert hash(rv._hash()) == hash(full._hash())
+    np.testing.assert_array_equal(
+        rv.sumAmplitude([0, 0, 1], 0), full.sumAmplitude([0, 0, 1], 0)
+    )
+
+    # Kernels that only read a field, or move all rays alike, keep it uniform.
+    rv2 = rv.copy().propagate(1.0)
+    assert rv2._uniformMask() == 15
+    rays_allclose(rv2, full.copy().propagate(1.0), atol=0)
+    rv2 = rv.copy().toCoordSys(batoid.CoordSys(rot=batoid.RotX(0.1)))
+    assert rv2._uniformMask() == 15
+    rays_allclose(
+        rv2, full.copy().toCoordSys(batoid.CoordSys(rot=batoid.RotX(0.1))),
+        atol=0
+    )
+    rv2 = batoid.intersect(
+        batoid.Plane(), rv.copy(), batoid.CoordSys(origin=[0, 0, 1])
+    )
+    assert rv2._uniformMask() == 1|4|8
+    rays_allclose(
+        rv2,
+        batoid.intersect(
+            batoid.Plane(), full.copy(), batoid.CoordSys(origin=[0, 0, 1])
+        ),
+        atol=0
+    )
+
+    # Fields materialize when written ray by ray, including traces.
+    out = telescope.trace(rv.copy())
+    assert out._uniformMask() & (1|2) == 0
+    assert out._uniformMask() & 4
+    assert out == telescope.trace(full.copy())
+    np.testing.assert_array_equal(out.wavelength, 620e-9)
+
+    # Or when handed out to Python, in which case writes are kept.
+    rv2 = rv.copy()
+    rv2.t[:] = 1.0
+    assert rv2._uniformMask() == 1|4|8
+    np.testing.assert_array_equal(rv2.t, 1.0)
+    rv2.vx[::2] = 0.0
+    assert rv2._uniformMask() == 4|8
+    np.testing.assert_array_equal(rv2.vx[::2], 0.0)
+    np.testing.assert_array_equal(rv2.vx[1::2], rv._vx[0])
+
+    # The constructor keeps scalars uniform
+    x = np.linspace(0, 1, 10)
+    rv = batoid.RayVector(x, x, x, 0.0, 0.0, 1.0)
+    assert rv._uniformMask() == 15
+    rv = batoid.RayVector(x, x, x, x, 0.0, 1.0, t=x)
+    assert rv._uniformMask() == 4|8
+    rv = batoid.RayVector(0.1, 0.2, 0.3, 0.0, 0.0, 1.0)
+    assert len(rv) == 1
+    np.testing.assert_array_equal(rv.vz, 1.0)
+    do_pickle(rv)
+
+
+@timer
+def test_view():
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    rv = batoid.RayVector.asPolar(
+        optic=telescope, wavelength=620e-9,
+        theta_x=np.deg2rad(0.1), theta_y=0.0,
+        nrad=30, naz=120
+    )
+    n = len(rv)
+    # Some rays fail before tracing, so flags straddle word boundaries.
+    failed = np.zeros(n, dtype=bool)
+    failed[::11] = True
+    rv = batoid.RayVector(
+        rv.x, rv.y, rv.z, rv.vx, rv.vy, rv.vz, rv.t, rv.wavelength, rv.flux,
+        failed=failed
+    )
+    ref = telescope.trace(rv.copy())
+
+    for start, stop in [(0, n), (0, 100), (37, 500), (64, 128), (101, 101)]:
+        view = rv[start:stop]
+        assert len(view) == stop-start
+        assert np.shares_memory(view.x, rv.x)
+        np.testing.assert_array_equal(view.failed, failed[start:stop])
+        assert view == batoid.RayVector(
+            rv.x[start:stop], rv.y[start:stop], rv.z[start:stop],
+            rv.vx[start:stop], rv.vy[start:stop], rv.vz[start:stop],
+            rv.t[start:stop], rv.wavelength[start:stop], rv.flux[start:stop],
+            rv.vignetted[start:stop], rv.failed[start:stop]
+        )
+        # Views of views
+        np.testing.assert_array_equal(view[3:-5].x, rv.x[start:stop][3:-5])
+        np.testing.assert_array_equal(
+            view[3:-5].failed, failed[start:stop][3:-5]
+        )
+        # Copies and pickles are independent RayVectors
+        cp = view.copy()
+        assert cp == view
+        assert not np.shares_memory(cp.x, rv.x)
+        do_pickle(view)
+
+    # Tracing views traces the parent's rays in place, leaving the rest alone.
+    view = rv[37:500]
+    telescope.trace(view)
+    np.testing.assert_array_equal(rv.x[37:500], ref.x[37:500])
+    np.testing.assert_array_equal(rv.vignetted[37:500], ref.vignetted[37:500])
+    np.testing.assert_array_equal(rv.failed[:37], failed[:37])
+    np.testing.assert_array_equal(rv.failed[500:], failed[500:])
+    assert view == ref[37:500]
+    telescope.trace(rv[:37])
+    telescope.trace(rv[500:])
+    assert rv == ref
+
+    # Negative integers are views of a single ray.
+    rv1 = rv[-3]
+    assert len(rv1) == 1
+    assert np.shares_memory(rv1.x, rv.x)
+    np.testing.assert_array_equal(rv1.r[0], rv.r[-3])
+    with np.testing.assert_raises(IndexError):
+        rv[n]
+    with np.testing.assert_raises(IndexError):
+        rv[[0, n]]
+
+    # Masks and index arrays gather into new RayVectors.
+    w = ~ref.vignetted & (ref.x > 0)
+    sel = ref[w]
+    assert not np.shares_memory(sel.x, ref.x)
+    assert sel == batoid.RayVector(
+        ref.x[w], ref.y[w], ref.z[w], ref.vx[w], ref.vy[w], ref.vz[w],
+        ref.t[w], ref.wavelength[w], ref.flux[w],
+        ref.vignetted[w], ref.failed[w], ref.coordSys
+    )
+    assert ref[np.zeros(n, dtype=bool)] == ref[0:0]
+    idx = np.arange(n)[::-7]
+    np.testing.assert_array_equal(ref[idx].failed, ref.failed[idx])
+    np.testing.assert_array_equal(ref[idx].vx, ref.vx[idx])
+    # Views as sources too
+    np.testing.assert_array_equal(
+        ref[100:900][w[100:900]].x, ref.x[100:900][w[100:900]]
+    )
+
+
+@timer
+def test_segmented():
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    rvs = [
+        batoid.RayVector.asPolar(
+            optic=telescope, wavelength=620e-9,
+            theta_x=np.deg2rad(thx), theta_y=0.0,
+            nrad=20, naz=60
+        )
+        for thx in [0.0, 0.3, 0.6]
+    ]
+    ref = telescope.trace(batoid.concatenateRayVectors(rvs))
+    segRefs = [telescope.trace(rv.copy()) for rv in rvs]
+
+    srv = batoid.SegmentedRayVector(rvs)
+    assert len(srv) == len(ref)
+    do_pickle(srv)
+    full = telescope.traceFull(srv.copy())
+    assert list(full.values())[-1]['out'] == batoid.SegmentedRayVector(segRefs)
+    out = telescope.trace(srv)
+    assert out is srv
+    # Segments are the original RayVectors, traced in place.
+    for i, (rv, segRef) in enumerate(zip(rvs, segRefs)):
+        assert srv.segments[i] is rv
+        assert rv == segRef
+        assert rv.coordSys == srv.coordSys
+    assert srv.toRayVector() == ref
+    np.testing.assert_array_equal(srv.r, ref.r)
+    np.testing.assert_array_equal(srv.v, ref.v)
+    np.testing.assert_array_equal(srv.vignetted, ref.vignetted)
+    np.testing.assert_array_equal(srv.failed, ref.failed)
+    np.testing.assert_array_equal(srv.flux, ref.flux)
+    np.testing.assert_array_equal(
+        srv.positionAtTime(1.0), ref.positionAtTime(1.0)
+    )
+    np.testing.assert_allclose(
+        srv.phase([0, 0, 1], 0.1), ref.phase([0, 0, 1], 0.1),
+        rtol=0, atol=0
+    )
+    np.testing.assert_allclose(
+        srv.sumAmplitude([0, 0, 1], 0.1), ref.sumAmplitude([0, 0, 1], 0.1),
+        rtol=1e-12, atol=0
+    )
+
+    # Segments in other coordinate systems are brought into the first one's.
+    rv1 = rvs[0].copy()
+    rv2 = rvs[1].copy().toCoordSys(batoid.CoordSys(origin=[0, 0, 1]))
+    srv = batoid.SegmentedRayVector([rv1, rv2])
+    assert rv2.coordSys == rv1.coordSys
+    rays_allclose(rv2, rvs[1])
+    srv.toCoordSys(batoid.CoordSys(rot=batoid.RotX(0.1)))
+    assert rv1.coordSys == rv2.coordSys == srv.coordSys
+
+    assert len(batoid.SegmentedRayVector([])) == 0
+
+
+@timer
+def test_stats():
+    rng = np.random.default_rng(5772156649)
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    rvs = [
+        batoid.RayVector.asPolar(
+            optic=telescope, wavelength=620e-9,
+            theta_x=np.deg2rad(thx), theta_y=np.deg2rad(0.1),
+            nrad=20, naz=60
+        )
+        for thx in [0.0, 0.3, 0.6, 0.9]
+    ]
+    rv = telescope.trace(batoid.concatenateRayVectors(rvs))
+    rv = batoid.RayVector(
+        rv.x, rv.y, rv.z, rv.vx, rv.vy, rv.vz, rv.t, rv.wavelength,
+        rng.uniform(0.5, 1.5, size=len(rv)), rv.vignetted, rv.failed,
+        rv.coordSys
+    )
+
+    def check(rays, st, weighted, ignoreVignetted, k=()):
+        w = ~rays.failed
+        if ignoreVignetted:
+            w &= ~rays.vignetted
+        wt = rays.flux[w] if weighted else np.ones(np.sum(w))
+        assert st.count[k] == np.sum(w)
+        np.testing.assert_allclose(st.weight[k], np.sum(wt), rtol=1e-12)
+        mean = np.average(rays.r[w], axis=0, weights=wt)
+        np.testing.assert_allclose(st.mean[k], mean, rtol=0, atol=1e-12)
+        np.testing.assert_allclose(
+            st.t[k], np.average(rays.t[w], weights=wt), rtol=1e-12
+        )
+        dx = rays.x[w] - mean[0]
+        dy = rays.y[w] - mean[1]
+        cov = np.array([
+            [np.average(dx*dx, weights=wt), np.average(dx*dy, weights=wt)],
+            [np.average(dx*dy, weights=wt), np.average(dy*dy, weights=wt)]
+        ])
+        np.testing.assert_allclose(st.cov[k], cov, rtol=1e-10, atol=1e-20)
+        np.testing.assert_allclose(
+            st.rms[k], np.sqrt(np.average(dx*dx+dy*dy, weights=wt)), rtol=1e-10
+        )
+
+    for weighted in [False, True]:
+        for ignoreVignetted in [True, False]:
+            kwargs = dict(weighted=weighted, ignoreVignetted=ignoreVignetted)
+            check(rv, rv.stats(**kwargs), **kwargs)
+            # Views not starting on a flag word boundary
+            view = rv[37:2000]
+            check(view, view.stats(**kwargs), **kwargs)
+            # Arbitrary ranges, including an empty one
+            bounds = [5, 77, 77, 1200, 1201, 2400, len(rv)]
+            st = rv.stats(bounds, **kwargs)
+            assert st.mean.shape == (len(bounds)-1, 3)
+            assert st.cov.shape == (len(bounds)-1, 2, 2)
+            for k, (b0, b1) in enumerate(zip(bounds[:-1], bounds[1:])):
+                if b0 == b1:
+                    assert st.count[k] == 0
+                    assert np.isnan(st.mean[k, 0])
+                else:
+                    check(rv[b0:b1], st, k=k, **kwargs)
+
+    # One row per field point, matching segments of a SegmentedRayVector.
+    lens = np.cumsum([0]+[len(r) for r in rvs])
+    st = rv.stats(lens)
+    srv = telescope.trace(batoid.SegmentedRayVector(rvs))
+    sst = srv.stats()
+    np.testing.assert_array_equal(st.count, sst.count)
+    np.testing.assert_allclose(st.mean, sst.mean, rtol=0, atol=1e-15)
+    np.testing.assert_allclose(st.rms, sst.rms, rtol=1e-12)
+
+    for bounds in [
+        [10, 5],
+        [0, len(rv)+1],
+        [-1, 10],
+        np.array([-5, 10], dtype=np.int64),
+        [0, 10.0],
+        [],
+        [[0, 10]],
+    ]:
+        with np.testing.assert_raises(ValueError):
+            rv.stats(bounds)
+        with np.testing.assert_raises(ValueError):
+            rv.focus(bounds=bounds)
+
+
+@timer
+def test_differentials():
+    rng = np.random.default_rng(57721566490)
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    wavelength = 750e-9
+    thx, thy = np.deg2rad(0.4), np.deg2rad(-0.2)
+    x = rng.uniform(-3.5, 3.5, size=200)
+    y = rng.uniform(-3.5, 3.5, size=200)
+
+    def traced(x, y, thx, thy, differentials=False):
+        rv = batoid.RayVector.fromStop(
+            x, y, optic=telescope, wavelength=wavelength,
+            theta_x=thx, theta_y=thy, differentials=differentials
+        )
+        return telescope.trace(rv)
+
+    rv = traced(x, y, thx, thy, differentials=True)
+    d = rv.differentials
+    assert d.shape == (4, 7, len(rv))
+    w = ~rv.vignetted
+    assert np.sum(w) > 100
+
+    # Compare against finite differences.
+    hs, ht = 1e-5, 1e-7
+    for k, (dx, dy, dthx, dthy) in enumerate([
+        (hs, 0, 0, 0), (0, hs, 0, 0), (0, 0, ht, 0), (0, 0, 0, ht)
+    ]):
+        plus = traced(x+dx, y+dy, thx+dthx, thy+dthy)
+        minus = traced(x-dx, y-dy, thx-dthx, thy-dthy)
+        h = 2*max(dx, dy, dthx, dthy)
+        scale = 1 if k < 2 else 1e2
+        np.testing.assert_allclose(
+            d[k, 0:3, w], ((plus.r - minus.r)/h)[w],
+            rtol=0, atol=1e-5*scale
+        )
+        np.testing.assert_allclose(
+            d[k, 3:6, w], ((plus.v - minus.v)/h)[w],
+            rtol=0, atol=1e-6*scale
+        )
+        np.testing.assert_allclose(
+            d[k, 6, w], ((plus.t - minus.t)/h)[w],
+            rtol=0, atol=1e-5*scale
+        )
+
+    # Propagating keeps differentials at constant t.
+    rv2 = rv.propagate(rv.t+0.1)
+    d2 = rv2.differentials
+    np.testing.assert_allclose(d2[:, 6], 0.0, rtol=0, atol=0)
+    plus = traced(x, y, thx+ht, thy).propagate(rv.t+0.1)
+    minus = traced(x, y, thx-ht, thy).propagate(rv.t+0.1)
+    np.testing.assert_allclose(
+        d2[2, 0:3, w], ((plus.r - minus.r)/(2*ht))[w],
+        rtol=0, atol=1e-3
+    )
+
+    # Differentials follow copies, slices and pickles.
+    rv3 = rv.copy()
+    np.testing.assert_array_equal(rv3.differentials, d)
+    assert rv3.differentials is not d
+    np.testing.assert_array_equal(rv[10:20].differentials, d[..., 10:20])
+    np.testing.assert_array_equal(rv[w].differentials, d[..., w])
+    rv4 = pickle.loads(pickle.dumps(rv))
+    np.testing.assert_array_equal(rv4.differentials, d)
+    rv3.differentials = None
+    assert rv3.differentials is None
+
+    with np.testing.assert_raises(ValueError):
+        rv3.differentials = np.zeros((2, 6, len(rv3)))
+
+    # Splitting traces don't support differentials.
+    rv = batoid.RayVector.asPolar(
+        optic=telescope, wavelength=wavelength, theta_x=thx, theta_y=thy,
+        nrad=5, naz=10, differentials=True
+    )
+    with np.testing.assert_raises(NotImplementedError):
+        telescope.traceSplit(rv)
+
+
+@timer
+def test_focus():
+    rng = np.random.default_rng(57721566490153)
+    # Rays through a common point converge there exactly.
+    target = np.array([0.01, -0.02, 3.0])
+    x = rng.normal(size=1000)
+    y = rng.normal(size=1000)
+    z = rng.normal(scale=0.1, size=1000)
+    v = target - np.stack([x, y, z], axis=1)
+    v /= 1.2*np.linalg.norm(v, axis=1)[:, None]
+    rv = batoid.RayVector(x, y, z, *v.T)
+    focus = rv.focus()
+    assert focus.count == 1000
+    np.testing.assert_allclose(focus.bestFocus, target, rtol=0, atol=1e-12)
+    np.testing.assert_allclose(focus.focusRms, 0.0, rtol=0, atol=1e-12)
+
+    # Compare against a direct computation for traced rays.
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    rvs = [
+        batoid.RayVector.asPolar(
+            optic=telescope, wavelength=620e-9,
+            theta_x=np.deg2rad(thx), theta_y=np.deg2rad(0.1),
+            nrad=20, naz=60
+        )
+        for thx in [0.0, 0.3, 0.6, 0.9]
+    ]
+    rv = telescope.trace(batoid.concatenateRayVectors(rvs))
+    rv = batoid.RayVector(
+        rv.x, rv.y, rv.z, rv.vx, rv.vy, rv.vz, rv.t, rv.wavelength,
+        rng.uniform(0.5, 1.5, size=len(rv)), rv.vignetted, rv.failed,
+        rv.coordSys
+    )
+    point = np.array([0.001, -0.002, 0.1])
+    axis = np.array([0.0, 0.1, 1.0])
+    axis /= np.linalg.norm(axis)
+
+    def check(rays, f, weighted, ignoreVignetted, k=()):
+        w = ~rays.failed
+        if ignoreVignetted:
+            w &= ~rays.vignetted
+        wt = rays.flux[w] if weighted else np.ones(np.sum(w))
+        p = rays.r[w] - point
+        u = rays.v[w]/np.linalg.norm(rays.v[w], axis=1)[:, None]
+        assert f.count[k] == np.sum(w)
+        np.testing.assert_allclose(f.weight[k], np.sum(wt), rtol=1e-12)
+        assert f.nParallel[k] == 0
+
+        b = u@axis
+        d = np.sum(u*p, axis=1)
+        e = p@axis
+        sc = (b*e - d)/(1 - b*b)
+        tc = (e - b*d)/(1 - b*b)
+        c = p + sc[:, None]*u
+        np.testing.assert_allclose(
+            f.axisCrossing[k], point + np.average(c, axis=0, weights=wt),
+            rtol=0, atol=1e-9
+        )
+        np.testing.assert_allclose(
+            f.axisSpread[k],
+            np.sqrt(np.cov(tc, aweights=wt, bias=True)),
+            rtol=1e-8
+        )
+        miss = c - tc[:, None]*axis
+        np.testing.assert_allclose(
+            f.axisMiss[k],
+            np.sqrt(np.average(np.sum(miss**2, axis=1), weights=wt)),
+            rtol=1e-8
+        )
+
+        proj = np.eye(3) - u[:, :, None]*u[:, None, :]
+        M = np.einsum("n,nij->ij", wt, proj)
+        X = np.linalg.solve(M, np.einsum("n,nij,nj->i", wt, proj, p))
+        np.testing.assert_allclose(
+            f.bestFocus[k], point + X, rtol=0, atol=1e-9
+        )
+        dist2 = np.sum(np.cross(X - p, u)**2, axis=1)
+        np.testing.assert_allclose(
+            f.focusRms[k], np.sqrt(np.average(dist2, weights=wt)), rtol=1e-6
+        )
+
+    bounds = np.cumsum([0]+[len(r) for r in rvs])
+    for weighted in [False, True]:
+        for ignoreVignetted in [False, True]:
+            f = rv.focus(
+                point, axis, weighted=weighted,
+                ignoreVignetted=ignoreVignetted
+            )
+            check(rv, f, weighted, ignoreVignetted)
+            f = rv.focus(
+                point, axis, bounds=bounds, weighted=weighted,
+                ignoreVignetted=ignoreVignetted
+            )
+            assert f.bestFocus.shape == (4, 3)
+            for k in range(4):
+                rays = rv[bounds[k]:bounds[k+1]]
+                check(rays, f, weighted, ignoreVignetted, k)
+
+    # Rays parallel to the axis have no closest approach and no focus.
+    rv = batoid.RayVector(x, y, z, 0, 0, 1)
+    focus = rv.focus()
+    assert focus.nParallel == 1000
+    assert np.all(np.isnan(focus.axisCrossing))
+    assert np.all(np.isnan(focus.bestFocus))
+    focus = rv.focus(axis=[1, 0, 1])
+    assert focus.nParallel == 0
+    assert np.all(np.isnan(focus.bestFocus))
+
+    with np.testing.assert_raises(ValueError):
+        rv.focus(bounds=[0, 2000])
+
+    # Rays at tiny but nonzero angles to the axis still cross it.
+    target = np.array([0.0, 0.0, 10.0])
+    x = rng.normal(scale=1e-6, size=100)
+    y = rng.normal(scale=1e-6, size=100)
+    v = target - np.stack([x, y, np.zeros(100)], axis=1)
+    v /= np.linalg.norm(v, axis=1)[:, None]
+    rv = batoid.RayVector(x, y, 0, *v.T)
+    focus = rv.focus()
+    assert focus.nParallel == 0
+    np.testing.assert_allclose(focus.axisCrossing, target, rtol=0, atol=1e-9)
+    np.testing.assert_allclose(focus.axisSpread, 0.0, rtol=0, atol=1e-9)
+
+    # Reference point and axis are validated.
+    srv = batoid.SegmentedRayVector([rv[:50], rv[50:]])
+    for rays in [rv, srv]:
+        for kwargs in [
+            dict(point=[0, 0]),
+            dict(point=np.zeros((1, 3))),
+            dict(axis=[0, 1]),
+            dict(axis=[[0, 0, 1]]),
+            dict(axis=[0, 0, 0]),
+        ]:
+            with np.testing.assert_raises(ValueError):
+                rays.focus(**kwargs)
+
+
 if __name__ == '__main__':
     init_gpu()
     test_properties()
@@ -1075,6 +1821,7 @@ if __name__ == '__main__':
     test_propagate()
     test_phase()
     test_sumAmplitude()
+    test_sumAmplitudeGrid()
     test_equals()
     test_asGrid()
     test_asPolar()
@@ -1082,4 +1829,13 @@ if __name__ == '__main__':
     test_factory_optic()
     test_getitem()
     test_fromStop()
-    test_fromFieldAngles()
\ No newline at end of file
+    test_fromFieldAngles()
+    test_allocation()
+    test_recycle()
+    test_flags()
+    test_uniform()
+    test_view()
+    test_segmented()
+    test_stats()
+    test_differentials()
+    test_focus()
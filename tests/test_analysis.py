@@ -79,6 +79,107 @@ def test_zernikeGQ():
     )
 
 
+@timer
+def test_ZernikeProjector():
+    import galsim
+    telescope = batoid.Optic.fromYaml("LSST_r.yaml")
+    thx, thy = np.deg2rad(0.6), np.deg2rad(-0.8)
+    wavelength = 625e-9
+    rings = 6
+    for eps in [0.0, 0.61]:
+        proj = batoid.ZernikeProjector(
+            telescope, rings=rings, jmax=28, eps=eps
+        )
+        for reference in ['chief', 'mean']:
+            # Reference: project traced asSpokes rays at the stop
+            rays = batoid.RayVector.asSpokes(
+                optic=telescope, wavelength=wavelength,
+                inner=eps*telescope.pupilSize/2,
+                theta_x=thx, theta_y=thy,
+                rings=rings, spacing='GQ'
+            )
+            epRays = rays.copy().toCoordSys(telescope.stopSurface.coordSys)
+            telescope.stopSurface.surface.intersect(epRays)
+            basis = galsim.zernike.zernikeBasis(
+                28, epRays.x, epRays.y,
+                R_outer=telescope.pupilSize/2,
+                R_inner=eps*telescope.pupilSize/2
+            )
+            telescope.trace(rays)
+            if reference == 'chief':
+                chief = batoid.RayVector.fromStop(
+                    0.0, 0.0, optic=telescope, wavelength=wavelength,
+                    theta_x=thx, theta_y=thy
+                )
+                telescope.trace(chief)
+                point = chief.r[0]
+            else:
+                point = np.mean(rays.r[~rays.vignetted], axis=0)
+            R = telescope.sphereRadius
+            target = rays.coordSys.shiftLocal(point+[0, 0, R])
+            rays.toCoordSys(target)
+            batoid.Sphere(-R).intersect(rays)
+            if reference == 'chief':
+                chief.toCoordSys(target)
+                batoid.Sphere(-R).intersect(chief)
+                t0 = chief.t[0]
+            else:
+                t0 = np.mean(rays.t[~rays.vignetted])
+            area = np.pi*(1-eps**2)
+            zk = np.dot(basis, (t0-rays.t)/wavelength*rays.flux)/area
+
+            np.testing.assert_allclose(
+                proj(thx, thy, wavelength, reference=reference), zk,
+                rtol=0, atol=1e-9
+            )
+
+    # Reuse for perturbed optics
+    proj = batoid.ZernikeProjector(telescope, jmax=22)
+    for dz in [1e-5, -3e-5]:
+        perturbed = telescope.withGloballyShiftedOptic(
+            "LSST.LSSTCamera", [0, 0, dz]
+        )
+        np.testing.assert_array_equal(
+            proj(thx, thy, wavelength, optic=perturbed),
+            batoid.zernikeGQ(perturbed, thx, thy, wavelength)
+        )
+
+    # Arrays of field angles are traced together
+    thxs = np.deg2rad([[0.0, 0.5, -1.0], [1.2, 0.3, -0.2]])
+    thys = np.deg2rad([[0.0, -0.7, 0.4], [0.1, 1.1, -1.5]])
+    for reference in ['chief', 'mean']:
+        zks = proj(thxs, thys, wavelength, reference=reference)
+        assert zks.shape == (2, 3, 23)
+        for idx in np.ndindex(thxs.shape):
+            np.testing.assert_allclose(
+                zks[idx],
+                proj(thxs[idx], thys[idx], wavelength, reference=reference),
+                rtol=0, atol=1e-12
+            )
+
+    # The rays of all field points, made together, are those of fromStop
+    m = len(proj.x)
+    rays = proj._fromStop(
+        telescope, proj.x, proj.y, thxs.ravel(), thys.ravel(), wavelength,
+        'postel'
+    )
+    for k, (tx, ty) in enumerate(zip(thxs.ravel(), thys.ravel())):
+        ref = batoid.RayVector.fromStop(
+            proj.x, proj.y, optic=telescope, wavelength=wavelength,
+            theta_x=tx, theta_y=ty
+        )
+        np.testing.assert_allclose(
+            rays.r[k*m:(k+1)*m], ref.r, rtol=0, atol=1e-12
+        )
+        np.testing.assert_allclose(
+            rays.v[k*m:(k+1)*m], ref.v, rtol=0, atol=1e-15
+        )
+        np.testing.assert_array_equal(rays.t[k*m:(k+1)*m], ref.t)
+
+    with np.testing.assert_raises(ValueError):
+        proj(thx, thy, wavelength, reference='Giraffe')
+
+
 @timer
 def test_huygensPSF():
     telescope = batoid.Optic.fromYaml("LSST_r.yaml")
@@ -165,6 +266,161 @@ def test_huygensPSF():
         nx=63,
     )
 
+    # Phase recurrence agrees with direct evaluation
+    for kwargs in [dict(dx=10e-6, dy=11e-6), dict()]:
+        psf5 = batoid.huygensPSF(
+            telescope,
+            np.deg2rad(0.1), np.deg2rad(0.1),
+            620e-9,
+            nx=64,
+            nxOut=48,
+            method='recurrence',
+            **kwargs
+        )
+        psf6 = batoid.huygensPSF(
+            telescope,
+            np.deg2rad(0.1), np.deg2rad(0.1),
+            620e-9,
+            nx=64,
+            nxOut=48,
+            **kwargs
+        )
+        assert np.array_equal(psf5.primitiveVectors, psf6.primitiveVectors)
+        np.testing.assert_allclose(
+            psf5.array, psf6.array, rtol=0, atol=1e-12*np.max(psf6.array)
+        )
+        # As does the nonuniform FFT, to within its tolerance
+        psf7 = batoid.huygensPSF(
+            telescope,
+            np.deg2rad(0.1), np.deg2rad(0.1),
+            620e-9,
+            nx=64,
+            nxOut=48,
+            method='nufft',
+            tol=1e-10,
+            **kwargs
+        )
+        np.testing.assert_allclose(
+            psf7.array, psf6.array, rtol=0, atol=1e-8*np.max(psf6.array)
+        )
+
+    with np.testing.assert_raises(ValueError):
+        batoid.huygensPSF(
+            telescope,
+            np.deg2rad(0.1), np.deg2rad(0.1),
+            620e-9,
+            nx=64,
+            method='Giraffe'
+        )
+    for tol in [0.0, -1e-10, 1.0]:
+        with np.testing.assert_raises(ValueError):
+            batoid.huygensPSF(
+                telescope,
+                np.deg2rad(0.1), np.deg2rad(0.1),
+                620e-9,
+                nx=64,
+                method='nufft',
+                tol=tol
+            )
+
+
+@timer
+def test_wavefront():
+    telescope = batoid.Optic.fromYaml("HSC.yaml")
+    thx, thy = np.deg2rad(0.3), np.deg2rad(-0.4)
+    wavelength = 700e-9
+    nx = 64
+    for reference in ['chief', 'mean']:
+        wf = batoid.wavefront(
+            telescope, thx, thy, wavelength, nx=nx, reference=reference
+        )
+
+        # Compare to transforming the rays and intersecting a Sphere
+        rays = batoid.RayVector.asGrid(
+            optic=telescope, wavelength=wavelength, nx=nx,
+            theta_x=thx, theta_y=thy
+        )
+        telescope.trace(rays)
+        cridx = (nx//2)*nx+nx//2
+        if reference == 'chief':
+            point = rays.r[cridx]
+        else:
+            point = np.mean(rays.r[~rays.vignetted], axis=0)
+        R = telescope.sphereRadius
+        rays.toCoordSys(rays.coordSys.shiftLocal(point+[0, 0, R]))
+        batoid.Sphere(-R).intersect(rays)
+        if reference == 'chief':
+            t0 = rays.t[cridx]
+        else:
+            t0 = np.mean(rays.t[~rays.vignetted])
+        np.testing.assert_array_equal(
+            wf.array.mask, rays.vignetted.reshape(nx, nx)
+        )
+        # Not bit-identical: wavefront intersects the sphere without
+        # transforming the rays, and sums the mean reference in a different
+        # order, so results agree only to rounding (1e-7 waves is ~1e-13 m).
+        np.testing.assert_allclose(
+            wf.array.data, ((t0-rays.t)/wavelength).reshape(nx, nx),
+            rtol=0, atol=1e-7
+        )
+
+    with np.testing.assert_raises(ValueError):
+        batoid.wavefront(telescope, thx, thy, wavelength, reference='Giraffe')
+
+    # The chief ray must be in the grid.
+    rays = batoid.RayVector.asGrid(
+        optic=telescope, wavelength=wavelength, nx=4,
+        theta_x=thx, theta_y=thy
+    )
+    telescope.trace(rays)
+    for nx, reference in [(6, 'chief'), (6, 'mean'), (3, 'chief')]:
+        with np.testing.assert_raises(ValueError):
+            batoid.analysis._wavefrontFromRays(
+                telescope, rays, wavelength, nx, None, reference
+            )
+    with np.testing.assert_raises(ValueError):
+        batoid.analysis._wavefrontFromRays(
+            telescope, rays[:0], wavelength, 0, None, 'chief'
+        )
+
+
+@timer
+def test_fftPSFBatch():
+    telescope = batoid.Optic.fromYaml("LSST_r.yaml")
+    thx = np.deg2rad([0.0, 0.5, -1.2])
+    thy = np.deg2rad([0.0, 0.3, 0.7])
+    wavelengths = [500e-9, 625e-9]
+    for reference in ['chief', 'mean']:
+        psfs = batoid.fftPSFBatch(
+            telescope, thx, thy, wavelengths, nx=32, reference=reference
+        )
+        assert psfs.shape == (2, 3)
+        for k, wavelength in enumerate(wavelengths):
+            for i in range(3):
+                psf = batoid.fftPSF(
+                    telescope, thx[i], thy[i], wavelength, nx=32,
+                    reference=reference
+                )
+                # Rays are generated once per field angle, so their positions
+                # can differ from fftPSF's in the last bit.
+                np.testing.assert_allclose(
+                    psfs[k, i].array, psf.array,
+                    rtol=0, atol=1e-6*np.max(psf.array)
+                )
+                np.testing.assert_allclose(
+                    psfs[k, i].primitiveVectors, psf.primitiveVectors,
+                    rtol=1e-8, atol=0
+                )
+
+    # Scalar wavelength and 2d field grid
+    thx, thy = np.meshgrid(np.deg2rad([-1, 1]), np.deg2rad([-0.5, 0, 0.5]))
+    psfs = batoid.fftPSFBatch(telescope, thx, thy, 625e-9, nx=16)
+    assert psfs.shape == (3, 2)
+    psf = batoid.fftPSF(telescope, thx[2, 1], thy[2, 1], 625e-9, nx=16)
+    np.testing.assert_allclose(
+        psfs[2, 1].array, psf.array, rtol=0, atol=1e-6*np.max(psf.array)
+    )
+
 
 @timer
 def test_doubleZernike():
@@ -212,6 +468,64 @@ def test_doubleZernike():
     )
     np.testing.assert_allclose(dz, dz2, rtol=0, atol=1e-2)
 
+    # Batched trace and projections match a loop over field points
+    field = np.deg2rad(1.75)
+    rings, spokes = 5, 11
+    Li, w = np.polynomial.legendre.leggauss(rings)
+    radii, azs = np.meshgrid(
+        np.sqrt((1+Li)/2)*field,
+        np.linspace(0, 2*np.pi, spokes, endpoint=False)
+    )
+    w = np.broadcast_to(w*np.pi/(2*spokes), radii.shape).ravel()
+    thx = (radii*np.cos(azs)).ravel()
+    thy = (radii*np.sin(azs)).ravel()
+    for reference in ['chief', 'mean']:
+        coefs = np.array([
+            batoid.zernikeGQ(
+                telescope, thx_, thy_, 625e-9,
+                rings=rings, spokes=spokes, jmax=15, reference=reference
+            )
+            for thx_, thy_ in zip(thx, thy)
+        ])
+        basis = galsim.zernike.zernikeBasis(10, thx, thy, R_outer=field)
+        np.testing.assert_allclose(
+            batoid.doubleZernike(
+                telescope, field, 625e-9, rings=rings, spokes=spokes,
+                kmax=10, jmax=15, reference=reference
+            ),
+            np.dot(basis, coefs*w[:, None])/np.pi,
+            rtol=0, atol=1e-12
+        )
+
+
+@timer
+def test_differential_jacobians():
+    telescope = batoid.Optic.fromYaml("LSST_r.yaml")
+    for thx, thy in [(0.0, 0.0), (0.01, -0.005), (-0.02, 0.015)]:
+        # Propagated differentials agree with finite differences
+        fd = batoid.drdth(telescope, thx, thy, 625e-9, method='finite')
+        diff = batoid.drdth(telescope, thx, thy, 625e-9)
+        np.testing.assert_allclose(
+            diff, fd, rtol=0, atol=1e-5*np.max(np.abs(fd))
+        )
+        np.testing.assert_allclose(
+            batoid.dthdr(telescope, thx, thy, 625e-9),
+            np.linalg.inv(diff),
+            rtol=1e-12
+        )
+
+        # and the mean local dk/du is close to the plane fit.
+        fit = batoid.dkdu(telescope, thx, thy, 625e-9)
+        diff = batoid.dkdu(telescope, thx, thy, 625e-9, method='differential')
+        np.testing.assert_allclose(
+            diff, fit, rtol=0, atol=1e-2*np.max(np.abs(fit))
+        )
+
+    with np.testing.assert_raises(ValueError):
+        batoid.drdth(telescope, 0.0, 0.0, 625e-9, method='Giraffe')
+    with np.testing.assert_raises(ValueError):
+        batoid.dkdu(telescope, 0.0, 0.0, 625e-9, method='Giraffe')
+
 
 @timer
 def test_huygens_paraboloid(plot=False):
@@ -365,6 +679,10 @@ if __name__ == '__main__':
 
     init_gpu()
     test_zernikeGQ()
+    test_ZernikeProjector()
     test_huygensPSF()
+    test_wavefront()
+    test_fftPSFBatch()
     test_doubleZernike()
+    test_differential_jacobians()
     test_huygens_paraboloid(args.plot)
@@ -76,14 +76,15 @@ def do_pickle(obj, reprable=True):
             complex128, ndarray
         )
         from batoid import (
-            RayVector,
+            RayVector, SegmentedRayVector,
             Plane, Paraboloid, Sphere, Quadric, Asphere,
-            Bicubic, Sum, Tilted, Zernike,
+            Bicubic, Sum, Tilted, Zernike, RadialSpline,
             ConstMedium, TableMedium, SellmeierMedium, SumitaMedium, Air,
+            TabulatedMedium,
             ObscCircle, ObscAnnulus, ObscRectangle, ObscRay, ObscPolygon,
-            ObscNegation, ObscUnion, ObscIntersection,
+            ObscBitmap, ObscNegation, ObscUnion, ObscIntersection,
             CoordSys, CoordTransform,
-            SimpleCoating,
+            SimpleCoating, TableCoating, MultilayerCoating,
             Optic, CompoundOptic, Baffle, Mirror, Lens, RefractiveInterface,
             OPDScreen, Detector,
             Lattice